@@ -0,0 +1,129 @@
+#ifndef __ADAPTIVE_WAIT_HPP__
+#define __ADAPTIVE_WAIT_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/**
+ * Counters for one stage of a pipeline (e.g. the BAM reader, or the
+ * quantification threads): how long its threads spent waiting for work
+ * (idle), and how long they ran in total.  Busy time is the difference.
+ */
+struct WaitStats {
+  std::atomic<uint64_t> idleNanos{0};
+  std::atomic<uint64_t> activeNanos{0};
+  // The number of waits that had to wait at all, and that had to park
+  std::atomic<uint64_t> numWaits{0};
+  std::atomic<uint64_t> numParks{0};
+
+  // Record that a thread of this stage ran for `nanos`
+  void addActive(uint64_t nanos) { activeNanos += nanos; }
+
+  double idleSeconds() const { return idleNanos.load() * 1e-9; }
+  double busySeconds() const {
+    uint64_t active = activeNanos.load();
+    uint64_t idle = idleNanos.load();
+    return (active > idle) ? (active - idle) * 1e-9 : 0.0;
+  }
+
+  void reset() {
+    idleNanos = 0;
+    activeNanos = 0;
+    numWaits = 0;
+    numParks = 0;
+  }
+};
+
+/**
+ * Wait for a condition by spinning briefly, then yielding, and finally
+ * parking on a condition variable.  Short waits (the common case when the
+ * producer and consumer of a queue keep pace) never enter the kernel, while
+ * long waits don't burn a core.
+ *
+ * The condition is given to wait() as a predicate, which may have side
+ * effects (e.g. "try to pop from the queue").  Producers must call
+ * notifyOne() / notifyAll() after making the condition true; this is
+ * cheap (a fence and a load) when nobody is parked.  Parked threads also
+ * re-check the condition every maxPark, so a missed notification only
+ * costs latency.
+ */
+class AdaptiveWait {
+public:
+  explicit AdaptiveWait(uint32_t numSpins = 256, uint32_t numYields = 32,
+                        std::chrono::microseconds maxPark = std::chrono::microseconds(1000))
+      : numSpins_(numSpins), numYields_(numYields), maxPark_(maxPark) {}
+
+  AdaptiveWait(const AdaptiveWait&) = delete;
+  AdaptiveWait& operator=(const AdaptiveWait&) = delete;
+
+  template <typename PredT>
+  void wait(PredT pred, WaitStats* stats = nullptr) {
+    if (pred()) { return; }
+    auto start = std::chrono::steady_clock::now();
+    bool parked{false};
+    bool done{false};
+    for (uint32_t i = 0; i < numSpins_ and !done; ++i) {
+      cpuRelax_();
+      done = pred();
+    }
+    for (uint32_t i = 0; i < numYields_ and !done; ++i) {
+      std::this_thread::yield();
+      done = pred();
+    }
+    if (!done) {
+      parked = true;
+      std::unique_lock<std::mutex> l(mutex_);
+      // (The seq_cst increment pairs with the fence in notify_.)
+      numParked_.fetch_add(1);
+      while (!pred()) {
+        cv_.wait_for(l, maxPark_);
+      }
+      numParked_.fetch_sub(1);
+    }
+    if (stats != nullptr) {
+      auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start).count();
+      stats->idleNanos += nanos;
+      ++stats->numWaits;
+      if (parked) { ++stats->numParks; }
+    }
+  }
+
+  void notifyOne() { notify_(false); }
+  void notifyAll() { notify_(true); }
+
+private:
+  static inline void cpuRelax_() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  void notify_(bool all) {
+    // Make the producer's update visible before checking for parked
+    // threads; a thread that parks after this point will see the update.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numParked_.load(std::memory_order_relaxed) == 0) { return; }
+    // Taking the lock means that a thread that has checked the condition,
+    // but not yet started waiting, can't miss this notification.
+    { std::lock_guard<std::mutex> l(mutex_); }
+    if (all) {
+      cv_.notify_all();
+    } else {
+      cv_.notify_one();
+    }
+  }
+
+  uint32_t numSpins_;
+  uint32_t numYields_;
+  std::chrono::microseconds maxPark_;
+  std::atomic<uint32_t> numParked_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+#endif // __ADAPTIVE_WAIT_HPP__
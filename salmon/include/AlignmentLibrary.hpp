@@ -25,6 +25,7 @@ extern "C" {
 #include "ErrorModel.hpp"
 #include "AlignmentModel.hpp"
 #include "FASTAParser.hpp"
+#include "TranscriptSequenceArena.hpp"
 #include "concurrentqueue.h"
 #include "EquivalenceClassBuilder.hpp"
 #include "SpinLock.hpp" // RapMap's with try_lock
@@ -124,7 +125,7 @@ class AlignmentLibrary {
 
             fmt::print(stderr, "Populating targets from aln = {}, fasta = {} . . .",
                        alnFiles.front(), transcriptFile_);
-            fp.populateTargets(transcripts_, salmonOpts);
+            fp.populateTargets(transcripts_, transcriptSeqs_, salmonOpts);
             /*
 	    for (auto& txp : transcripts_) {
 		    // Length classes taken from
@@ -270,6 +271,8 @@ class AlignmentLibrary {
     std::vector<Transcript>& transcripts() { return transcripts_; }
     const std::vector<Transcript>& transcripts() const { return transcripts_; }
 
+    TranscriptSequenceArena& transcriptSequences() { return transcriptSeqs_; }
+
     inline bool getAlignmentGroup(AlignmentGroup<FragT>*& ag) { return bq->getAlignmentGroup(ag); }
 
     //inline t_pool* threadPool() { return threadPool_.get(); }
@@ -304,6 +307,8 @@ class AlignmentLibrary {
 
     inline BAMQueue<FragT>& getAlignmentGroupQueue() { return *bq.get(); }
 
+    inline AdaptiveWait& poolRefilled() { return bq->poolRefilled(); }
+
     inline size_t upperBoundHits() { return bq->numMappedFragments(); }
     inline size_t numObservedFragments() const { return bq->numObservedFragments(); }
     inline size_t numMappedFragments() const { return bq->numMappedFragments(); }
@@ -489,6 +494,11 @@ class AlignmentLibrary {
      * fragment library.
      */
     LibraryFormat libFmt_;
+    /**
+     * The sequences of the transcripts, which borrow them from here (so this
+     * must be declared before, and outlive, transcripts_).
+     */
+    TranscriptSequenceArena transcriptSeqs_;
     /**
      * The targets (transcripts) to be quantified.
      */
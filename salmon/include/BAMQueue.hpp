@@ -13,15 +13,18 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <type_traits>
 
 #include <boost/timer/timer.hpp>
 #include <boost/filesystem.hpp>
 #include <tbb/concurrent_queue.h>
+#include "AdaptiveWait.hpp"
 #include "AlignmentGroup.hpp"
 #include "LibraryFormat.hpp"
 #include "SalmonMath.hpp"
 #include "ReadPair.hpp"
 #include "UnpairedRead.hpp"
+#include "StadenUtils.hpp"
 #include "spdlog/spdlog.h"
 #include "concurrentqueue.h"
 #include "readerwriterqueue.h"
@@ -70,6 +73,11 @@ public:
   void start(FilterT filt, bool onlyProcessAmbiguousAlignments = false);
 
   inline bool getAlignmentGroup(AlignmentGroup<FragT*>*& group);
+  // Append up to maxGroups parsed alignment groups to `groups`.  This waits
+  // until at least one group is available, and returns 0 only once parsing
+  // is finished and every group has been consumed.
+  inline size_t getAlignmentGroups(std::vector<AlignmentGroup<FragT*>*>& groups,
+                                   size_t maxGroups);
 
   // Return the number of reads processed so far by the queue
   size_t numObservedAlignments();
@@ -79,6 +87,13 @@ public:
 
   void reset();
 
+  // How long the consumer(s) of alignment groups waited for them
+  WaitStats& consumerWaitStats();
+
+  // Notified by whoever returns fragments or alignment groups to the pools
+  // (see MiniBatchInfo::release), to wake the decoding threads waiting on them
+  AdaptiveWait& poolRefilled();
+
   tbb::concurrent_queue<FragT*>& getFragmentQueue();
   //moodycamel::ConcurrentQueue<FragT*>& getFragmentQueue();
 
@@ -86,19 +101,62 @@ public:
   moodycamel::ConcurrentQueue<AlignmentGroup<FragT*>*>& getAlignmentGroupQueue();
 
 private:
+  /**
+   * A batch of consecutive alignment records, as read from the file.  A
+   * slab never splits the records of a single read (i.e. a read-name group,
+   * or the two ends of a pair), so each slab can be turned into alignment
+   * groups independently of the others.
+   */
+  struct RecordSlab {
+    std::vector<bam_seq_t*> recs;
+    // The number of valid records, and the next one to be consumed
+    size_t size{0};
+    size_t next{0};
+
+    ~RecordSlab() {
+      for (auto r : recs) { staden::utils::bam_destroy(r); }
+    }
+  };
+
+  // Counts accumulated by a decoding thread over a slab
+  struct ParseCounts {
+    size_t numAlignments{0};
+    size_t numUnaligned{0};
+    size_t numMapped{0};
+    size_t numUniquelyMapped{0};
+  };
+
   size_t popNum{0};
   /** Fill the queue with the appropriate type of alignment
-   * depending on the template paramater T
+   * depending on the template paramater T.  This reads records into slabs,
+   * which are turned into alignment groups by numDecodeThreads_ threads
+   * running decodeSlabs_.
    */
   template <typename FilterT>
   void fillQueue_(FilterT, bool);
 
+  // Take an empty slab from the pool (waiting for one if necessary)
+  RecordSlab* acquireSlab_();
+
+  template <typename FilterT>
+  void decodeSlabs_(FilterT filt, bool onlyProcessAmbiguousAlignments);
+
+  // Move the next record of the slab into rec (the slab keeps rec's old
+  // buffer for reuse).
+  inline bool nextRecord_(RecordSlab& slab, bam_seq_t*& rec);
+
   /** Overload of getFrag_ for paired-end reads */
   template <typename FilterT>
-  inline bool getFrag_(ReadPair& rpair, FilterT filt);
+  inline bool getFrag_(ReadPair& rpair, RecordSlab& slab, FilterT filt,
+                       ParseCounts& counts);
   /** Overload of getFrag_ for single-end reads */
   template <typename FilterT>
-  inline bool getFrag_(UnpairedRead& sread, FilterT filt);
+  inline bool getFrag_(UnpairedRead& sread, RecordSlab& slab, FilterT filt,
+                       ParseCounts& counts);
+
+  // Pass a fragment to the (shared) output filter
+  template <typename FilterT>
+  inline void filterFrag_(FilterT filt, FragT* frag);
 
 public:
   bool verbose=false;
@@ -112,10 +170,10 @@ private:
   SAM_hdr* hdr_ = nullptr;
 
   //htsFile* fp_ = nullptr;
-  size_t totalAlignments_;
-  size_t numUnaligned_;
-  size_t numMappedReads_;
-  size_t numUniquelyMappedReads_;
+  std::atomic<size_t> totalAlignments_;
+  std::atomic<size_t> numUnaligned_;
+  std::atomic<size_t> numMappedReads_;
+  std::atomic<size_t> numUniquelyMappedReads_;
   tbb::concurrent_queue<FragT*> fragmentQueue_;
   //moodycamel::ConcurrentQueue<FragT*> fragmentQueue_;
 
@@ -123,14 +181,38 @@ private:
   moodycamel::ConcurrentQueue<AlignmentGroup<FragT*>*> alnGroupPool_;
 
   //tbb::concurrent_bounded_queue<AlignmentGroup<FragT*>*> alnGroupQueue_;
-  moodycamel::ReaderWriterQueue<AlignmentGroup<FragT*>*> alnGroupQueue_;
+  // Filled by all of the decoding threads
+  moodycamel::ConcurrentQueue<AlignmentGroup<FragT*>*> alnGroupQueue_;
+
+  // Empty slabs, and slabs that have been read but not yet decoded
+  moodycamel::ConcurrentQueue<RecordSlab*> slabPool_;
+  moodycamel::ConcurrentQueue<RecordSlab*> readySlabs_;
+  std::vector<std::unique_ptr<RecordSlab>> slabs_;
+  std::atomic<bool> doneReading_{false};
+  uint32_t numDecodeThreads_{1};
+  // The (minimum) number of records per slab
+  static constexpr size_t recordsPerSlab_{4096};
+  std::atomic<size_t> numFragAlloc_{0};
+  std::atomic<bool> notifiedExhausted_{false};
+
+  // Waits between the stages (reader -> decoders -> consumer), and for the
+  // pools to be refilled by the quantification threads.
+  AdaptiveWait groupsReady_;
+  AdaptiveWait slabsReady_;
+  AdaptiveWait slabsFree_;
+  AdaptiveWait poolRefilled_;
+  WaitStats readerStats_;
+  WaitStats decoderStats_;
+  WaitStats consumerStats_;
+  // The output filter isn't thread-safe
+  std::mutex filterMutex_;
 
   /*
   boost::lockfree::spsc_queue<AlignmentGroup<FragT*>*,
                               boost::lockfree::capacity<65535>> alnGroupQueue_;
                               */
-  volatile bool doneParsing_;
-  volatile bool exhaustedAlnGroupPool_;
+  std::atomic<bool> doneParsing_;
+  std::atomic<bool> exhaustedAlnGroupPool_;
   std::unique_ptr<std::thread> parsingThread_;
   std::shared_ptr<spdlog::logger> logger_;
 
@@ -20,6 +20,20 @@ BAMQueue<FragT>::BAMQueue(std::vector<boost::filesystem::path>& fnames, LibraryF
         logger_ = spdlog::get("jointLog");
 
         uint32_t localCacheSize = std::max(uint32_t{2000000}, cacheSize);
+
+        // The parse threads are shared between io_lib's (block)
+        // decompression and our record decoding.
+        numDecodeThreads_ = std::max(uint32_t{1}, numParseThreads / 2);
+        size_t numSlabs = 4 * numDecodeThreads_ + 2;
+        for (size_t i = 0; i < numSlabs; ++i) {
+            slabs_.emplace_back(new RecordSlab);
+            auto& recs = slabs_.back()->recs;
+            recs.reserve(recordsPerSlab_ + 1);
+            for (size_t j = 0; j < recordsPerSlab_; ++j) {
+                recs.push_back(staden::utils::bam_init());
+            }
+            slabPool_.enqueue(slabs_.back().get());
+        }
         uint32_t capacity{localCacheSize};
         for (size_t i = 0; i < capacity; ++i) {
             // avoid r-value ref until we figure out what's
@@ -159,52 +173,40 @@ BAMQueue<FragT>::~BAMQueue() {
     fmt::print(stderr, "done\n");
 }
 
-/*
- * Tries _numTries_ times to get work from _workQueue_.  It returns
- * true immediately if it was able to find work, and false otherwise.
- */
-template <typename FragT>
-inline bool tryToGetWork(moodycamel::ReaderWriterQueue<AlignmentGroup<FragT*>*>& workQueue,
-                         AlignmentGroup<FragT*>*& group,
-                         uint32_t numTries) {
-    uint32_t attempts{1};
-    bool foundWork = workQueue.try_dequeue(group);
-    while (!foundWork and attempts < numTries) {
-        foundWork = workQueue.try_dequeue(group);
-        ++attempts;
-    }
-    return foundWork;
-}
-
-
-
-
 template <typename FragT>
 inline bool BAMQueue<FragT>::getAlignmentGroup(AlignmentGroup<FragT*>*& group) {
-    while (!doneParsing_) {
-        while (alnGroupQueue_.try_dequeue(group)) {
-            return true;
-        }
-/*
-#if not defined(__APPLE__)
-{
-            std::unique_lock<std::mutex> l(agMutex_);
-            workAvailable_.wait(l, [&group, this]() { 
-                                    return this->alnGroupQueue_.try_dequeue(group) or this->doneParsing_; 
-                                });
-            return !doneParsing_;
+    bool found{false};
+    groupsReady_.wait([this, &group, &found]() -> bool {
+            found = alnGroupQueue_.try_dequeue(group);
+            return found or doneParsing_;
+        }, &consumerStats_);
+    // If parsing is finished, this can only fail once the queue is empty
+    return found or alnGroupQueue_.try_dequeue(group);
 }
-#endif
-    }
-*/
-    }
 
-    while (alnGroupQueue_.try_dequeue(group)) {
-        return true;
+template <typename FragT>
+inline size_t BAMQueue<FragT>::getAlignmentGroups(std::vector<AlignmentGroup<FragT*>*>& groups,
+                                                  size_t maxGroups) {
+    size_t offset = groups.size();
+    groups.resize(offset + maxGroups);
+    size_t n{0};
+    groupsReady_.wait([this, &groups, &n, offset, maxGroups]() -> bool {
+            n = alnGroupQueue_.try_dequeue_bulk(groups.begin() + offset, maxGroups);
+            return n > 0 or doneParsing_;
+        }, &consumerStats_);
+    if (n == 0) {
+        n = alnGroupQueue_.try_dequeue_bulk(groups.begin() + offset, maxGroups);
     }
-    return false;
+    groups.resize(offset + n);
+    return n;
 }
 
+template <typename FragT>
+WaitStats& BAMQueue<FragT>::consumerWaitStats() { return consumerStats_; }
+
+template <typename FragT>
+AdaptiveWait& BAMQueue<FragT>::poolRefilled() { return poolRefilled_; }
+
 template <typename FragT>
 void BAMQueue<FragT>::forceEndParsing() { doneParsing_ = true; }
 
@@ -223,6 +225,9 @@ std::vector<SAM_hdr*> BAMQueue<FragT>::headers() {
 template <typename FragT>
 template <typename FilterT>
 void BAMQueue<FragT>::start(FilterT filt, bool onlyProcessAmbiguousAlignments) {
+    readerStats_.reset();
+    decoderStats_.reset();
+    consumerStats_.reset();
     // Start the parsing thread that will fill the queue
     parsingThread_.reset(new std::thread([this, filt, onlyProcessAmbiguousAlignments]()-> void {
             this->fillQueue_(filt, onlyProcessAmbiguousAlignments);
@@ -337,7 +342,8 @@ inline uint32_t getPairedNameLen(bam_seq_t* read) {
 
 template <typename FragT>
 template <typename FilterT>
-inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
+inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, RecordSlab& slab, FilterT filt,
+                                      ParseCounts& counts) {
     bool haveValidPair{false};
     bool didRead1{false};
     bool didRead2{false};
@@ -346,7 +352,7 @@ inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
     // Until we get a valid pair of reads
     while (!haveValidPair) {
         // Consume a single read
-        didRead1 = (scram_get_seq(fp_, &rpair.read1) >= 0);
+        didRead1 = nextRecord_(slab, rpair.read1);
         AlignmentType alnType;
         // If we were able to obtain a read, determine what type
         // of alignment it came from.
@@ -362,10 +368,10 @@ inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
 
             switch (alnType) {
                 case AlignmentType::UnmappedOrphan:
-                    ++numUnaligned_;
+                    ++counts.numUnaligned;
                     if (filt != nullptr) {
                         rpair.orphanStatus = salmon::utils::OrphanStatus::LeftOrphan;
-                        filt->processFrag(&rpair);
+                        filterFrag_(filt, &rpair);
                     }
                     break;
                     // === end of UnmappedOrphan case
@@ -402,27 +408,19 @@ inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
             }
             // If this was not a properly mapped orphan read, then grab the next
             // read.
-            didRead1 = (scram_get_seq(fp_, &rpair.read1) >= 0);
+            didRead1 = nextRecord_(slab, rpair.read1);
         }
 
-        didRead2 = (scram_get_seq(fp_, &rpair.read2) >=0);
+        didRead2 = nextRecord_(slab, rpair.read2);
 
-        // If we didn't get a read, then we've exhausted this file. 
+        // If we didn't get a read, then we've exhausted this slab.  Slabs
+        // never split a pair, so this only discards a single, unpaired read
+        // at the end of a file.
         // NOTE: I'm not sure about the *or* condition here. In some cases, we
         // may be discarding a single read, but it won't be properly paired
         // anyway. Figure out what the right thing is to do here.
         if (!didRead1 or !didRead2) { 
-            // close the current file
-            scram_close(currFile_->fp);
-            currFile_->fp = nullptr;
-            // increment the file iterator
-            currFile_++;
-            // If this is the last file, then we're done
-            if (currFile_ == files_.end()) { return false; }
-            // Otherwise, start parsing the next file.
-            fp_ = scram_open(currFile_->fileName.c_str(), currFile_->readMode.c_str());
-            hdr_ = currFile_->header;
-            continue;
+            return false;
         }
 
         // If we expected a paired read, but didn't find one
@@ -509,10 +507,10 @@ inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
                 rpair.orphanStatus = salmon::utils::OrphanStatus::Paired;
                 break;
             case AlignmentType::UnmappedPair:
-                ++numUnaligned_;
+                ++counts.numUnaligned;
                 if ((filt != nullptr) and sameName) {
                     rpair.orphanStatus = salmon::utils::OrphanStatus::Paired;
-                    filt->processFrag(&rpair);
+                    filterFrag_(filt, &rpair);
                 }
                 break;
             default:
@@ -521,7 +519,7 @@ inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
                 std::exit(1);
                 break;
         }
-        ++totalAlignments_;
+        ++counts.numAlignments;
     }
     rpair.logProb = salmon::math::LOG_0;
     return true;
@@ -529,23 +527,15 @@ inline bool BAMQueue<FragT>::getFrag_(ReadPair& rpair, FilterT filt) {
 
 template <typename FragT>
 template <typename FilterT>
-inline bool BAMQueue<FragT>::getFrag_(UnpairedRead& sread, FilterT filt) {
+inline bool BAMQueue<FragT>::getFrag_(UnpairedRead& sread, RecordSlab& slab, FilterT filt,
+                                      ParseCounts& counts) {
     bool haveValidRead{false};
 
     while (!haveValidRead) {
-        bool didRead = (scram_get_seq(fp_, &sread.read) >= 0);
-        // If we didn't get a read, then we've exhausted this file
+        bool didRead = nextRecord_(slab, sread.read);
+        // If we didn't get a read, then we've exhausted this slab
         if (!didRead) { 
-            // close the current file
-            scram_close(currFile_->fp);
-            currFile_->fp = nullptr;
-            currFile_++;
-            // If this is the last file, then we're done
-            if (currFile_ == files_.end()) { return false; }
-            // Otherwise, start parsing the next file.
-            fp_ = scram_open(currFile_->fileName.c_str(), currFile_->readMode.c_str());
-            hdr_ = currFile_->header;
-            continue;
+            return false;
         }
 
         if (!(bam_flag(sread.read) & BAM_FDUP) and
@@ -557,11 +547,11 @@ inline bool BAMQueue<FragT>::getFrag_(UnpairedRead& sread, FilterT filt) {
 
         if (!haveValidRead) { 
             if (filt != nullptr) {
-                filt->processFrag(&sread);
+                filterFrag_(filt, &sread);
             }
-            ++numUnaligned_; 
+            ++counts.numUnaligned; 
         }
-        ++totalAlignments_;
+        ++counts.numAlignments;
     }
 
     sread.logProb = salmon::math::LOG_0;
@@ -585,140 +575,272 @@ size_t BAMQueue<FragT>::numUniquelyMappedFragments(){
 }
 
 
+template <typename FragT>
+inline bool BAMQueue<FragT>::nextRecord_(RecordSlab& slab, bam_seq_t*& rec) {
+    if (slab.next >= slab.size) { return false; }
+    std::swap(rec, slab.recs[slab.next]);
+    ++slab.next;
+    return true;
+}
+
 template <typename FragT>
 template <typename FilterT>
-void BAMQueue<FragT>::fillQueue_(FilterT filt, bool onlyProcessAmbiguousAlignments) {
-    size_t n{0};
-    size_t numFragAlloc{0};
-    AlignmentGroup<FragT*>* alngroup;
-    //alnGroupPool_.pop(alngroup);
-    while (!alnGroupPool_.try_dequeue(alngroup));
-    bool notified{false};
+inline void BAMQueue<FragT>::filterFrag_(FilterT filt, FragT* frag) {
+    std::lock_guard<std::mutex> lock(filterMutex_);
+    filt->processFrag(frag);
+}
 
-    currFile_ = files_.begin();
-    fp_ = currFile_->fp;
-    hdr_ = currFile_->header;
+template <typename FragT>
+typename BAMQueue<FragT>::RecordSlab* BAMQueue<FragT>::acquireSlab_() {
+    RecordSlab* slab{nullptr};
+    slabsFree_.wait([this, &slab]() -> bool { return slabPool_.try_dequeue(slab); },
+                    &readerStats_);
+    slab->size = 0;
+    slab->next = 0;
+    return slab;
+}
+
+/**
+ * Turn slabs of records into alignment groups.  Several threads run this
+ * concurrently; since a slab never splits the records of a read, each slab
+ * is grouped independently.
+ */
+template <typename FragT>
+template <typename FilterT>
+void BAMQueue<FragT>::decodeSlabs_(FilterT filt, bool onlyProcessAmbiguousAlignments) {
+    auto start = std::chrono::steady_clock::now();
+    AlignmentGroup<FragT*>* alngroup;
+    auto getGroup = [this, &alngroup]() -> bool { return alnGroupPool_.try_dequeue(alngroup); };
+    poolRefilled_.wait(getGroup, &decoderStats_);
 
     FragT* f;
     if (!fragmentQueue_.try_pop(f)) {
         f = new FragT;
     }
 
-    uint32_t prevLen{1};
-    char* prevReadName = new char[255];
+    std::string prevReadName;
     bool readAlignsUniquely{false};
     int32_t prevTranscriptId{std::numeric_limits<int32_t>::min()};
+    ParseCounts counts;
+
+    // Send the (complete) current alignment group off to be processed
+    auto finishGroup = [&]() -> void {
+        if (alngroup->size() > 0) {
+            // If we only wish to process ambiguous alignments,
+            // and the current read aligns uniquely, then return 
+            // what we parsed to the appropriate queue and continue
+            if (onlyProcessAmbiguousAlignments and 
+                    readAlignsUniquely) {
+               // return the fragments
+               for (auto aln : alngroup->alignments()) {
+                   fragmentQueue_.push(aln); aln = nullptr;
+               }
+               // clear the alignments vector
+               alngroup->alignments().clear();
+               // continue to use this alignment group
+               counts.numUniquelyMapped++;
+            } else {
+                // push the align group
+                alnGroupQueue_.enqueue(alngroup);
+                groupsReady_.notifyOne();
+                alngroup = nullptr;
+                if (!alnGroupPool_.try_dequeue(alngroup)) {  
+                    exhaustedAlnGroupPool_ = true;
+                    poolRefilled_.wait(getGroup, &decoderStats_);
+                }
+            }
+        }
+        if (readAlignsUniquely) { counts.numUniquelyMapped++; }
+        readAlignsUniquely = false;
+    };
+
+    RecordSlab* slab{nullptr};
+    while (true) {
+        bool gotSlab{false};
+        slabsReady_.wait([this, &slab, &gotSlab]() -> bool {
+                gotSlab = readySlabs_.try_dequeue(slab);
+                return gotSlab or doneReading_;
+            }, &decoderStats_);
+        // Once the reader is done, check again, since it may have pushed a
+        // final slab in the meantime.
+        if (!gotSlab and !readySlabs_.try_dequeue(slab)) { break; }
+
+        prevReadName.clear();
+        while (getFrag_(*f, *slab, filt, counts)) {
+            char* readName = f->getName();
+            uint32_t currLen = f->getNameLength();
+            // if this is a new read
+            if ( (currLen != prevReadName.size()) or
+                !sameReadName_<UnpairedRead>(readName, prevReadName.data(), currLen) ) {
+                finishGroup();
+                readAlignsUniquely = true;
+
+                alngroup->addAlignment(f);
+                prevReadName.assign(readName, currLen);
+                prevTranscriptId = f->transcriptID();
+                f = nullptr;
+                counts.numMapped++;
+            } else { // otherwise, this is another alignment for the same read
+
+                // If the new alignment for the read is to a 
+                // different transcript, then it's not a unique mapper
+                if (readAlignsUniquely and f->transcriptID() != prevTranscriptId) {
+                    readAlignsUniquely = false;
+                }
+
+                alngroup->addAlignment(f);
+                f = nullptr;
+           }
 
-    while(getFrag_(*f, filt)) {
-
-        char* readName = f->getName();
-        uint32_t currLen = f->getNameLength();
-        // if this is a new read
-        if ( (currLen != prevLen) or
-            !sameReadName_<UnpairedRead>(readName, prevReadName, currLen) ) {
-
-            if (alngroup->size() > 0) {
-
-                // If we only wish to process ambiguous alignments,
-                // and the current read aligns uniquely, then return 
-                // what we parsed to the appropriate queue and continue
-                if (onlyProcessAmbiguousAlignments and 
-                        readAlignsUniquely) {
-                   // return the fragments
-                   for (auto aln : alngroup->alignments()) {
-                       fragmentQueue_.push(aln); aln = nullptr;
-                   }
-                   // clear the alignments vector
-                   alngroup->alignments().clear();
-                   // continue to use this alignment group
-                   numUniquelyMappedReads_++;
+            if (!fragmentQueue_.try_pop(f)) {
+                if (!exhaustedAlnGroupPool_) {
+                    f = new FragT;
+                    ++numFragAlloc_;
                 } else {
-                    // push the align group
-                    while(!alnGroupQueue_.try_enqueue(alngroup));
-                    alngroup = nullptr;
-                    if (!alnGroupPool_.try_dequeue(alngroup)) {  
-                        exhaustedAlnGroupPool_ = true;
-                        //alnGroupPool_.pop(alngroup);
-                        while(!alnGroupPool_.try_dequeue(alngroup));
-                    }
+                    poolRefilled_.wait([this, &f]() -> bool { return fragmentQueue_.try_pop(f); },
+                                       &decoderStats_);
                 }
             }
-            
-            if (readAlignsUniquely) { numUniquelyMappedReads_++; }
-            readAlignsUniquely = true;
-
-            alngroup->addAlignment(f);
-            memcpy(prevReadName, readName, currLen);
-            prevLen = currLen;
-            prevTranscriptId = f->transcriptID();
-            f = nullptr;
-            numMappedReads_++;
-        } else { // otherwise, this is another alignment for the same read
-
-            // If the new alignment for the read is to a 
-            // different transcript, then it's not a unique mapper
-            if (readAlignsUniquely and f->transcriptID() != prevTranscriptId) {
-                readAlignsUniquely = false;
-            }
 
-            alngroup->addAlignment(f);
-            f = nullptr;
-       }
+           if (exhaustedAlnGroupPool_ and !notifiedExhausted_.exchange(true)) { 
+              logger_->info("\n\nThe alignment group queue pool has been exhausted.  {} extra fragments were allocated "
+                            "on the heap to saturate the pool.  No new fragments will be allocated\n\n",
+                            numFragAlloc_.load());
+           }
+        }
+        // The last read of a slab is complete
+        finishGroup();
+
+        totalAlignments_ += counts.numAlignments;
+        numUnaligned_ += counts.numUnaligned;
+        numMappedReads_ += counts.numMapped;
+        numUniquelyMappedReads_ += counts.numUniquelyMapped;
+        counts = ParseCounts();
+        slabPool_.enqueue(slab);
+        slabsFree_.notifyOne();
+        slab = nullptr;
+    }
 
-        while (!fragmentQueue_.try_pop(f)) {
-            if (!exhaustedAlnGroupPool_) {
-                f = new FragT;
-                ++numFragAlloc;
-                break;
+    // Reclaim the unused fragment and (empty) alignment group
+    fragmentQueue_.push(f); f = nullptr;
+    alnGroupPool_.enqueue(alngroup);
+    poolRefilled_.notifyAll();
+    decoderStats_.addActive(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * Read the alignment file(s) into slabs of records for the decoding threads.
+ *
+ * This is the only sequential part of parsing (apart from io_lib's own
+ * reading, whose block decompression runs on its CRAM_OPT_NTHREADS pool).
+ * It only classifies each record enough to know where a slab may end: a
+ * slab is cut only once it holds at least recordsPerSlab_ records, and only
+ * before the first record of a new read (never between the ends of a pair,
+ * or between two alignments of the same read).
+ */
+template <typename FragT>
+template <typename FilterT>
+void BAMQueue<FragT>::fillQueue_(FilterT filt, bool onlyProcessAmbiguousAlignments) {
+    constexpr bool isPaired = std::is_same<FragT, ReadPair>::value;
+    auto start = std::chrono::steady_clock::now();
+    doneReading_ = false;
+    std::vector<std::thread> decoders;
+    for (uint32_t i = 0; i < numDecodeThreads_; ++i) {
+        decoders.emplace_back([this, filt, onlyProcessAmbiguousAlignments]() -> void {
+            this->decodeSlabs_(filt, onlyProcessAmbiguousAlignments);
+        });
+    }
+
+    currFile_ = files_.begin();
+    fp_ = currFile_->fp;
+    hdr_ = currFile_->header;
+
+    RecordSlab* slab = acquireSlab_();
+    // The name of the read to which the last records belong
+    std::string groupName;
+    // True if the last record was the first end of a pair
+    bool awaitingMate{false};
+    while (true) {
+        if (slab->size == slab->recs.size()) {
+            slab->recs.push_back(staden::utils::bam_init());
+        }
+        bam_seq_t*& rec = slab->recs[slab->size];
+        if (scram_get_seq(fp_, &rec) < 0) {
+            // We've exhausted this file; a slab never spans two files.
+            scram_close(currFile_->fp);
+            currFile_->fp = nullptr;
+            if (slab->size > 0) {
+                readySlabs_.enqueue(slab);
+                slabsReady_.notifyOne();
+                slab = acquireSlab_();
             }
+            groupName.clear();
+            awaitingMate = false;
+            currFile_++;
+            // If this is the last file, then we're done
+            if (currFile_ == files_.end()) { break; }
+            // Otherwise, start parsing the next file.
+            fp_ = scram_open(currFile_->fileName.c_str(), currFile_->readMode.c_str());
+            scram_set_option(fp_, CRAM_OPT_NTHREADS, currFile_->numParseThreads);
+            currFile_->fp = fp_;
+            hdr_ = currFile_->header;
+            continue;
         }
 
-       if (!notified and exhaustedAlnGroupPool_) { 
-          logger_->info("\n\nThe alignment group queue pool has been exhausted.  {} extra fragments were allocated "
-                        "on the heap to saturate the pool.  No new fragments will be allocated\n\n", numFragAlloc);
-          notified = true;
-       }
-       ++n;
-    }
+        bool startsFragment = !awaitingMate;
+        if (isPaired) {
+            if (awaitingMate) {
+                awaitingMate = false;
+            } else {
+                auto alnType = getPairedAlignmentType_(rec);
+                awaitingMate = (alnType == AlignmentType::MappedConcordantPair or
+                                alnType == AlignmentType::UnmappedPair);
+            }
+        }
 
-    // If we popped a fragment structure off the queue, but didn't add it 
-    // to an alignment group, then reclaim it here
-    if (f != nullptr) { fragmentQueue_.push(f); f = nullptr; }
-
-    // If the last alignment group is non-empty, then send 
-    // it off to be processed.
-    if (alngroup->size() > 0) { 
-
-        // If we only wish to process ambiguous alignments,
-        // and the current read aligns uniquely, then return 
-        // what we parsed to the appropriate queue and continue
-        if (onlyProcessAmbiguousAlignments and 
-                readAlignsUniquely) {
-            // return the fragments
-            for (auto aln : alngroup->alignments()) {
-                fragmentQueue_.push(aln); aln = nullptr;
+        if (startsFragment) {
+            uint32_t nameLen = isPaired ? getPairedNameLen(rec) : bam_name_len(rec);
+            const char* name = bam_name(rec);
+            if (nameLen != groupName.size() or
+                memcmp(name, groupName.data(), nameLen) != 0) {
+                // This record starts a new read; if the slab is full,
+                // hand it off and move this record to a new one.
+                if (slab->size >= recordsPerSlab_) {
+                    RecordSlab* nextSlab = acquireSlab_();
+                    std::swap(slab->recs[slab->size], nextSlab->recs[0]);
+                    readySlabs_.enqueue(slab);
+                    slabsReady_.notifyOne();
+                    slab = nextSlab;
+                }
+                // (the record moved with its buffer, so name is still valid)
+                groupName.assign(name, nameLen);
             }
-            // clear the alignments vector
-            alngroup->alignments().clear();
-            // return the alignment group itself 
-            alnGroupPool_.enqueue(alngroup);
-            numUniquelyMappedReads_++;
-        } else {
-            while(!alnGroupQueue_.try_enqueue(alngroup));
-            alngroup = nullptr;
         }
-    } else { // otherwise, reclaim the alignment group structure here
-        //alnGroupPool_.push(alngroup);
-        alnGroupPool_.enqueue(alngroup);
+        ++slab->size;
     }
+    slabPool_.enqueue(slab);
+
+    doneReading_ = true;
+    slabsReady_.notifyAll();
+    readerStats_.addActive(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    for (auto& t : decoders) { t.join(); }
 
-    delete [] prevReadName;
     // We're at the end of the list of input files
     // and we're done parsing (for now).
     currFile_ = files_.end();
     fp_ = nullptr;
     hdr_ = nullptr;
     doneParsing_ = true;
+    groupsReady_.notifyAll();
+
+    logger_->info("BAM parsing: reader busy {:.2f}s, idle {:.2f}s; {} decoding thread(s) "
+                  "busy {:.2f}s, idle {:.2f}s ({} waits, {} parked)",
+                  readerStats_.busySeconds(), readerStats_.idleSeconds(),
+                  numDecodeThreads_, decoderStats_.busySeconds(),
+                  decoderStats_.idleSeconds(), decoderStats_.numWaits.load(),
+                  decoderStats_.numParks.load());
     return;
 }
 
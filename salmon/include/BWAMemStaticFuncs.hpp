@@ -39,20 +39,19 @@ static void mem_collect_intv(const SalmonOpts& sopt, const mem_opt_t *opt, Salmo
 
     // first pass: find all SMEMs
     if (sidx->hasAuxKmerIndex()) {
-        KmerIntervalMap& auxIdx = sidx->auxIndex();
+        const KmerIntervalMap& auxIdx = sidx->auxIndex();
         uint32_t klen = auxIdx.k();
+        bwtintv_t kmerInterval;
         while (x < len) {
             if (seq[x] < 4) {
                 // Make sure there are at least k bases left
                 if (len - x < klen) { x = len; continue; }
                 // search for this key in the auxiliary index
-                KmerKey kmer(const_cast<uint8_t*>(&(seq[x])), klen);
-                auto it = auxIdx.find(kmer);
                 // if we can't find it, move to the next key
-                if (it == auxIdx.end()) { ++x; continue; }
-                // otherwise, start the search using the initial interval @it->second from the hash
+                if (!auxIdx.find(&(seq[x]), kmerInterval)) { ++x; continue; }
+                // otherwise, start the search using the initial interval from the map
                 int xb = x;
-                x = bwautils::bwt_smem1_with_kmer(bwt, len, seq, x, start_width, it->second, &a->mem1, a->tmpv);
+                x = bwautils::bwt_smem1_with_kmer(bwt, len, seq, x, start_width, kmerInterval, &a->mem1, a->tmpv);
                 for (i = 0; i < a->mem1.n; ++i) {
                     bwtintv_t *p = &a->mem1.a[i];
                     int slen = (uint32_t)p->info - (p->info>>32); // seed length
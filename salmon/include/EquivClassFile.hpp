@@ -0,0 +1,277 @@
+#ifndef __EQUIV_CLASS_FILE_HPP__
+#define __EQUIV_CLASS_FILE_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+/**
+ * The binary equivalence class format (eq_classes.bin), written with
+ * --dumpEq --dumpEqFormat binary.  All fixed-width values are little-endian.
+ *
+ *   header   : magic (u64, "SALMONEQ"), version (u32), flags (u32),
+ *              # transcripts (u64), # equivalence classes (u64)
+ *   names    : one block (see below) holding, for each transcript, the
+ *              varint length of its name followed by the name
+ *   classes  : a sequence of blocks, each holding up to classesPerBlock
+ *              equivalence classes
+ *
+ * A block is its # of entries (u32), its uncompressed size (u32), its
+ * compressed size (u32), and then its zlib-compressed payload.  Each class
+ * in a payload is encoded as
+ *
+ *   k (varint), t_1 (varint), t_2 - t_1, ..., t_k - t_{k-1} (zigzag varints),
+ *   [k weights (float32), if flags & flagWeights], count (varint)
+ *
+ * The blocks are independent, so they can be encoded (and decoded) in
+ * parallel.  EquivClassReader below reads the format; `salmon eqconvert`
+ * converts it to the text format.
+ */
+namespace salmon {
+namespace eqclass {
+
+constexpr uint64_t fileMagic{0x51454e4f4d4c4153}; // "SALMONEQ"
+constexpr uint32_t fileVersion{1};
+constexpr uint32_t flagWeights{0x1};
+constexpr size_t classesPerBlock{65536};
+
+struct EquivClass {
+  std::vector<uint32_t> txps;
+  std::vector<float> weights;
+  uint64_t count{0};
+};
+
+inline void putVarint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (uint32_t shift = 0; p < end and shift < 64; shift += 7) {
+    uint8_t b = *p++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) { return true; }
+  }
+  return false;
+}
+
+inline uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+inline int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+/**
+ * Append the encoding of a single class (with transcripts txps[0..n), and,
+ * if weights is non-null, their weights) to `out`.
+ */
+inline void encodeClass(std::string& out, const uint32_t* txps, size_t n,
+                        const double* weights, uint64_t count) {
+  putVarint(out, n);
+  int64_t prev{0};
+  for (size_t i = 0; i < n; ++i) {
+    int64_t t = txps[i];
+    if (i == 0) {
+      putVarint(out, t);
+    } else {
+      putVarint(out, zigzag(t - prev));
+    }
+    prev = t;
+  }
+  if (weights != nullptr) {
+    for (size_t i = 0; i < n; ++i) {
+      float w = static_cast<float>(weights[i]);
+      char buf[sizeof(float)];
+      std::memcpy(buf, &w, sizeof(float));
+      out.append(buf, sizeof(float));
+    }
+  }
+  putVarint(out, count);
+}
+
+/**
+ * Compress `raw` (the encoding of numClasses classes) into a complete block
+ * (header and payload), appended to `out`.
+ */
+inline bool compressBlock(const std::string& raw, uint32_t numClasses,
+                          std::string& out) {
+  uLongf compSize = compressBound(raw.size());
+  std::string comp(compSize, '\0');
+  if (compress2(reinterpret_cast<Bytef*>(&comp[0]), &compSize,
+                reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+                Z_DEFAULT_COMPRESSION) != Z_OK) {
+    return false;
+  }
+  uint32_t hdr[3] = {numClasses, static_cast<uint32_t>(raw.size()),
+                     static_cast<uint32_t>(compSize)};
+  out.append(reinterpret_cast<const char*>(hdr), sizeof(hdr));
+  out.append(comp.data(), compSize);
+  return true;
+}
+
+// Write the file header (and transcript names block) to `out`.
+inline bool writeHeader(std::ofstream& out, const std::vector<std::string>& names,
+                        uint64_t numClasses, bool hasWeights) {
+  uint64_t magic{fileMagic};
+  uint32_t version{fileVersion};
+  uint32_t flags = hasWeights ? flagWeights : 0;
+  uint64_t numTranscripts = names.size();
+  out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+  out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+  out.write(reinterpret_cast<const char*>(&numTranscripts), sizeof(numTranscripts));
+  out.write(reinterpret_cast<const char*>(&numClasses), sizeof(numClasses));
+  std::string raw, block;
+  for (auto& n : names) {
+    putVarint(raw, n.size());
+    raw.append(n);
+  }
+  if (!compressBlock(raw, static_cast<uint32_t>(names.size()), block)) {
+    return false;
+  }
+  out.write(block.data(), block.size());
+  return out.good();
+}
+
+/**
+ * Streams the equivalence classes out of a binary equivalence class file,
+ * one block at a time.
+ *
+ *   EquivClassReader r(path);
+ *   if (!r.good()) { ... r.error() ... }
+ *   EquivClass ec;
+ *   while (r.next(ec)) { ... }
+ */
+class EquivClassReader {
+public:
+  explicit EquivClassReader(const std::string& path)
+      : in_(path, std::ios::binary) {
+    if (!in_.good()) { fail_("could not open " + path); return; }
+    uint64_t magic{0};
+    uint32_t version{0};
+    in_.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in_.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in_.read(reinterpret_cast<char*>(&flags_), sizeof(flags_));
+    in_.read(reinterpret_cast<char*>(&numTranscripts_), sizeof(numTranscripts_));
+    in_.read(reinterpret_cast<char*>(&numClasses_), sizeof(numClasses_));
+    if (!in_.good() or magic != fileMagic) {
+      fail_(path + " is not a binary equivalence class file");
+      return;
+    }
+    if (version != fileVersion) {
+      fail_("unsupported binary equivalence class file version " +
+            std::to_string(version));
+      return;
+    }
+    uint32_t numNames{0};
+    if (!readBlock_(numNames)) { return; }
+    names_.reserve(numTranscripts_);
+    for (uint32_t i = 0; i < numNames; ++i) {
+      uint64_t len{0};
+      if (!getVarint(pos_, end_, len) or
+          static_cast<uint64_t>(end_ - pos_) < len) {
+        fail_("corrupt transcript name table");
+        return;
+      }
+      names_.emplace_back(reinterpret_cast<const char*>(pos_), len);
+      pos_ += len;
+    }
+    if (names_.size() != numTranscripts_) {
+      fail_("corrupt transcript name table");
+      return;
+    }
+    remainingInBlock_ = 0;
+  }
+
+  bool good() const { return error_.empty(); }
+  const std::string& error() const { return error_; }
+
+  uint64_t numTranscripts() const { return numTranscripts_; }
+  uint64_t numClasses() const { return numClasses_; }
+  bool hasWeights() const { return flags_ & flagWeights; }
+  const std::vector<std::string>& transcriptNames() const { return names_; }
+
+  // Read the next class into `ec`; returns false at the end of the file (or
+  // on an error, in which case good() is false).
+  bool next(EquivClass& ec) {
+    if (!good() or numRead_ == numClasses_) { return false; }
+    if (remainingInBlock_ == 0 and !readBlock_(remainingInBlock_)) {
+      return false;
+    }
+    uint64_t k{0}, v{0};
+    if (!getVarint(pos_, end_, k)) { return fail_("corrupt equivalence class"); }
+    ec.txps.resize(k);
+    int64_t prev{0};
+    for (uint64_t i = 0; i < k; ++i) {
+      if (!getVarint(pos_, end_, v)) { return fail_("corrupt equivalence class"); }
+      prev = (i == 0) ? static_cast<int64_t>(v) : prev + unzigzag(v);
+      ec.txps[i] = static_cast<uint32_t>(prev);
+    }
+    ec.weights.clear();
+    if (hasWeights()) {
+      if (static_cast<uint64_t>(end_ - pos_) < k * sizeof(float)) {
+        return fail_("corrupt equivalence class");
+      }
+      ec.weights.resize(k);
+      std::memcpy(ec.weights.data(), pos_, k * sizeof(float));
+      pos_ += k * sizeof(float);
+    }
+    if (!getVarint(pos_, end_, ec.count)) { return fail_("corrupt equivalence class"); }
+    --remainingInBlock_;
+    ++numRead_;
+    return true;
+  }
+
+private:
+  bool fail_(const std::string& msg) {
+    error_ = msg;
+    return false;
+  }
+
+  bool readBlock_(uint32_t& numClasses) {
+    uint32_t hdr[3];
+    in_.read(reinterpret_cast<char*>(hdr), sizeof(hdr));
+    if (!in_.good()) { return fail_("unexpected end of file"); }
+    numClasses = hdr[0];
+    comp_.resize(hdr[2]);
+    raw_.resize(hdr[1]);
+    in_.read(reinterpret_cast<char*>(comp_.data()), comp_.size());
+    if (!in_.good()) { return fail_("unexpected end of file"); }
+    uLongf rawSize = raw_.size();
+    if (!raw_.empty() and
+        (uncompress(raw_.data(), &rawSize, comp_.data(), comp_.size()) != Z_OK or
+         rawSize != raw_.size())) {
+      return fail_("corrupt block");
+    }
+    pos_ = raw_.data();
+    end_ = raw_.data() + raw_.size();
+    return true;
+  }
+
+  std::ifstream in_;
+  std::string error_;
+  uint32_t flags_{0};
+  uint64_t numTranscripts_{0};
+  uint64_t numClasses_{0};
+  uint64_t numRead_{0};
+  std::vector<std::string> names_;
+  std::vector<uint8_t> comp_;
+  std::vector<uint8_t> raw_;
+  const uint8_t* pos_{nullptr};
+  const uint8_t* end_{nullptr};
+  uint32_t remainingInBlock_{0};
+};
+
+} // namespace eqclass
+} // namespace salmon
+
+#endif // __EQUIV_CLASS_FILE_HPP__
@@ -0,0 +1,42 @@
+#ifndef __EXPECTED_BIAS_STATE_HPP__
+#define __EXPECTED_BIAS_STATE_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "DistributionUtils.hpp"
+#include "GCFragModel.hpp"
+#include "SBModel.hpp"
+
+/**
+ * The (unnormalized) expected bias distributions computed by
+ * salmon::utils::updateEffectiveLengths, together with the weight
+ * (alpha / effective length) with which each transcript contributed to them.
+ *
+ * Each expected distribution is a sum of per-transcript contributions, each
+ * scaled by the transcript's weight.  So, when the same state is passed to a
+ * later call, only the transcripts whose weight has changed (by more than
+ * --biasUpdateThreshold, relatively) need to be visited; each of these adds
+ * (new weight - old weight) times its contribution.  All of the
+ * accumulators here are in linear space so that contributions can be
+ * removed as well as added.
+ */
+class ExpectedBiasState {
+public:
+  ExpectedBiasState(size_t numCondBins, size_t numGCBins)
+      : expectGC(numCondBins, numGCBins,
+                 distribution_utils::DistributionSpace::LINEAR) {}
+
+  // True once a call has filled in this state
+  bool initialized{false};
+  // The weight with which each transcript currently contributes
+  std::vector<double> weights;
+  SBModel expectSeqFW;
+  SBModel expectSeqRC;
+  GCFragModel expectGC;
+  // The positional masses for each length class, and bin
+  std::vector<std::vector<double>> expectPos5;
+  std::vector<std::vector<double>> expectPos3;
+};
+
+#endif // __EXPECTED_BIAS_STATE_HPP__
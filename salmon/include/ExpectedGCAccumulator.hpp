@@ -0,0 +1,179 @@
+#ifndef __EXPECTED_GC_ACCUMULATOR_HPP__
+#define __EXPECTED_GC_ACCUMULATOR_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Eigen/Dense"
+#include "GCFragModel.hpp"
+#include "Transcript.hpp"
+
+/**
+ * Accumulates the *expected* fragment-GC distribution of a set of
+ * transcripts.  Every putative fragment [s, s + fl - 1] of a transcript (for
+ * each start s < numStarts, and each fragment length fl in
+ * {flLow, flLow + flStep, ..., flHigh} that fits) contributes the mass of its
+ * length under the (conditional) fragment length distribution to the bin
+ * given by its GC fraction and the GC fraction of its end contexts.
+ *
+ * Rather than visiting each (start, length) pair through Transcript::gcFrac
+ * and GCFragModel::inc, this
+ *   - computes the mass of each fragment length once per transcript,
+ *   - slides each fragment length along the prefix counts of the
+ *     transcript's GCIndex,
+ *   - maps GC and context fractions to bins through lookup tables, and
+ *   - accumulates into a flat per-transcript histogram, which is added to the
+ *     model (scaled by the transcript's weight) once, at the end.
+ * The bins chosen are exactly those that the direct computation chooses.
+ *
+ * An accumulator holds scratch space and is not thread-safe; use one per
+ * thread.
+ */
+class ExpectedGCAccumulator {
+public:
+  ExpectedGCAccumulator(size_t condBins, size_t numGCBins)
+      : condBins_(condBins), numGCBins_(numGCBins),
+        hist_(condBins * numGCBins, 0.0), ctxStride_(0) {
+    // GC fraction (in percent) => fragment bin
+    fragBins_.resize(101);
+    for (int32_t f = 0; f <= 100; ++f) {
+      GCDesc desc{f, 0};
+      fragBins_[f] = (numGCBins_ != 101) ? desc.fragBin(numGCBins_) : desc.fragBin();
+    }
+  }
+
+  /**
+   * Add the expected GC distribution of `txp`, with weight `weight`, to
+   * `expectGC`.  `conditionalCDF(x)` gives the fragment length CDF,
+   * conditioned on this transcript's length.  The context arrays give, for
+   * each position, the number of G/C bases in (and the length of) the 5'
+   * and 3' context windows anchored there (they may be all zero).
+   */
+  template <typename CondCDFT>
+  void addTranscript(const Transcript& txp, int32_t numStarts, int32_t flLow,
+                     int32_t flHigh, int32_t flStep, CondCDFT& conditionalCDF,
+                     const Eigen::VectorXd& contextCountsFP,
+                     const Eigen::VectorXd& contextCountsTP,
+                     const Eigen::VectorXd& windowLensFP,
+                     const Eigen::VectorXd& windowLensTP, double weight,
+                     GCFragModel& expectGC) {
+    int32_t refLen = static_cast<int32_t>(txp.RefLength);
+    if (numStarts <= 0 or refLen <= 0) { return; }
+
+    // prefix_[i] is the number of G/C bases in [0, i), decoded from the
+    // transcript's GC index in a single pass.
+    prefix_.resize(refLen + 1);
+    txp.gcIndex().prefixCounts(prefix_.data());
+
+    // The (integral) context counts and window lengths
+    fillContext_(refLen, contextCountsFP, contextCountsTP, windowLensFP,
+                 windowLensTP);
+
+    std::fill(hist_.begin(), hist_.end(), 0.0);
+    const uint32_t* q = prefix_.data();
+    const int32_t* cFP = ctxCountFP_.data();
+    const int32_t* cTP = ctxCountTP_.data();
+    const int32_t* lFP = ctxLenFP_.data();
+    const int32_t* lTP = ctxLenTP_.data();
+    const int32_t ctxStride = ctxStride_;
+    const int32_t* ctxBins = ctxBins_.data();
+    double* hist = hist_.data();
+    const int32_t numGCBins = static_cast<int32_t>(numGCBins_);
+
+    size_t sp = static_cast<size_t>((flLow > 0) ? flLow - 1 : 0);
+    double prevFLMass = conditionalCDF(sp);
+    for (int32_t fl = flLow; fl <= flHigh and fl <= refLen; fl += flStep) {
+      // The mass of this fragment length is the same for every start
+      double flMass = conditionalCDF(fl);
+      double m = flMass - prevFLMass;
+      prevFLMass = flMass;
+      if (m == 0.0) { continue; }
+
+      // Every start position at which a fragment of this length fits
+      int32_t sEnd = std::min(numStarts, refLen - fl + 1);
+      // (# of G/C bases in the fragment) => fragment bin
+      const int32_t* countBins = getCountBins_(fl);
+      for (int32_t s = 0; s < sEnd; ++s) {
+        int32_t e = s + fl - 1;
+        int32_t ctx = ctxBins[(cFP[s] + cTP[e]) * ctxStride + (lFP[s] + lTP[e])];
+        hist[ctx * numGCBins + countBins[q[e + 1] - q[s]]] += m;
+      }
+    }
+
+    expectGC.addCounts(hist_, weight);
+  }
+
+private:
+  void fillContext_(int32_t refLen, const Eigen::VectorXd& contextCountsFP,
+                    const Eigen::VectorXd& contextCountsTP,
+                    const Eigen::VectorXd& windowLensFP,
+                    const Eigen::VectorXd& windowLensTP) {
+    ctxCountFP_.resize(refLen);
+    ctxCountTP_.resize(refLen);
+    ctxLenFP_.resize(refLen);
+    ctxLenTP_.resize(refLen);
+    int32_t maxVal{0};
+    auto toInt = [&maxVal](double v) -> int32_t {
+      int32_t i = std::max(0, static_cast<int32_t>(std::lrint(v)));
+      maxVal = std::max(maxVal, i);
+      return i;
+    };
+    for (int32_t i = 0; i < refLen; ++i) {
+      ctxCountFP_[i] = toInt(contextCountsFP[i]);
+      ctxCountTP_[i] = toInt(contextCountsTP[i]);
+      ctxLenFP_[i] = toInt(windowLensFP[i]);
+      ctxLenTP_[i] = toInt(windowLensTP[i]);
+    }
+    // Any sum of a 5' and a 3' value is at most 2 * maxVal
+    buildContextBins_(2 * maxVal + 1);
+  }
+
+  // The fragment bin of each possible G/C count of a fragment of length fl.
+  // These are built on demand, and kept for the lifetime of the accumulator.
+  const int32_t* getCountBins_(int32_t fl) {
+    if (static_cast<size_t>(fl) >= countBins_.size()) { countBins_.resize(fl + 1); }
+    auto& bins = countBins_[fl];
+    if (bins.empty()) {
+      bins.resize(fl + 1);
+      for (int32_t c = 0; c <= fl; ++c) {
+        // The same computation as in Transcript::gcFrac
+        bins[c] = fragBins_[std::lrint((100.0 * c) / fl)];
+      }
+    }
+    return bins.data();
+  }
+
+  // (context G/C count, context length) => context bin
+  void buildContextBins_(int32_t stride) {
+    if (stride <= ctxStride_) { return; }
+    ctxStride_ = stride;
+    ctxBins_.assign(stride * stride, 0);
+    for (int32_t cnt = 0; cnt < stride; ++cnt) {
+      for (int32_t len = 0; len < stride; ++len) {
+        double contextLength = static_cast<double>(len);
+        int32_t contextFrac = (contextLength > 0) ?
+          static_cast<int32_t>(std::lrint(100.0 * cnt / contextLength)) : 0;
+        GCDesc desc{0, contextFrac};
+        ctxBins_[cnt * stride + len] =
+          (condBins_ > 1) ? desc.contextBin(condBins_) : 0;
+      }
+    }
+  }
+
+  size_t condBins_;
+  size_t numGCBins_;
+  std::vector<double> hist_;
+  std::vector<uint32_t> prefix_;
+  std::vector<int32_t> fragBins_;
+  std::vector<std::vector<int32_t>> countBins_;
+  std::vector<int32_t> ctxBins_;
+  int32_t ctxStride_;
+  std::vector<int32_t> ctxCountFP_;
+  std::vector<int32_t> ctxCountTP_;
+  std::vector<int32_t> ctxLenFP_;
+  std::vector<int32_t> ctxLenTP_;
+};
+
+#endif // __EXPECTED_GC_ACCUMULATOR_HPP__
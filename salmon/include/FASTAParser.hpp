@@ -1,15 +1,23 @@
 #ifndef FASTA_PARSER
 #define FASTA_PARSER
 
+#include <string>
 #include <vector>
 
 class Transcript;
 class SalmonOpts;
+class TranscriptSequenceArena;
 
 class FASTAParser {
 public:
     FASTAParser(const std::string& fname);
-    void populateTargets(std::vector<Transcript>& transcripts, SalmonOpts& sopt);
+    /**
+     * Load the sequence of each of the transcripts from the FASTA file into
+     * the arena (from which the transcripts borrow them), along with their
+     * SAM encodings and, if GC bias correction is on, their GC content.
+     */
+    void populateTargets(std::vector<Transcript>& transcripts,
+                         TranscriptSequenceArena& arena, SalmonOpts& sopt);
 
 private:
     std::string fname_;
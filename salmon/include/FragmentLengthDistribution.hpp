@@ -10,50 +10,117 @@
 #ifndef FRAGMENT_LENGTH_DISTRIBUTION
 #define FRAGMENT_LENGTH_DISTRIBUTION
 
-#include "tbb/atomic.h"
+#include "tbb/enumerable_thread_specific.h"
 #include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 #include <mutex>
 
-#include "SpinLock.hpp" // RapMap's with try_lock
-
 /**
  * The LengthDistribution class keeps track of the observed length distribution.
  * It is initialized with a Gaussian prior with parameters specified by the
  * arguments to the constructor. An argument-specified binomial kernel is then
  * added for each observation. All mass values and probabilities are stored and
  * returned in log space (except in to_string).
+ *
+ * Observations are accumulated (in linear space, relative to a per-thread
+ * scale) into per-thread histograms, which are periodically merged into an immutable Snapshot of the (logged)
+ * PMF and CMF.  Readers only ever see a complete snapshot, obtained through
+ * a single atomic load; snapshots are never modified once published and live
+ * as long as the distribution does.
  */
 class FragmentLengthDistribution {
+public:
+  /**
+   * An immutable, consistent view of the distribution at some point in time.
+   **/
+  struct Snapshot {
+    // Incremented each time a new snapshot is published
+    uint64_t epoch{0};
+    size_t binSize{1};
+    // The (logged) total mass and mean
+    double totMass;
+    double mean;
+    // The (logged) probability and cumulative mass of each bin
+    std::vector<double> pmfBins;
+    std::vector<double> cmfBins;
+
+    inline double pmf(size_t len) const {
+      len /= binSize;
+      return (len < pmfBins.size()) ? pmfBins[len] : pmfBins.back();
+    }
+    inline double cmf(size_t len) const {
+      len /= binSize;
+      return (len < cmfBins.size()) ? cmfBins[len] : cmfBins.back();
+    }
+  };
+
+private:
+  /**
+   * The mass observed by a single thread, in linear space relative to
+   * exp(logScale).  Only the owning thread writes to it, so updates need no
+   * read-modify-write atomics; the atomics just let the merging thread read
+   * it safely.  The owner moves logScale up (rescaling every bin) as the
+   * forgetting mass grows; `version` is odd while it does, so that the
+   * merging thread can retry rather than mix bins of two scales.
+   **/
+  struct LocalHist {
+    explicit LocalHist(size_t numBins)
+        : mass(new std::atomic<double>[numBins]), numBins(numBins) {
+      for (size_t i = 0; i < numBins; ++i) { mass[i].store(0.0, std::memory_order_relaxed); }
+    }
+    inline void add(std::atomic<double>& v, double m) {
+      v.store(v.load(std::memory_order_relaxed) + m, std::memory_order_relaxed);
+    }
+    // Move the scale to newLogScale (called only by the owning thread)
+    void rescale(double newLogScale);
+    std::unique_ptr<std::atomic<double>[]> mass;
+    size_t numBins;
+    std::atomic<double> lenMass{0.0};
+    std::atomic<double> totMass{0.0};
+    std::atomic<double> logScale{0.0};
+    std::atomic<uint64_t> version{0};
+    uint64_t numObs{0};
+  };
+
   /**
-   * A private vector that stores the (logged) kernel values.
+   * A private vector that stores the kernel values.
    **/
   std::vector<double> kernel_;
   /**
-   * A private vector that stores the observed (logged) mass for each length.
+   * The (linear-space) prior mass for each length, and its total and
+   * length-weighted sum.
    */
-    std::vector<tbb::atomic<double>> hist_;
+  std::vector<double> priorHist_;
+  double priorTotMass_;
+  double priorLenMass_;
 
-   /**
-   * A private vector that stores the observed (logged) mass for each length.
+  /**
+   * The per-thread histograms (owned by localHists_, looked up through
+   * threadHist_).
    */
-  std::vector<double> cachedCMF_;
-  std::vector<double> cachedPMF_;
-    volatile bool haveCachedCMF_;
-  //std::mutex fldMut_;
-  SpinLock sl_;
-
+  std::vector<std::unique_ptr<LocalHist>> localHists_;
+  tbb::enumerable_thread_specific<LocalHist*> threadHist_;
+  std::mutex localHistMut_;
 
   /**
-   * A private double that stores the total observed (logged) mass.
+   * The current snapshot, and all those ever published.
    */
-    tbb::atomic<double> totMass_;
+  std::atomic<const Snapshot*> current_;
+  std::vector<std::unique_ptr<Snapshot>> snapshots_;
+  // Held while merging / publishing
+  std::mutex publishMut_;
+  // Once set, no further snapshots are published (see cacheCMF()).
+  std::atomic<bool> frozen_;
+
   /**
-   * A private double that stores the (logged) sum of the product of observed
-   * lengths and masses for quick mean calculations.
+   * The total number of observations reported by the threads so far, and
+   * the count at which the next snapshot will be published.
    */
-    tbb::atomic<double> sum_;
+  std::atomic<uint64_t> numObs_;
+  std::atomic<uint64_t> nextPublish_;
+
   /**
    * A private int that stores the minimum observed length.
    */
@@ -62,6 +129,12 @@ class FragmentLengthDistribution {
    * A size for internal binning of the lengths in the distribution.
    */
   size_t binSize_;
+  size_t numBins_;
+
+  // The calling thread's histogram (created on first use)
+  LocalHist& localHist_();
+  // Merge all histograms into a new snapshot; publishMut_ must be held
+  void publish_();
 
 public:
   /**
@@ -119,13 +192,21 @@ public:
   double cmf(size_t len) const;
 
   /**
-    * A member function that caches the cumulative mass function into
-    * a vector.  This should be called (once), when the fld will no
-    * longer be updated.  It will make future calls to cmf(len)
-    * much faster.
+    * A member function that publishes a final snapshot of the distribution.
+    * This should be called (once), when the fld will no longer be updated;
+    * later observations are not reflected in pmf(len) / cmf(len).
     */
   void cacheCMF();
 
+  /**
+   * The current snapshot of the distribution.  The pointer remains valid for
+   * the lifetime of this object; reading both the pmf and the cmf from the
+   * same snapshot guarantees that they are consistent.
+   */
+  inline const Snapshot* snapshot() const {
+    return current_.load(std::memory_order_acquire);
+  }
+
   /**
    * A member function that returns a vector containing the (logged) cumulative
    * mass function *for the bins*.
@@ -144,6 +144,25 @@ public:
     }
   }
 
+  /**
+   * Add `scale` times the (linear-space) counts in `hist` to this model.
+   * `hist` is a row-major (condBins x numGCBins) histogram, indexed by
+   * (context bin, fragment bin).
+   */
+  void addCounts(const std::vector<double>& hist, double scale) {
+    for (size_t r = 0; r < condBins_; ++r) {
+      for (size_t c = 0; c < numGCBins_; ++c) {
+        double w = hist[r * numGCBins_ + c];
+        if (w == 0.0) { continue; }
+        if (dspace_ == distribution_utils::DistributionSpace::LOG) {
+          counts_(r, c) = salmon::math::logAdd(counts_(r, c), std::log(scale * w));
+        } else {
+          counts_(r, c) += scale * w;
+        }
+      }
+    }
+  }
+
   double get(GCDesc desc) {
     auto ctx = (condBins_ > 1) ? desc.contextBin(condBins_) : 0;
     auto frag = (numGCBins_ != 101) ? desc.fragBin(numGCBins_) : desc.fragBin();
@@ -0,0 +1,120 @@
+#ifndef __GC_INDEX_HPP__
+#define __GC_INDEX_HPP__
+
+#include <cctype>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A compact index over the G/C content of a single sequence, answering
+ * "how many G/C bases are in [0, i)" (a rank query) in constant time.
+ *
+ * The index stores one bit per base, and rank9-style counts on top of it:
+ *   - a 32-bit anchor (the absolute count) every 2^16 bases, and
+ *   - a 16-bit count, relative to its anchor, every 64 bases (or, in the
+ *     sparse mode used by --reduceGCMemory, every 512 bases).
+ * A rank query is then an anchor, a relative count and the popcount of (at
+ * most 8) words.  This takes ~1.25 (sparse: ~1.03) bits per base, rather
+ * than 32 for a full array of prefix counts.
+ *
+ * The batched queries (ranks, rangeCounts and prefixCounts) are branch-free
+ * loops, and should be preferred when many positions of the same sequence are
+ * needed at once.
+ */
+class GCIndex {
+public:
+  GCIndex() = default;
+
+  GCIndex(const char* seq, uint32_t len, bool sparse = false)
+      : len_(len), countShift_(sparse ? 9 : 6) {
+    // One extra word so that rank(len) never reads past the end
+    words_.assign((len >> 6) + 1, 0);
+    for (uint32_t i = 0; i < len; ++i) {
+      auto c = std::toupper(seq[i]);
+      if (c == 'G' or c == 'C') {
+        words_[i >> 6] |= (uint64_t(1) << (i & 63));
+      }
+    }
+
+    anchors_.assign((len >> superShift_) + 1, 0);
+    counts_.assign((len >> countShift_) + 1, 0);
+    uint32_t wordsPerCount = 1u << (countShift_ - 6);
+    uint32_t tot{0};
+    for (size_t w = 0; w < words_.size(); ++w) {
+      uint64_t pos = static_cast<uint64_t>(w) << 6;
+      if ((pos & ((uint64_t(1) << superShift_) - 1)) == 0) {
+        anchors_[pos >> superShift_] = tot;
+      }
+      if ((w & (wordsPerCount - 1)) == 0) {
+        counts_[pos >> countShift_] =
+            static_cast<uint16_t>(tot - anchors_[pos >> superShift_]);
+      }
+      tot += __builtin_popcountll(words_[w]);
+    }
+  }
+
+  uint32_t length() const { return len_; }
+  bool empty() const { return words_.empty(); }
+
+  // The number of G/C bases in [0, i), for 0 <= i <= length()
+  inline uint32_t rank(uint32_t i) const {
+    uint32_t w = i >> 6;
+    uint32_t r = anchors_[i >> superShift_] + counts_[i >> countShift_];
+    for (uint32_t k = (i >> countShift_) << (countShift_ - 6); k < w; ++k) {
+      r += __builtin_popcountll(words_[k]);
+    }
+    // (1 << 0) - 1 == 0, so this needs no special case when i is aligned
+    return r + __builtin_popcountll(words_[w] & ((uint64_t(1) << (i & 63)) - 1));
+  }
+
+  // out[j] = rank(pos[j]) for j in [0, n)
+  void ranks(const uint32_t* pos, size_t n, uint32_t* out) const {
+    for (size_t j = 0; j < n; ++j) {
+      out[j] = rank(pos[j]);
+    }
+  }
+
+  // out[j] = the number of G/C bases in the closed interval [s[j], e[j]]
+  void rangeCounts(const int32_t* s, const int32_t* e, size_t n,
+                   uint32_t* out) const {
+    for (size_t j = 0; j < n; ++j) {
+      out[j] = rank(static_cast<uint32_t>(e[j]) + 1) -
+               rank(static_cast<uint32_t>(s[j]));
+    }
+  }
+
+  // out[i] = rank(i) for every i in [0, length()]; `out` must hold
+  // length() + 1 values.
+  void prefixCounts(uint32_t* out) const {
+    uint32_t tot{0};
+    out[0] = 0;
+    for (uint32_t w = 0; w < words_.size(); ++w) {
+      uint64_t word = words_[w];
+      uint32_t base = w << 6;
+      uint32_t end = (base + 64 <= len_) ? 64 : (len_ - base);
+      for (uint32_t b = 0; b < end; ++b) {
+        tot += (word >> b) & 1;
+        out[base + b + 1] = tot;
+      }
+    }
+  }
+
+  size_t sizeInBytes() const {
+    return words_.size() * sizeof(uint64_t) +
+           counts_.size() * sizeof(uint16_t) +
+           anchors_.size() * sizeof(uint32_t);
+  }
+
+private:
+  // log2 of the number of bases per (32-bit) anchor
+  static constexpr uint32_t superShift_{16};
+
+  uint32_t len_{0};
+  // log2 of the number of bases per (16-bit) relative count
+  uint32_t countShift_{6};
+  std::vector<uint64_t> words_;
+  std::vector<uint16_t> counts_;
+  std::vector<uint32_t> anchors_;
+};
+
+#endif // __GC_INDEX_HPP__
@@ -0,0 +1,90 @@
+#ifndef __INDEX_READAHEAD_HPP__
+#define __INDEX_READAHEAD_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <boost/filesystem.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "MappedFile.hpp"
+
+/**
+ * Statistics about loading an index: the size of its files, how long they
+ * took to deserialize, and the peak resident set size before and after.
+ **/
+struct IndexLoadStats {
+  uint64_t numFiles{0};
+  uint64_t numBytes{0};
+  double loadSeconds{0.0};
+  // Peak resident set size (in KB) before and after the index was loaded.
+  long maxRSSBeforeKB{0};
+  long maxRSSAfterKB{0};
+
+  static long currentMaxRSSKB() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+    return usage.ru_maxrss;
+  }
+
+  void log(std::shared_ptr<spdlog::logger>& logger) const {
+    logger->info("Index load stats: {} files ({:.2f} MB) loaded in {:.2f}s; "
+                 "peak RSS {} MB -> {} MB",
+                 numFiles, numBytes / (1024.0 * 1024.0), loadSeconds,
+                 maxRSSBeforeKB / 1024, maxRSSAfterKB / 1024);
+  }
+};
+
+/**
+ * Maps the files of an on-disk index read-only, and asks the kernel
+ * (MADV_WILLNEED) to start reading them into the page cache, so that the
+ * disk reads overlap the (stream-based) deserialization that follows.  The
+ * advice is asynchronous: nothing is read, or made resident, here.  This
+ * doesn't change how the index is loaded; the deserialized index is still a
+ * private copy.
+ *
+ * The mappings are released when this object is destroyed; any pages read
+ * remain in the page cache.
+ **/
+class IndexReadahead {
+public:
+  IndexReadahead() = default;
+
+  IndexReadahead(const IndexReadahead&) = delete;
+  IndexReadahead& operator=(const IndexReadahead&) = delete;
+
+  /**
+   * Map every regular file in `indexDir`, and advise that it will be read.
+   * Returns the number of bytes mapped; files that can't be mapped are
+   * silently skipped (the loader will report any real problem with them).
+   **/
+  uint64_t start(const boost::filesystem::path& indexDir,
+                 IndexLoadStats& stats) {
+    namespace bfs = boost::filesystem;
+    uint64_t numBytes{0};
+
+    for (bfs::directory_iterator it(indexDir), end; it != end; ++it) {
+      if (!bfs::is_regular_file(it->status())) { continue; }
+      std::unique_ptr<salmon::MappedFile> mapped(
+          new salmon::MappedFile(it->path().string(), MADV_WILLNEED));
+      if (!mapped->good() or mapped->size() == 0) { continue; }
+      numBytes += mapped->size();
+      mappings_.push_back(std::move(mapped));
+    }
+
+    stats.numFiles += mappings_.size();
+    stats.numBytes += numBytes;
+    return numBytes;
+  }
+
+private:
+  std::vector<std::unique_ptr<salmon::MappedFile>> mappings_;
+};
+
+#endif // __INDEX_READAHEAD_HPP__
@@ -5,127 +5,215 @@ extern "C" {
 #include "bwt.h"
 }
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
-#include <unordered_map>
+#include <memory>
+#include <utility>
+#include <vector>
 
-#include <jellyfish/mer_dna.hpp>
+#include <sys/mman.h>
 
-#include "cereal/archives/binary.hpp"
-#include "cereal/types/unordered_map.hpp"
+#include <boost/filesystem.hpp>
 
-#include "xxhash.h"
+#include "MappedFile.hpp"
+#include "MinimalPerfectHash.hpp"
 
-using JFMer = jellyfish::mer_dna_ns::mer_base_static<uint64_t, 1>;
-
-// What will be the keys in our k-mer has map
-struct KmerKey {
-    KmerKey() {
-        mer_.polyT();
+/**
+ *  This class provides a compact, static map from
+ *  k-mers (k <= 32) to BWT intervals.
+ *
+ *  A k-mer is keyed by its 2-bit code (A=0, C=1, G=2, T=3, with the last
+ *  base in the lowest bits).  A minimal perfect hash over the codes gives the
+ *  slot of each k-mer in a bit-packed table of records; a record holds the
+ *  k-mer's code (its fingerprint, against which lookups are checked, since
+ *  the hash can't reject k-mers that aren't in the map) followed by the
+ *  interval's start positions (x[0] and x[1]) and size (x[2]), each in as
+ *  few bits as the largest of them needs.  The info field of every interval
+ *  is k, so it isn't stored.
+ *
+ *  Looking up a k-mer touches the hash (~0.6 bytes / k-mer, so it is
+ *  largely cache-resident) and then a single record (a few words).  The
+ *  records are used in place from a memory mapping of the file on disk, or
+ *  copied into (transparent) huge pages, which make the random accesses of
+ *  lookups much cheaper, on request.
+ */
+class KmerIntervalMap {
+    public:
+    uint32_t k() const { return k_; }
+    size_t size() const { return n_; }
+
+    // The code of the k bases (each in [0, 4)) starting at seq
+    inline uint64_t encode(const uint8_t* seq) const {
+        uint64_t code{0};
+        for (uint32_t i = 0; i < k_; ++i) { code = (code << 2) | seq[i]; }
+        return code;
     }
 
-    KmerKey(uint8_t* seq, uint32_t len) : mer_(len) {
-        mer_.polyT();
-        for (size_t i = 0; i < len; ++i) {
-            mer_.shift_left(seq[i]);
+    /**
+     * (Re-)build the map from (code, interval) pairs, whose codes must be
+     * distinct.  Every interval must be that of a k-mer (i.e. have info == k).
+     */
+    void build(uint32_t k, const std::vector<std::pair<uint64_t, bwtintv_t>>& entries) {
+        mapped_.reset();
+        k_ = k;
+        n_ = entries.size();
+        uint64_t maxPos{0}, maxSize{0};
+        std::vector<uint64_t> codes;
+        codes.reserve(n_);
+        for (auto& kv : entries) {
+            codes.push_back(kv.first);
+            maxPos = std::max({maxPos, kv.second.x[0], kv.second.x[1]});
+            maxSize = std::max(maxSize, kv.second.x[2]);
+        }
+        mph_ = MinimalPerfectHash(codes);
+        std::vector<uint64_t>().swap(codes);
+
+        posBits_ = bitsFor_(maxPos);
+        sizeBits_ = bitsFor_(maxSize);
+        setLayout_();
+        // One extra word, so that reading a record never runs off the end
+        ownedRecords_.assign(numRecordWords_(), 0);
+        records_ = ownedRecords_.data();
+        for (auto& kv : entries) {
+            uint64_t pos = mph_.lookup(kv.first) * recordBits_;
+            setBits_(pos, keyBits_, kv.first);
+            setBits_(pos + keyBits_, posBits_, kv.second.x[0]);
+            setBits_(pos + keyBits_ + posBits_, posBits_, kv.second.x[1]);
+            setBits_(pos + keyBits_ + 2 * posBits_, sizeBits_, kv.second.x[2]);
         }
     }
 
-    bool operator==(const KmerKey& ok) const {
-        return mer_ == ok.mer_;
+    /**
+     * If the k-mer with the given code is in the map, put its interval in
+     * interval and return true; otherwise, return false.
+     */
+    inline bool find(uint64_t code, bwtintv_t& interval) const {
+        uint64_t slot = mph_.lookup(code);
+        if (slot >= n_) { return false; }
+        uint64_t pos = slot * recordBits_;
+        if (getBits_(pos, keyBits_) != code) { return false; }
+        interval.x[0] = getBits_(pos + keyBits_, posBits_);
+        interval.x[1] = getBits_(pos + keyBits_ + posBits_, posBits_);
+        interval.x[2] = getBits_(pos + keyBits_ + 2 * posBits_, sizeBits_);
+        interval.info = k_;
+        return true;
     }
 
-    // Is there a smarter way to do save / load here?
-    template <typename Archive>
-    void save(Archive& archive) const {
-        auto key = mer_.get_bits(0, 2*mer_.k());
-        archive(key);
+    // As above, for the k bases starting at seq; false if any isn't A/C/G/T
+    inline bool find(const uint8_t* seq, bwtintv_t& interval) const {
+        uint64_t code{0};
+        for (uint32_t i = 0; i < k_; ++i) {
+            if (seq[i] > 3) { return false; }
+            code = (code << 2) | seq[i];
+        }
+        return find(code, interval);
     }
 
-    template <typename Archive>
-    void load(Archive& archive) {
-        mer_.polyT();
-        uint64_t bits;
-        archive(bits);
-        mer_.set_bits(0, 2*mer_.k(), bits);
+    size_t sizeInBytes() const {
+        return mph_.sizeInBytes() + numRecordWords_() * sizeof(uint64_t);
     }
 
-    JFMer mer_;
-};
-
-template <typename Archive>
-void load(Archive& archive, bwtintv_t& interval) {
-    archive( interval.x[0], interval.x[1], interval.x[2], interval.info );
-}
-
-template <typename Archive>
-void save(Archive& archive, const bwtintv_t& interval) {
-    archive( interval.x[0], interval.x[1], interval.x[2], interval.info );
-}
-
-/**
- *  This class provides an efficent hash-map from 
- *  k-mers to BWT intervals.
- */
-class KmerIntervalMap {
-    public:
-    // How we hash the keys
-    struct KmerHasher {
-        std::size_t operator()(const KmerKey& k) const {
-            void* data = static_cast<void*>(const_cast<KmerKey&>(k).mer_.data__());
-           return XXH64(data, sizeof(uint64_t), 0);
+    /**
+     * The file is a sequence of native 64-bit words: a header (magic, format
+     * version, k, n, and the field widths), the perfect hash, and the
+     * records.
+     */
+    bool save(const boost::filesystem::path& indexPath) const {
+        std::ofstream ofs(indexPath.string(), std::ios::binary);
+        auto put = [&ofs](uint64_t w) {
+            ofs.write(reinterpret_cast<const char*>(&w), sizeof(w));
+        };
+        for (uint64_t w : {magic_, formatVersion_, uint64_t(k_), n_,
+                           uint64_t(posBits_), uint64_t(sizeBits_)}) {
+            put(w);
         }
-    };
- 
-    private:
-        std::unordered_map<KmerKey, bwtintv_t, KmerHasher> map_;
-
-    public:
-    void setK(unsigned int k) { JFMer::k(k); }
-    uint32_t k() { return JFMer::k(); }
-
-    bool hasKmer(KmerKey& k) {
-        return map_.find(k) != map_.end();
-    }
-
-    decltype(map_)::iterator find(const KmerKey& k) {
-        return map_.find(k);
-    }
-    decltype(map_)::iterator find(KmerKey&& k) {
-        return map_.find(k);
+        mph_.save(ofs);
+        uint64_t numWords = numRecordWords_();
+        for (uint64_t i = 0; i < numWords; ++i) { put(records_ ? records_[i] : 0); }
+        ofs.close();
+        return ofs.good();
     }
 
-    decltype(map_)::iterator end() {
-        return map_.end();
+    /**
+     * Load a map written by save().  The hash is read into memory, but the
+     * records are used directly from a (read-only) mapping of the file.
+     * Returns false if the file can't be read, or isn't such a map (e.g. it
+     * was written by an older version of salmon).
+     */
+    bool load(const boost::filesystem::path& indexPath) {
+        *this = KmerIntervalMap();
+        std::unique_ptr<salmon::MappedFile> mapped(
+            new salmon::MappedFile(indexPath.string(), MADV_WILLNEED));
+        if (!mapped->good()) { return false; }
+        const uint64_t* p = reinterpret_cast<const uint64_t*>(mapped->begin());
+        const uint64_t* end = p + mapped->size() / sizeof(uint64_t);
+        if (end - p < 6 or p[0] != magic_ or p[1] != formatVersion_) { return false; }
+        uint64_t k = p[2], n = p[3], posBits = p[4], sizeBits = p[5];
+        if (k == 0 or k > 32 or posBits > 64 or sizeBits > 64) { return false; }
+        p += 6;
+        MinimalPerfectHash mph;
+        if (!mph.load(p, end) or mph.size() != n) { return false; }
+
+        k_ = k;
+        n_ = n;
+        posBits_ = posBits;
+        sizeBits_ = sizeBits;
+        setLayout_();
+        if (static_cast<uint64_t>(end - p) < numRecordWords_()) {
+            *this = KmerIntervalMap();
+            return false;
+        }
+        mph_ = std::move(mph);
+        records_ = p;
+        mapped_ = std::move(mapped);
+        return true;
     }
 
+    private:
+    static constexpr uint64_t magic_{0x5855414e4d4c4153ULL}; // "SALMNAUX"
+    static constexpr uint64_t formatVersion_{2};
 
-    bwtintv_t& operator[](const KmerKey& k) {
-        return map_[k];
+    static uint32_t bitsFor_(uint64_t v) {
+        uint32_t b{1};
+        while (b < 64 and (v >> b) != 0) { ++b; }
+        return b;
     }
-    bwtintv_t& operator[](KmerKey&& k) {
-        return map_[k];
+
+    void setLayout_() {
+        keyBits_ = 2 * k_;
+        recordBits_ = keyBits_ + 2 * posBits_ + sizeBits_;
     }
-    
-    decltype(map_)::size_type size() { return map_.size(); }
 
-    void save(boost::filesystem::path indexPath) {
-        std::ofstream ofs(indexPath.string(), std::ios::binary);
-        {
-            cereal::BinaryOutputArchive oa(ofs);
-            oa(map_);
-        }
-        ofs.close();
+    uint64_t numRecordWords_() const { return (n_ * recordBits_ + 63) / 64 + 1; }
+
+    // The width bits (<= 64) starting at bit pos of the records
+    inline uint64_t getBits_(uint64_t pos, uint32_t width) const {
+        uint64_t w = pos >> 6;
+        uint32_t o = pos & 63;
+        uint64_t v = records_[w] >> o;
+        if (o + width > 64) { v |= records_[w + 1] << (64 - o); }
+        return (width == 64) ? v : (v & ((uint64_t(1) << width) - 1));
     }
 
-    void load(boost::filesystem::path indexPath) {
-        std::ifstream ifs(indexPath.string(), std::ios::binary);
-        {
-            cereal::BinaryInputArchive ia(ifs);
-            ia(map_);
-        }
-        ifs.close();
+    void setBits_(uint64_t pos, uint32_t width, uint64_t v) {
+        uint64_t w = pos >> 6;
+        uint32_t o = pos & 63;
+        ownedRecords_[w] |= v << o;
+        if (o + width > 64) { ownedRecords_[w + 1] |= v >> (64 - o); }
     }
 
+    uint32_t k_{0};
+    uint64_t n_{0};
+    uint32_t keyBits_{0};
+    uint32_t posBits_{0};
+    uint32_t sizeBits_{0};
+    uint64_t recordBits_{0};
+    MinimalPerfectHash mph_;
+    // Either ownedRecords_ (after build), or within mapped_ (after load)
+    const uint64_t* records_{nullptr};
+    std::vector<uint64_t> ownedRecords_;
+    std::unique_ptr<salmon::MappedFile> mapped_;
 };
 
 #endif // __KMER_INTERVAL_MAP_HPP__
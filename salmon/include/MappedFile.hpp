@@ -0,0 +1,70 @@
+#ifndef __MAPPED_FILE_HPP__
+#define __MAPPED_FILE_HPP__
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace salmon {
+
+// A read-only memory mapping of a whole file; advice is passed on to
+// madvise (the default suits a single pass over the file).
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path, int advice = MADV_SEQUENTIAL) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return;
+    }
+    len_ = static_cast<size_t>(st.st_size);
+    good_ = true;
+    if (len_ > 0) {
+      void* addr = mmap(nullptr, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        good_ = false;
+      } else {
+        addr_ = addr;
+        madvise(addr_, len_, advice);
+      }
+    }
+    // The mapping holds its own reference to the file.
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (addr_ != nullptr) { munmap(addr_, len_); }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool good() const { return good_; }
+  const char* begin() const { return static_cast<const char*>(addr_); }
+  const char* end() const { return begin() + (addr_ ? len_ : 0); }
+  size_t size() const { return addr_ ? len_ : 0; }
+
+  // Drop the (whole) pages before `upTo` from this process' memory; they
+  // are read from the file again if they are touched later.
+  void release(const char* upTo) const {
+    if (addr_ == nullptr or upTo <= begin()) { return; }
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t len = (static_cast<size_t>(upTo - begin()) / pageSize) * pageSize;
+    if (len > 0) { madvise(addr_, len, MADV_DONTNEED); }
+  }
+
+private:
+  void* addr_{nullptr};
+  size_t len_{0};
+  bool good_{false};
+};
+
+} // namespace salmon
+
+#endif // __MAPPED_FILE_HPP__
@@ -0,0 +1,256 @@
+#ifndef __MAPPING_CACHE_HPP__
+#define __MAPPING_CACHE_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "AlignmentGroup.hpp"
+#include "LibraryFormat.hpp"
+#include "RapMapUtils.hpp"
+
+/**
+ * The on-disk mapping cache.  As the reads are mapped, the quasi-mappings of
+ * each mini-batch are written out as a block of compact, fixed-size records.
+ * A later `salmon quant --fromCache` run can then replay these blocks
+ * directly, without re-parsing the reads or repeating the k-mer lookups, SA
+ * searches and hit merging.
+ *
+ * File layout:
+ *   [magic (8 bytes)][version (uint32)][numTranscripts (uint32)]
+ *   [seqHash length (uint32)][seqHash bytes]
+ *   followed by any number of blocks, each of which is
+ *   [BlockHeader][group sizes (uint32 x numGroups)][CachedMapping x numMappings]
+ *
+ * Only fragments that have at least one mapping are stored; the number of
+ * fragments observed in the block (mapped or not) is kept in the header so
+ * that the mapping rate can be reproduced.
+ **/
+
+// A single cached mapping.  This holds everything that processMiniBatch
+// and the bias models need to know about a QuasiAlignment.
+struct CachedMapping {
+  uint32_t tid;
+  int32_t pos;
+  int32_t matePos;
+  uint32_t fragLen;
+  uint32_t readLen;
+  uint32_t mateLen;
+  uint8_t flags;
+  uint8_t formatID;
+  uint16_t padding{0};
+
+  static constexpr uint8_t fwdBit = 0x1;
+  static constexpr uint8_t mateIsFwdBit = 0x2;
+  static constexpr uint8_t isPairedBit = 0x4;
+  static constexpr uint8_t mateStatusShift = 4;
+
+  CachedMapping() = default;
+
+  CachedMapping(const rapmap::utils::QuasiAlignment& h)
+      : tid(h.tid), pos(h.pos), matePos(h.matePos), fragLen(h.fragLen),
+        readLen(h.readLen), mateLen(h.mateLen), flags(0),
+        formatID(h.format.formatID()) {
+    if (h.fwd) { flags |= fwdBit; }
+    if (h.mateIsFwd) { flags |= mateIsFwdBit; }
+    if (h.isPaired) { flags |= isPairedBit; }
+    flags |= (static_cast<uint8_t>(h.mateStatus) << mateStatusShift);
+  }
+
+  // Fill in the QuasiAlignment `h` from this record.
+  void toQuasiAlignment(rapmap::utils::QuasiAlignment& h) const {
+    h.tid = tid;
+    h.pos = pos;
+    h.matePos = matePos;
+    h.fragLen = fragLen;
+    h.readLen = readLen;
+    h.mateLen = mateLen;
+    h.fwd = (flags & fwdBit);
+    h.mateIsFwd = (flags & mateIsFwdBit);
+    h.isPaired = (flags & isPairedBit);
+    h.mateStatus =
+        static_cast<rapmap::utils::MateStatus>((flags >> mateStatusShift) & 0x3);
+    h.format = LibraryFormat::formatFromID(formatID);
+  }
+};
+
+// The (decoded) contents of one cache block.  A writer thread re-uses one of
+// these as scratch space, and a reader thread re-uses one to receive blocks.
+struct MappingCacheBlock {
+  struct BlockHeader {
+    uint32_t libraryIndex{0};
+    uint32_t numObserved{0};
+    uint32_t numUpperBound{0};
+    uint32_t numGroups{0};
+    uint32_t numMappings{0};
+  };
+
+  BlockHeader header;
+  std::vector<uint32_t> groupSizes;
+  std::vector<CachedMapping> mappings;
+
+  void clear() {
+    header = BlockHeader();
+    groupSizes.clear();
+    mappings.clear();
+  }
+
+  // Populate this block from a range of alignment groups.
+  template <typename IterT>
+  void fill(IterT begin, IterT end, uint32_t numObserved,
+            uint32_t numUpperBound) {
+    clear();
+    header.numObserved = numObserved;
+    header.numUpperBound = numUpperBound;
+    for (auto it = begin; it != end; ++it) {
+      auto& alns = it->alignments();
+      if (alns.empty()) { continue; }
+      groupSizes.push_back(static_cast<uint32_t>(alns.size()));
+      for (auto& h : alns) { mappings.emplace_back(h); }
+    }
+    header.numGroups = groupSizes.size();
+    header.numMappings = mappings.size();
+  }
+
+  /**
+   * Decode this block into `structureVec`, which must have room for at
+   * least header.numGroups groups.  Returns the number of groups filled.
+   **/
+  size_t decode(
+      std::vector<AlignmentGroup<rapmap::utils::QuasiAlignment>>& structureVec) const {
+    size_t mappingIdx{0};
+    for (size_t g = 0; g < groupSizes.size(); ++g) {
+      auto& group = structureVec[g];
+      group.clearAlignments();
+      auto& alns = group.alignments();
+      alns.resize(groupSizes[g]);
+      for (auto& h : alns) {
+        mappings[mappingIdx++].toQuasiAlignment(h);
+      }
+    }
+    return groupSizes.size();
+  }
+};
+
+class MappingCacheWriter {
+public:
+  MappingCacheWriter(const boost::filesystem::path& cachePath,
+                     uint32_t numTranscripts, const std::string& seqHash)
+      : out_(cachePath.string(), std::ios::binary | std::ios::trunc),
+        libraryIndex_(0), numBlocks_(0) {
+    if (!out_.is_open()) { return; }
+    out_.write(magic(), magicLen);
+    uint32_t version{version_};
+    out_.write(reinterpret_cast<char*>(&version), sizeof(version));
+    out_.write(reinterpret_cast<char*>(&numTranscripts), sizeof(numTranscripts));
+    uint32_t hashLen = seqHash.size();
+    out_.write(reinterpret_cast<char*>(&hashLen), sizeof(hashLen));
+    out_.write(seqHash.data(), hashLen);
+  }
+
+  bool isOpen() const { return out_.is_open() and out_.good(); }
+
+  // All blocks written from now on belong to read library `idx`.
+  void setLibraryIndex(uint32_t idx) { libraryIndex_ = idx; }
+
+  /**
+   * Append `block` to the cache.  The block is encoded by the calling
+   * thread; only the write itself is serialized.
+   **/
+  bool writeBlock(MappingCacheBlock& block) {
+    block.header.libraryIndex = libraryIndex_;
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    out_.write(reinterpret_cast<char*>(&block.header), sizeof(block.header));
+    out_.write(reinterpret_cast<char*>(block.groupSizes.data()),
+               sizeof(uint32_t) * block.groupSizes.size());
+    out_.write(reinterpret_cast<char*>(block.mappings.data()),
+               sizeof(CachedMapping) * block.mappings.size());
+    ++numBlocks_;
+    return out_.good();
+  }
+
+  uint64_t numBlocks() const { return numBlocks_; }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (out_.is_open()) { out_.close(); }
+  }
+
+  static const char* magic() { return "SLMNMCCH"; }
+  static constexpr size_t magicLen{8};
+  static constexpr uint32_t version_{1};
+
+private:
+  std::ofstream out_;
+  std::mutex writeMutex_;
+  uint32_t libraryIndex_;
+  uint64_t numBlocks_;
+};
+
+class MappingCacheReader {
+public:
+  MappingCacheReader(const boost::filesystem::path& cachePath)
+      : in_(cachePath.string(), std::ios::binary), valid_(false),
+        numTranscripts_(0) {
+    if (!in_.is_open()) { return; }
+    char magic[MappingCacheWriter::magicLen];
+    in_.read(magic, sizeof(magic));
+    uint32_t version{0};
+    in_.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in_.read(reinterpret_cast<char*>(&numTranscripts_), sizeof(numTranscripts_));
+    uint32_t hashLen{0};
+    in_.read(reinterpret_cast<char*>(&hashLen), sizeof(hashLen));
+    if (!in_.good() or
+        std::memcmp(magic, MappingCacheWriter::magic(), sizeof(magic)) != 0 or
+        version != MappingCacheWriter::version_) {
+      return;
+    }
+    seqHash_.resize(hashLen);
+    in_.read(&seqHash_[0], hashLen);
+    valid_ = in_.good();
+  }
+
+  // True if the file exists and has a header this version understands.
+  bool isValid() const { return valid_; }
+  uint32_t numTranscripts() const { return numTranscripts_; }
+  const std::string& seqHash() const { return seqHash_; }
+
+  /**
+   * Read the next block belonging to read library `libraryIndex` into
+   * `block`.  Returns false when there are no more blocks for this library.
+   * This function is safe to call from multiple threads.
+   **/
+  bool nextBlock(uint32_t libraryIndex, MappingCacheBlock& block) {
+    std::lock_guard<std::mutex> lock(readMutex_);
+    auto blockStart = in_.tellg();
+    if (!in_.read(reinterpret_cast<char*>(&block.header), sizeof(block.header))) {
+      return false;
+    }
+    // This block belongs to the next library; leave it for later.
+    if (block.header.libraryIndex != libraryIndex) {
+      in_.seekg(blockStart);
+      return false;
+    }
+    block.groupSizes.resize(block.header.numGroups);
+    block.mappings.resize(block.header.numMappings);
+    in_.read(reinterpret_cast<char*>(block.groupSizes.data()),
+             sizeof(uint32_t) * block.groupSizes.size());
+    in_.read(reinterpret_cast<char*>(block.mappings.data()),
+             sizeof(CachedMapping) * block.mappings.size());
+    return in_.good();
+  }
+
+private:
+  std::ifstream in_;
+  std::mutex readMutex_;
+  bool valid_;
+  uint32_t numTranscripts_;
+  std::string seqHash_;
+};
+
+#endif // __MAPPING_CACHE_HPP__
@@ -6,6 +6,7 @@
 #include "ReadPair.hpp"
 #include "UnpairedRead.hpp"
 #include "AlignmentGroup.hpp"
+#include "AdaptiveWait.hpp"
 #include "concurrentqueue.h"
 
 template <typename AlnGroupT>
@@ -20,9 +21,12 @@ class MiniBatchInfo {
         std::vector<AlnGroupT*>* alignments;
         double logForgettingMass;
 
+        // Return the fragments and alignment groups of this batch to their
+        // pools, and wake any (decoding) thread waiting for them
         template <typename FragT>
         void release(tbb::concurrent_queue<FragT*>& fragmentQueue,
-                     moodycamel::ConcurrentQueue<AlnGroupT*>& alignmentGroupQueue){
+                     moodycamel::ConcurrentQueue<AlnGroupT*>& alignmentGroupQueue,
+                     AdaptiveWait& poolRefilled){
                     // tbb::concurrent_bounded_queue<AlnGroupT*>& alignmentGroupQueue){
             size_t ng{0};
             for (auto& alnGroup : *alignments) {
@@ -40,6 +44,7 @@ class MiniBatchInfo {
             }
 
             alignmentGroupQueue.enqueue_bulk(std::make_move_iterator(alignments->begin()), alignments->size());
+            poolRefilled.notifyAll();
             delete alignments;
             alignments = nullptr;
         }
@@ -0,0 +1,231 @@
+#ifndef __MINIMAL_PERFECT_HASH_HPP__
+#define __MINIMAL_PERFECT_HASH_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+/**
+ * A minimal perfect hash function over a static set of n distinct 64-bit
+ * keys (typically the hashes of strings or k-mers), mapping each of them to a
+ * distinct index in [0, n).
+ *
+ * This follows the "pilot" construction of PTHash: every key is hashed into a
+ * bucket (~4 keys per bucket, skewed so that 60% of the keys fall into 30% of
+ * the buckets), and the buckets, largest first, are each given the smallest
+ * 16-bit pilot that sends all of their keys to distinct free slots of a table
+ * ~1% larger than n.  A key's index is a hash of the key and its bucket's
+ * pilot; the few keys whose slot is past n are remapped into the slots left
+ * free below it.  This takes ~4.6 bits per key, and a lookup reads a single
+ * pilot (and, rarely, a remapped slot) --- there are no levels to walk, nor
+ * branches to mispredict --- so it costs at most one cache miss.
+ *
+ * The function can't tell keys outside of the set apart from those in it;
+ * lookup() returns an arbitrary index (or size()) for them.  Callers that may
+ * look up foreign keys must verify the result (e.g. against a stored
+ * fingerprint, or the original key).
+ */
+class MinimalPerfectHash {
+public:
+  // An empty function
+  MinimalPerfectHash() : MinimalPerfectHash(std::vector<uint64_t>()) {}
+
+  // The keys must be distinct
+  explicit MinimalPerfectHash(const std::vector<uint64_t>& keys) {
+    n_ = keys.size();
+    setLayout_();
+    // The hashes of the keys, in order of their buckets (bucket_() is
+    // monotone in the hash)
+    std::vector<uint64_t> hashes;
+    // bucketStart[b] is the index, in hashes, of the first of bucket b
+    std::vector<uint64_t> bucketStart(numBuckets_ + 1);
+    std::vector<uint64_t> order(numBuckets_);
+    std::vector<uint64_t> taken;
+    std::vector<uint64_t> pos;
+    for (seed_ = seedStep_;; seed_ += seedStep_) {
+      hashes.resize(n_);
+      for (size_t i = 0; i < n_; ++i) { hashes[i] = hash_(keys[i]); }
+      std::sort(hashes.begin(), hashes.end());
+      // (repeated keys would never be placed)
+      hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+      std::fill(bucketStart.begin(), bucketStart.end(), 0);
+      for (auto h : hashes) { ++bucketStart[bucket_(h) + 1]; }
+      uint64_t maxSize{0};
+      for (uint64_t b = 0; b < numBuckets_; ++b) {
+        maxSize = std::max(maxSize, bucketStart[b + 1]);
+        bucketStart[b + 1] += bucketStart[b];
+      }
+      // The buckets from largest to smallest
+      std::vector<uint64_t> sizeStart(maxSize + 2, 0);
+      for (uint64_t b = 0; b < numBuckets_; ++b) {
+        ++sizeStart[maxSize - (bucketStart[b + 1] - bucketStart[b]) + 1];
+      }
+      for (uint64_t s = 0; s <= maxSize; ++s) { sizeStart[s + 1] += sizeStart[s]; }
+      for (uint64_t b = 0; b < numBuckets_; ++b) {
+        order[sizeStart[maxSize - (bucketStart[b + 1] - bucketStart[b])]++] = b;
+      }
+
+      taken.assign((tableSize_ + 63) / 64, 0);
+      pilots_.assign(numBuckets_, 0);
+      bool placed{true};
+      for (auto b : order) {
+        uint64_t first = bucketStart[b], last = bucketStart[b + 1];
+        if (first == last) { break; }
+        uint32_t pilot{0};
+        for (; pilot <= maxPilot_; ++pilot) {
+          pos.clear();
+          for (uint64_t i = first; i < last; ++i) {
+            uint64_t p = position_(hashes[i], pilot);
+            if (((taken[p >> 6] >> (p & 63)) & 1) or
+                std::find(pos.begin(), pos.end(), p) != pos.end()) {
+              break;
+            }
+            pos.push_back(p);
+          }
+          if (pos.size() == last - first) { break; }
+        }
+        // No pilot works (vanishingly unlikely); start over with a new seed
+        if (pilot > maxPilot_) {
+          placed = false;
+          break;
+        }
+        pilots_[b] = pilot;
+        for (auto p : pos) { taken[p >> 6] |= uint64_t(1) << (p & 63); }
+      }
+      if (placed) { break; }
+    }
+
+    // Send the keys placed past n to the free slots below it; the other
+    // entries (which only foreign keys can reach) give n.
+    remap_.assign(tableSize_ - n_, n_);
+    uint64_t hole{0};
+    for (uint64_t p = n_; p < tableSize_; ++p) {
+      if ((taken[p >> 6] >> (p & 63)) & 1) {
+        while ((taken[hole >> 6] >> (hole & 63)) & 1) { ++hole; }
+        remap_[p - n_] = hole++;
+      }
+    }
+  }
+
+  size_t size() const { return n_; }
+
+  // The index of key, if it is one of the keys this was built from
+  inline uint64_t lookup(uint64_t key) const {
+    uint64_t h = hash_(key);
+    uint64_t p = position_(h, pilots_[bucket_(h)]);
+    return (p < n_) ? p : remap_[p - n_];
+  }
+
+  size_t sizeInBytes() const {
+    return pilots_.size() * sizeof(uint16_t) + remap_.size() * sizeof(uint64_t);
+  }
+
+  // Write the function to out, as a sequence of (native) 64-bit words
+  void save(std::ostream& out) const {
+    auto put = [&out](uint64_t w) {
+      out.write(reinterpret_cast<const char*>(&w), sizeof(w));
+    };
+    put(n_);
+    put(seed_);
+    // The pilots, 4 to a word
+    for (uint64_t b = 0; b < numBuckets_; b += 4) {
+      uint64_t w{0};
+      for (uint64_t j = 0; j < 4 and b + j < numBuckets_; ++j) {
+        w |= uint64_t(pilots_[b + j]) << (16 * j);
+      }
+      put(w);
+    }
+    for (auto p : remap_) { put(p); }
+  }
+
+  /**
+   * Read a function written by save() from the words [p, end), leaving p just
+   * past it.  Returns false (leaving this empty) if they don't hold one.
+   */
+  bool load(const uint64_t*& p, const uint64_t* end) {
+    *this = MinimalPerfectHash();
+    const uint64_t* q = p;
+    if (end - q < 2) { return false; }
+    MinimalPerfectHash f;
+    f.n_ = q[0];
+    f.seed_ = q[1];
+    q += 2;
+    // (which also rules out an n so large that the sizes below overflow)
+    if (f.n_ > static_cast<uint64_t>(end - q) * 16) { return false; }
+    f.setLayout_();
+    uint64_t numPilotWords = (f.numBuckets_ + 3) / 4;
+    uint64_t numRemap = f.tableSize_ - f.n_;
+    if (static_cast<uint64_t>(end - q) < numPilotWords + numRemap) { return false; }
+    f.pilots_.resize(f.numBuckets_);
+    for (uint64_t b = 0; b < f.numBuckets_; ++b) {
+      f.pilots_[b] = static_cast<uint16_t>(q[b / 4] >> (16 * (b % 4)));
+    }
+    q += numPilotWords;
+    f.remap_.assign(q, q + numRemap);
+    q += numRemap;
+    for (auto r : f.remap_) {
+      if (r > f.n_) { return false; }
+    }
+    *this = std::move(f);
+    p = q;
+    return true;
+  }
+
+private:
+  static constexpr uint32_t maxPilot_{0xffff};
+  static constexpr uint64_t seedStep_{0x9e3779b97f4a7c15ULL};
+  // 60% of the hashes (those below split_) go to the first 30% of the buckets
+  static constexpr uint64_t split_{0x9999999999999999ULL};
+
+  // A well-mixed (and invertible) function of a word
+  static inline uint64_t mix_(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // x * y / 2^64: maps x to [0, y), as a modulus would, but cheaply
+  static inline uint64_t scale_(uint64_t x, uint64_t y) {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(x) * y) >> 64);
+  }
+
+  inline uint64_t hash_(uint64_t key) const { return mix_(key + seed_); }
+
+  // (written so as to compile to conditional moves, not a branch)
+  inline uint64_t bucket_(uint64_t h) const {
+    bool dense = h < split_;
+    uint64_t first = dense ? 0 : numDenseBuckets_;
+    uint64_t x = dense ? h : h - split_;
+    return first + scale_(x, dense ? denseScale_ : sparseScale_);
+  }
+
+  inline uint64_t position_(uint64_t h, uint64_t pilot) const {
+    return scale_(mix_(h ^ (pilot * 0xc2b2ae3d27d4eb4fULL)), tableSize_);
+  }
+
+  // The sizes that follow from n_
+  void setLayout_() {
+    numBuckets_ = std::max<uint64_t>(1, (n_ + 3) / 4);
+    numDenseBuckets_ = numBuckets_ * 3 / 10;
+    // So that the hashes below split_ (~0.6 * 2^64) scale to
+    // [0, numDenseBuckets_), and the rest (~0.4 * 2^64) to the others
+    denseScale_ = numDenseBuckets_ * 5 / 3;
+    sparseScale_ = (numBuckets_ - numDenseBuckets_) * 5 / 2;
+    tableSize_ = n_ + n_ / 99 + 1;
+  }
+
+  uint64_t n_{0};
+  uint64_t seed_{0};
+  uint64_t numBuckets_{0};
+  uint64_t numDenseBuckets_{0};
+  uint64_t denseScale_{0};
+  uint64_t sparseScale_{0};
+  uint64_t tableSize_{0};
+  std::vector<uint16_t> pilots_;
+  // The index of each of the slots [n, tableSize_)
+  std::vector<uint64_t> remap_;
+};
+
+#endif // __MINIMAL_PERFECT_HASH_HPP__
@@ -0,0 +1,53 @@
+#ifndef __PARALLEL_BWT_HPP__
+#define __PARALLEL_BWT_HPP__
+
+extern "C" {
+#include "bwt.h"
+}
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+namespace salmon {
+namespace fmd {
+
+/**
+ * Build the BWT of the (2-bit packed, as in a BWA .pac file) text of
+ * seqLen bases, along with every saInterval-th entry of its suffix array,
+ * using all of the threads TBB has been allowed.
+ *
+ * The suffixes are partitioned into 4^q buckets by their first q bases
+ * (q <= 12), and the buckets are sorted in parallel (comparing 32 bases at a
+ * time).  The suffix positions of a round of buckets are held as 8-byte
+ * integers, at most maxRoundSuffixes of them (1 GiB with the default) unless
+ * a single bucket holds more; when there are more suffixes than that, the
+ * buckets are sorted in several rounds.  That is the bulk of the memory used.
+ * Besides it, this holds the packed text and two copies of the BWT (n/4 bytes
+ * each), the SA samples (8n/saInterval bytes) and, for each thread, a count
+ * per bucket (8 * 4^q bytes, up to 128 MiB).
+ *
+ * The result is exactly what bwt_pac2bwt (or bwt_bwtgen) followed by
+ * bwt_cal_sa would give: the same primary index, counts, BWT and SA samples.
+ * The BWT has no occurrence counts yet (see bwt_bwtupdate_core).
+ */
+bwt_t* buildBWT(const uint8_t* pac, uint64_t seqLen, int saInterval,
+                spdlog::logger* log = nullptr,
+                uint64_t maxRoundSuffixes = uint64_t(1) << 27);
+
+/**
+ * Build the FMD (BWA) index of fastaFile, writing prefix.{pac,ann,amb,bwt,sa}
+ * exactly as `bwa index -s saInterval -p prefix fastaFile` would, but
+ * constructing the BWT and suffix array with numThreads threads.  Returns 0
+ * on success.
+ */
+int buildIndex(const std::string& fastaFile, const std::string& prefix,
+               int saInterval, uint32_t numThreads,
+               std::shared_ptr<spdlog::logger> log);
+
+} // namespace fmd
+} // namespace salmon
+
+#endif // __PARALLEL_BWT_HPP__
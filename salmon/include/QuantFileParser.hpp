@@ -0,0 +1,188 @@
+#ifndef __QUANT_FILE_PARSER_HPP__
+#define __QUANT_FILE_PARSER_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "MappedFile.hpp"
+
+/**
+ * Fast, allocation-free reading of quant.sf files, used by `salmon
+ * quantmerge`.  The file is memory-mapped, and its records are parsed in
+ * place; a record's name points into the mapping.
+ */
+namespace salmon {
+namespace quantfile {
+
+/**
+ * Parse a (possibly signed, possibly scientific) decimal number in [p, end)
+ * into `out`, and advance p past it.  Numbers with at most 19 significant
+ * digits and a small exponent are converted exactly with a single
+ * multiplication or division (every such mantissa and power of ten is
+ * exactly representable); anything else (e.g. "nan", "inf" or very long
+ * mantissas) falls back to strtod.  Returns false if there is no number at p.
+ */
+inline bool parseDouble(const char*& p, const char* end, double& out) {
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* start = p;
+  const char* q = p;
+  bool neg{false};
+  if (q < end and (*q == '-' or *q == '+')) {
+    neg = (*q == '-');
+    ++q;
+  }
+  uint64_t mantissa{0};
+  int32_t numDigits{0};
+  int32_t exp10{0};
+  bool sawDigit{false};
+  while (q < end and *q >= '0' and *q <= '9') {
+    sawDigit = true;
+    if (mantissa == 0 and *q == '0') { ++q; continue; }
+    if (numDigits < 19) {
+      mantissa = mantissa * 10 + (*q - '0');
+      ++numDigits;
+    } else {
+      ++exp10;
+      numDigits = 20; // too many digits to convert exactly
+    }
+    ++q;
+  }
+  if (q < end and *q == '.') {
+    ++q;
+    while (q < end and *q >= '0' and *q <= '9') {
+      sawDigit = true;
+      if (mantissa == 0 and *q == '0') {
+        --exp10;
+      } else if (numDigits < 19) {
+        mantissa = mantissa * 10 + (*q - '0');
+        ++numDigits;
+        --exp10;
+      } else {
+        numDigits = 20;
+      }
+      ++q;
+    }
+  }
+  if (sawDigit and q < end and (*q == 'e' or *q == 'E')) {
+    const char* r = q + 1;
+    bool expNeg{false};
+    if (r < end and (*r == '-' or *r == '+')) {
+      expNeg = (*r == '-');
+      ++r;
+    }
+    if (r < end and *r >= '0' and *r <= '9') {
+      int32_t e{0};
+      while (r < end and *r >= '0' and *r <= '9') {
+        if (e < 100000) { e = e * 10 + (*r - '0'); }
+        ++r;
+      }
+      exp10 += expNeg ? -e : e;
+      q = r;
+    }
+  }
+
+  bool fast = sawDigit and numDigits <= 19 and
+              (mantissa >> 53) == 0 and exp10 >= -22 and exp10 <= 22;
+  if (fast) {
+    double v = static_cast<double>(mantissa);
+    v = (exp10 < 0) ? v / pow10[-exp10] : v * pow10[exp10];
+    out = neg ? -v : v;
+    p = q;
+    return true;
+  }
+
+  // Slow path; strtod needs a terminated copy of the token.
+  const char* tokEnd = start;
+  while (tokEnd < end and *tokEnd != '\t' and *tokEnd != ' ' and
+         *tokEnd != '\n' and *tokEnd != '\r') {
+    ++tokEnd;
+  }
+  std::string tok(start, tokEnd);
+  char* parsedEnd{nullptr};
+  out = std::strtod(tok.c_str(), &parsedEnd);
+  if (parsedEnd == tok.c_str()) { return false; }
+  p = start + (parsedEnd - tok.c_str());
+  return true;
+}
+
+// A single line of a quant.sf file
+struct QuantRecord {
+  const char* name{nullptr};
+  size_t nameLen{0};
+  double len{0.0};
+  double effectiveLen{0.0};
+  double tpm{0.0};
+  double numReads{0.0};
+};
+
+/**
+ * Iterates over the records in [begin, end), which holds the contents of a
+ * quant.sf file.  The first line is skipped if it's a header.  Fields may be
+ * separated by any (non-newline) whitespace.
+ */
+class QuantFileParser {
+public:
+  QuantFileParser(const char* begin, const char* end) : p_(begin), end_(end) {
+    if (p_ + 4 <= end_ and std::memcmp(p_, "Name", 4) == 0) { skipLine_(); }
+  }
+
+  // Parse the next record into `rec`; returns false at the end of the input
+  // (or on a malformed line, in which case error() is true).
+  bool next(QuantRecord& rec) {
+    skipSpace_(true);
+    if (p_ >= end_) { return false; }
+    rec.name = p_;
+    while (p_ < end_ and !isSpace_(*p_)) { ++p_; }
+    rec.nameLen = p_ - rec.name;
+    if (!field_(rec.len) or !field_(rec.effectiveLen) or !field_(rec.tpm) or
+        !field_(rec.numReads)) {
+      error_ = true;
+      return false;
+    }
+    skipLine_();
+    return true;
+  }
+
+  bool error() const { return error_; }
+
+  // How far into the input the parser has read
+  const char* position() const { return p_; }
+
+private:
+  static bool isSpace_(char c) {
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+  }
+
+  void skipSpace_(bool newlines) {
+    while (p_ < end_ and (*p_ == ' ' or *p_ == '\t' or *p_ == '\r' or
+                          (newlines and *p_ == '\n'))) {
+      ++p_;
+    }
+  }
+
+  void skipLine_() {
+    auto nl = static_cast<const char*>(std::memchr(p_, '\n', end_ - p_));
+    p_ = (nl == nullptr) ? end_ : nl + 1;
+  }
+
+  bool field_(double& v) {
+    skipSpace_(false);
+    return p_ < end_ and parseDouble(p_, end_, v);
+  }
+
+  const char* p_;
+  const char* end_;
+  bool error_{false};
+};
+
+using salmon::MappedFile;
+
+} // namespace quantfile
+} // namespace salmon
+
+#endif // __QUANT_FILE_PARSER_HPP__
@@ -0,0 +1,81 @@
+#ifndef __READ_BIAS_SAMPLE_BUFFER_HPP__
+#define __READ_BIAS_SAMPLE_BUFFER_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "SBModel.hpp"
+#include "Transcript.hpp"
+
+/**
+ * A sequence-specific bias observation, recorded during mapping.  This is
+ * just the location of the read-start context window; the context itself is
+ * only extracted from the transcript sequence when the buffer is flushed.
+ **/
+struct ReadBiasSample {
+  uint32_t tid;
+  // The first position of the context window on the transcript.
+  int32_t windowStart;
+  // True if the read maps to the reverse complement strand.
+  uint32_t rc;
+};
+
+/**
+ * A per-thread buffer of read-start bias observations.  Mapping threads only
+ * decide *where* a sample comes from (which needs no sequence), and push it
+ * here; the (comparatively expensive) k-mer extraction and model update are
+ * done in batches, in transcript order, off of the per-read path.
+ **/
+class ReadBiasSampleBuffer {
+public:
+  explicit ReadBiasSampleBuffer(size_t capacity = 65536)
+      : capacity_(capacity) {
+    samples_.reserve(capacity_);
+  }
+
+  inline void push(uint32_t tid, int32_t windowStart, bool rc) {
+    samples_.push_back({tid, windowStart, static_cast<uint32_t>(rc)});
+  }
+
+  inline bool full() const { return samples_.size() >= capacity_; }
+  inline size_t size() const { return samples_.size(); }
+
+  /**
+   * Add the context of every buffered sample to the appropriate model and
+   * empty the buffer.
+   **/
+  void flush(std::vector<Transcript>& transcripts, SBModel& readBiasFW,
+             SBModel& readBiasRC) {
+    if (samples_.empty()) { return; }
+    // Visit the transcript sequences in order
+    std::sort(samples_.begin(), samples_.end(),
+              [](const ReadBiasSample& a, const ReadBiasSample& b) -> bool {
+                return (a.tid == b.tid) ? (a.windowStart < b.windowStart)
+                                        : (a.tid < b.tid);
+              });
+    for (auto& s : samples_) {
+      mer_.from_chars(transcripts[s.tid].Sequence() + s.windowStart);
+      if (s.rc) {
+        mer_.reverse_complement();
+        readBiasRC.addSequence(mer_, 1.0);
+      } else {
+        readBiasFW.addSequence(mer_, 1.0);
+      }
+    }
+    samples_.clear();
+  }
+
+  // Flush only if the buffer has reached its capacity.
+  inline void flushIfFull(std::vector<Transcript>& transcripts,
+                          SBModel& readBiasFW, SBModel& readBiasRC) {
+    if (full()) { flush(transcripts, readBiasFW, readBiasRC); }
+  }
+
+private:
+  size_t capacity_;
+  std::vector<ReadBiasSample> samples_;
+  Mer mer_;
+};
+
+#endif // __READ_BIAS_SAMPLE_BUFFER_HPP__
@@ -26,6 +26,7 @@ extern "C" {
 #include "ReadKmerDist.hpp"
 #include "SBModel.hpp"
 #include "SimplePosBias.hpp"
+#include "TranscriptSequenceArena.hpp"
 
 // Logger includes
 #include "spdlog/spdlog.h"
@@ -58,9 +59,21 @@ class ReadExperiment {
                    //const boost::filesystem::path& transcriptFile,
                    const boost::filesystem::path& indexDirectory,
 		           SalmonOpts& sopt) :
+        ReadExperiment(readLibraries, loadIndex(readLibraries, indexDirectory, sopt), sopt) {}
+
+    /**
+     * Construct an experiment over an index that has already been loaded
+     * (e.g. by a previous sample in a `--samples` batch).  The index is
+     * shared; all of the per-experiment state (transcripts, models and
+     * counts) is fresh.
+     */
+    ReadExperiment(std::vector<ReadLibrary>& readLibraries,
+                   std::shared_ptr<SalmonIndex> salmonIndex,
+		           SalmonOpts& sopt) :
         readLibraries_(readLibraries),
         //transcriptFile_(transcriptFile),
         transcripts_(std::vector<Transcript>()),
+        salmonIndex_(salmonIndex),
         totalAssignedFragments_(0),
         fragStartDists_(5),
         posBiasFW_(5),
@@ -120,34 +133,6 @@ class ReadExperiment {
             }
 
 
-            // Make sure the transcript file exists.
-            /*
-            if (!bfs::exists(transcriptFile_)) {
-                std::stringstream ss;
-                ss << "The provided transcript file: " << transcriptFile_ <<
-                    " does not exist!\n";
-                throw std::invalid_argument(ss.str());
-            }
-            */
-
-            // ==== Figure out the index type
-            boost::filesystem::path versionPath = indexDirectory / "versionInfo.json";
-            SalmonIndexVersionInfo versionInfo;
-            versionInfo.load(versionPath);
-            if (versionInfo.indexVersion() == 0) {
-                fmt::MemoryWriter infostr;
-                infostr << "Error: The index version file " << versionPath.string()
-                    << " doesn't seem to exist.  Please try re-building the salmon "
-                    "index.";
-                throw std::invalid_argument(infostr.str());
-            }
-            // Check index version compatibility here
-            auto indexType = versionInfo.indexType();
-            // ==== Figure out the index type
-
-            salmonIndex_.reset(new SalmonIndex(sopt.jointLog, indexType));
-            salmonIndex_->load(indexDirectory);
-
 	    // Now we'll have either an FMD-based index or a QUASI index
 	    // dispatch on the correct type.
 
@@ -177,6 +162,38 @@ class ReadExperiment {
             clusters_.reset(new ClusterForest(transcripts_.size(), transcripts_));
         }
 
+    /**
+     * Load the index in `indexDirectory` so that it can be handed to one
+     * or more ReadExperiments.  The read libraries are validated first so
+     * that a bad read file is reported before we spend time on the index.
+     */
+    static std::shared_ptr<SalmonIndex> loadIndex(
+            std::vector<ReadLibrary>& readLibraries,
+            const boost::filesystem::path& indexDirectory,
+            SalmonOpts& sopt) {
+            // Make sure the read libraries are valid.
+            for (auto& rl : readLibraries) { rl.checkValid(); }
+
+            // ==== Figure out the index type
+            boost::filesystem::path versionPath = indexDirectory / "versionInfo.json";
+            SalmonIndexVersionInfo versionInfo;
+            versionInfo.load(versionPath);
+            if (versionInfo.indexVersion() == 0) {
+                fmt::MemoryWriter infostr;
+                infostr << "Error: The index version file " << versionPath.string()
+                    << " doesn't seem to exist.  Please try re-building the salmon "
+                    "index.";
+                throw std::invalid_argument(infostr.str());
+            }
+            // Check index version compatibility here
+            auto indexType = versionInfo.indexType();
+            // ==== Figure out the index type
+
+            std::shared_ptr<SalmonIndex> salmonIndex(new SalmonIndex(sopt.jointLog, indexType));
+            salmonIndex->load(indexDirectory);
+            return salmonIndex;
+    }
+
     EquivalenceClassBuilder& equivalenceClassBuilder() {
         return eqBuilder_;
     }
@@ -187,6 +204,8 @@ class ReadExperiment {
     std::vector<Transcript>& transcripts() { return transcripts_; }
     const std::vector<Transcript>& transcripts() const { return transcripts_; }
 
+    TranscriptSequenceArena& transcriptSequences() { return transcriptSeqs_; }
+
         const std::vector<double>& condMeans() const { return conditionalMeans_; }
 
     void updateTranscriptLengthsAtomic(std::atomic<bool>& done) {
@@ -266,6 +285,7 @@ class ReadExperiment {
     }
 
     SalmonIndex* getIndex() { return salmonIndex_.get(); }
+    std::shared_ptr<SalmonIndex> sharedIndex() { return salmonIndex_; }
 
 
     template <typename QuasiIndexT>
@@ -274,47 +294,32 @@ class ReadExperiment {
         auto log = sopt.jointLog.get();
 
 	    log->info("Index contained {} targets", numRecords);
-	    //transcripts_.resize(numRecords);
 	    std::vector<uint32_t> lengths;
 	    lengths.reserve(numRecords);
 	    double alpha = 0.005;
+	    transcripts_.reserve(numRecords);
 	    for (auto i : boost::irange(size_t(0), numRecords)) {
 		    uint32_t id = i;
 		    const char* name = idx_->txpNames[i].c_str();
 		    uint32_t len = idx_->txpLens[i];
 		    // copy over the length, then we're done.
 		    transcripts_.emplace_back(id, name, len, alpha);
-		    auto& txp = transcripts_.back();
-        txp.setCompleteLength(idx_->txpCompleteLens[i]);
-		    // The transcript sequence
-		    //auto txpSeq = idx_->seq.substr(idx_->txpOffsets[i], len);
-
-		    // Set the transcript sequence
-		    txp.setSequenceBorrowed(idx_->seq.c_str() + idx_->txpOffsets[i],
-                                    sopt.gcBiasCorrect, sopt.reduceGCMemory);
-		    lengths.push_back(txp.RefLength);
-		    /*
-		    // Length classes taken from
-		    // https://github.com/cole-trapnell-lab/cufflinks/blob/master/src/biascorrection.cpp
-		    // ======
-		    // Roberts, Adam, et al.
-		    // "Improving RNA-Seq expression estimates by correcting for fragment bias."
-		    // Genome Biol 12.3 (2011): R22.
-		    // ======
-		    // perhaps, define these in a more data-driven way
-		    if (txp.RefLength <= 791) {
-			txp.lengthClassIndex(0);
-		    } else if (txp.RefLength <= 1265) {
-			txp.lengthClassIndex(1);
-		    } else if (txp.RefLength <= 1707) {
-			txp.lengthClassIndex(2);
-		    } else if (txp.RefLength <= 2433) {
-			txp.lengthClassIndex(3);
-		    } else {
-			txp.lengthClassIndex(4);
-		    }
-		    */
-      }
+		    transcripts_.back().setCompleteLength(idx_->txpCompleteLens[i]);
+		    lengths.push_back(len);
+	    }
+
+	    // The transcript sequences are borrowed straight from the index's
+	    // concatenated text; only their GC indices need to be built (which we
+	    // do in parallel).
+	    transcriptSeqs_.borrow(idx_->seq.c_str(), idx_->txpOffsets, lengths);
+	    tbb::parallel_for(
+		    tbb::blocked_range<size_t>(0, numRecords),
+		    [&](const tbb::blocked_range<size_t>& r) {
+			    for (size_t i = r.begin(); i != r.end(); ++i) {
+				    transcripts_[i].setSequenceBorrowed(transcriptSeqs_.sequence(i),
+                                                        sopt.gcBiasCorrect, sopt.reduceGCMemory);
+			    }
+		    });
 	    // ====== Done loading the transcripts from file
 	    setTranscriptLengthClasses_(lengths, posBiasFW_.size());
     }
@@ -322,95 +327,63 @@ class ReadExperiment {
     void loadTranscriptsFromFMD() {
 	    bwaidx_t* idx_ = salmonIndex_->bwaIndex();
 	    size_t numRecords = idx_->bns->n_seqs;
-	    std::vector<Transcript> transcripts_tmp;
         auto log = spdlog::get("jointLog");
-        //transcripts_tmp.reserve(numRecords);
-        //transcripts_.reserve(numRecords);
 
 	    log->info("Index contained {} targets", numRecords);
-	    //transcripts_.resize(numRecords);
+	    double alpha = 0.005;
+	    std::vector<uint32_t> lengths;
+	    lengths.reserve(numRecords);
+	    transcripts_.reserve(numRecords);
 	    for (auto i : boost::irange(size_t(0), numRecords)) {
 		    uint32_t id = i;
 		    char* name = idx_->bns->anns[i].name;
 		    uint32_t len = idx_->bns->anns[i].len;
-		    // copy over the length, then we're done.
-		    transcripts_tmp.emplace_back(id, name, len);
+		    transcripts_.emplace_back(id, name, len, alpha);
+		    lengths.push_back(len);
 	    }
 
-	    std::sort(transcripts_tmp.begin(), transcripts_tmp.end(),
-			    [](const Transcript& t1, const Transcript& t2) -> bool {
-			    return t1.id < t2.id;
-			    });
-
-
-	    double alpha = 0.005;
 	    char nucTab[256];
 	    nucTab[0] = 'A'; nucTab[1] = 'C'; nucTab[2] = 'G'; nucTab[3] = 'T';
 	    for (size_t i = 4; i < 256; ++i) { nucTab[i] = 'N'; }
 
-	    std::vector<uint32_t> lengths;
-	    lengths.reserve(transcripts_tmp.size());
-        size_t tnum = 0;
-	    // Load the transcript sequence from file
-	    for (auto& t : transcripts_tmp) {
-		    transcripts_.emplace_back(t.id, t.RefName.c_str(), t.RefLength, alpha);
-		    /* from BWA */
-		    uint8_t* rseq = nullptr;
-		    int64_t tstart, tend, compLen, l_pac = idx_->bns->l_pac;
-		    tstart  = idx_->bns->anns[t.id].offset;
-		    tend = tstart + t.RefLength;
-		    rseq = bns_get_seq(l_pac, idx_->pac, tstart, tend, &compLen);
-		    if (compLen != t.RefLength) {
-			    fmt::print(stderr,
-					    "For transcript {}, stored length ({}) != computed length ({}) --- index may be corrupt. exiting\n",
-					    t.RefName, compLen, t.RefLength);
-			    std::exit(1);
-		    }
-		    std::string seq(t.RefLength, ' ');
-		    if (rseq != 0) {
-			    for (int64_t i = 0; i < compLen; ++i) { seq[i] = nucTab[rseq[i]]; }
-		    }
-
-            auto& txp = transcripts_.back();
-
-            // allocate space for the new copy
-            char* seqCopy = new char[seq.length()+1];
-            std::strcpy(seqCopy, seq.c_str());
-            txp.setSequenceOwned(seqCopy);
-		    txp.setSAMSequenceOwned(salmon::stringtools::encodeSequenceInSAM(seq.c_str(), t.RefLength));
-	    lengths.push_back(t.RefLength);
-		    /*
-            // Length classes taken from
-            // https://github.com/cole-trapnell-lab/cufflinks/blob/master/src/biascorrection.cpp
-		    // ======
-		    // Roberts, Adam, et al.
-		    // "Improving RNA-Seq expression estimates by correcting for fragment bias."
-		    // Genome Biol 12.3 (2011): R22.
-		    // ======
-		    // perhaps, define these in a more data-driven way
-            if (txp.RefLength <= 791) {
-                txp.lengthClassIndex(0);
-            } else if (txp.RefLength <= 1265) {
-                txp.lengthClassIndex(1);
-            } else if (txp.RefLength <= 1707) {
-                txp.lengthClassIndex(2);
-            } else if (txp.RefLength <= 2433) {
-                txp.lengthClassIndex(3);
-            } else {
-                txp.lengthClassIndex(4);
-            }
-	    */
-		    free(rseq);
-		    /* end BWA code */
-            ++tnum;
-	    }
+	    // Decode the transcript sequences from the (2-bit packed) index
+	    // straight into the arena, along with their SAM encodings.
+	    transcriptSeqs_.allocate(lengths, true);
+	    std::atomic<bool> corrupt{false};
+	    tbb::parallel_for(
+		    tbb::blocked_range<size_t>(0, numRecords),
+		    [&](const tbb::blocked_range<size_t>& r) {
+			    for (size_t i = r.begin(); i != r.end(); ++i) {
+				    auto& txp = transcripts_[i];
+				    /* from BWA */
+				    int64_t tstart, tend, compLen, l_pac = idx_->bns->l_pac;
+				    tstart  = idx_->bns->anns[i].offset;
+				    tend = tstart + txp.RefLength;
+				    uint8_t* rseq = bns_get_seq(l_pac, idx_->pac, tstart, tend, &compLen);
+				    if (compLen != txp.RefLength) {
+					    fmt::print(stderr,
+							    "For transcript {}, stored length ({}) != computed length ({}) --- index may be corrupt. exiting\n",
+							    txp.RefName, compLen, txp.RefLength);
+					    corrupt = true;
+					    free(rseq);
+					    continue;
+				    }
+				    char* seq = transcriptSeqs_.writableSequence(i);
+				    for (int64_t j = 0; j < compLen; ++j) {
+					    seq[j] = (rseq != nullptr) ? nucTab[rseq[j]] : ' ';
+				    }
+				    seq[compLen] = '\0';
+				    free(rseq);
+				    /* end BWA code */
+
+				    salmon::stringtools::encodeSequenceInSAM(seq, txp.RefLength,
+                                                             transcriptSeqs_.samSequence(i));
+				    txp.setSequenceBorrowed(seq);
+				    txp.setSAMSequenceBorrowed(transcriptSeqs_.samSequence(i));
+			    }
+		    });
+	    if (corrupt) { std::exit(1); }
 
-	    // Since we have the de-coded reference sequences, we no longer need
-	    // the encoded sequences, so free them.
-	    /** TEST OPT **/
-	    // free(idx_->pac); idx_->pac = nullptr;
-	    /** END TEST OPT **/
-	    transcripts_tmp.clear();
 	    // ====== Done loading the transcripts from file
 	    setTranscriptLengthClasses_(lengths, posBiasFW_.size());
     }
@@ -763,6 +736,11 @@ class ReadExperiment {
      * This is expected to be a FASTA format file.
      */
     //boost::filesystem::path transcriptFile_;
+    /**
+     * The sequences of the transcripts, which borrow them from here (so this
+     * must be declared before, and outlive, transcripts_).
+     */
+    TranscriptSequenceArena transcriptSeqs_;
     /**
      * The targets (transcripts) to be quantified.
      */
@@ -770,7 +748,7 @@ class ReadExperiment {
     /**
      * The index we've built on the set of transcripts.
      */
-    std::unique_ptr<SalmonIndex> salmonIndex_{nullptr};
+    std::shared_ptr<SalmonIndex> salmonIndex_{nullptr};
     //bwaidx_t *idx_{nullptr};
     /**
      * The cluster forest maintains the dynamic relationship
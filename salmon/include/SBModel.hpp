@@ -32,6 +32,19 @@ public:
   
     double evaluateLog(const char* seqIn); 
     double evaluateLog(const Mer& mer);
+
+    /**
+     * The log-probability of the context whose packed (2-bit per base)
+     * encoding is `ctx`; i.e. of the context held in `mer` when
+     * `ctx == packedContext(mer)`.  This is a single lookup into the table
+     * compiled when the model is normalized, so it's only valid afterward.
+     */
+    inline double evaluateLogPacked(uint64_t ctx) const { return _logTable[ctx]; }
+    inline uint64_t packedContext(const Mer& mer) const {
+      return mer.get_bits(0, 2 * _contextLength);
+    }
+    // The number of distinct (packed) contexts
+    inline size_t numContexts() const { return _logTable.size(); }
  
   bool normalize();
 
@@ -47,9 +60,10 @@ public:
   bool train(CountVecT& kmerCounts, const uint32_t K);
   
   inline double evaluate(uint32_t kmer, uint32_t K) {
-    std::vector<uint32_t> _order{0, 0, 2,2,2,2};
+    static constexpr uint32_t _order[] = {0, 0, 2, 2, 2, 2};
+    static constexpr int32_t _maxOrder = 2;
     double p{1.0};
-    for (int32_t pos = 0; pos < K - _order.back(); ++pos) {
+    for (int32_t pos = 0; pos < static_cast<int32_t>(K) - _maxOrder; ++pos) {
       uint32_t offset = 2 * (K - (pos + 1) - _order[pos]);
       auto idx = _getIndex(kmer, offset, _order[pos]);
       p *= _probs(idx, pos);
@@ -58,6 +72,8 @@ public:
   }
 
 private:
+  void _compileLogTable();
+
   inline uint32_t _getIndex(uint32_t kmer, uint32_t offset, uint32_t _order) {
     kmer >>= offset;
     switch (_order) {
@@ -80,6 +96,8 @@ private:
 
   Eigen::MatrixXd _probs;
   Eigen::MatrixXd _marginals;
+  // The log-probability of every full context (once normalized)
+  std::vector<double> _logTable;
 
   Mer _mer;
   std::vector<int32_t> _order;
@@ -8,7 +8,11 @@ extern "C" {
 #include "utils.h"
 }
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
 
 #include <boost/filesystem.hpp>
 #include <boost/range/irange.hpp>
@@ -17,6 +21,12 @@ extern "C" {
 #include "cereal/archives/json.hpp"
 #include "cereal/types/vector.hpp"
 
+#include "tbb/blocked_range.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+#include "tbb/task_scheduler_init.h"
+
 #include "BooMap.hpp"
 #include "FrugalBooMap.hpp"
 #include "RapMapSAIndex.hpp"
@@ -25,6 +35,8 @@ extern "C" {
 #include "SalmonConfig.hpp"
 #include "SalmonIndexVersionInfo.hpp"
 #include "KmerIntervalMap.hpp"
+#include "IndexReadahead.hpp"
+#include "ParallelBWT.hpp"
 
 extern "C" {
 int bwa_index(int argc, char* argv[]);
@@ -48,6 +60,12 @@ class SalmonIndex{
                 if (idx_) { bwa_idx_destroy(idx_); }
             }
 
+            const IndexLoadStats& loadStats() const { return loadStats_; }
+
+            // Log to `logger` from now on (e.g. when the index is shared by
+            // several samples, each with its own log)
+            void setLogger(std::shared_ptr<spdlog::logger>& logger) { logger_ = logger; }
+
             void load(const boost::filesystem::path& indexDir) {
                 namespace bfs = boost::filesystem;
 
@@ -74,8 +92,10 @@ class SalmonIndex{
                 loaded_ = true;
             }
 
-            bool buildAux_(boost::filesystem::path indexDir, uint32_t k) {
+            bool buildAux_(boost::filesystem::path indexDir, uint32_t k, uint32_t numThreads) {
                        namespace bfs = boost::filesystem;
+                       using BlockedRange = tbb::blocked_range<size_t>;
+                       using Clock = std::chrono::steady_clock;
 
                        bfs::path indexPath = indexDir / "bwaidx";
                        // Load the bwa index
@@ -88,47 +108,128 @@ class SalmonIndex{
                            }
                        }
 
-                       auxIdx_.setK(k);
+                       tbb::task_scheduler_init tbbScheduler(numThreads);
                        size_t numRecords = idx_->bns->n_seqs;
-                       { // Load transcripts from file
+                       auto start = Clock::now();
+                       // The distinct k-mers of the reference, 2 bits per base
+                       // (the last base in the lowest bits)
+                       std::vector<uint64_t> kmers;
+                       { // Stream through the transcripts, in parallel
                           logger_->info("Index contained {} targets; streaming through them", numRecords);
-                          for (auto i : boost::irange(size_t(0), numRecords)) {
-                              char* name = idx_->bns->anns[i].name;
-                              uint32_t len = idx_->bns->anns[i].len;
-                              uint8_t* rseq = nullptr;
-                              int64_t tstart, tend, compLen, l_pac = idx_->bns->l_pac;
-                              tstart  = idx_->bns->anns[i].offset;
-                              tend = tstart + len;
-                              rseq = bns_get_seq(l_pac, idx_->pac, tstart, tend, &compLen);
-                              if (compLen != len) {
-                                  logger_->error(
-                                          "For transcript {}, stored length ({}) != computed length ({}) --- index may be corrupt. exiting\n",
-                                          name, compLen, len);
-                                  std::exit(1);
-                              }
-                              if (len < k) { continue; }
-                              for (uint32_t s = 0; s < len - k + 1; ++s) {
-                                  bwtintv_t resInterval;
-                                  KmerKey key(&(rseq[s]), k);
-                                  if (!auxIdx_.hasKmer(key)) {
-                                      bool foundInterval = bwautils::getIntervalForKmer(idx_->bwt, k, &(rseq[s]), resInterval);
-                                      // If we found the interval for this k-mer
-                                      if (foundInterval) {
-                                          // If the interval for this k-mer isn't already in the hash
-                                          // then put it in the hash
-                                          auxIdx_[key] = resInterval;
+                          uint64_t kmerMask = (k >= 32) ? ~uint64_t(0) : ((uint64_t(1) << (2 * k)) - 1);
+                          std::atomic<bool> corrupt{false};
+                          tbb::enumerable_thread_specific<std::vector<uint64_t>> localKmers;
+                          tbb::parallel_for(
+                              BlockedRange(size_t(0), numRecords),
+                              [&](const BlockedRange& range) {
+                                  auto& out = localKmers.local();
+                                  size_t chunkStart = out.size();
+                                  for (auto i : boost::irange(range.begin(), range.end())) {
+                                      char* name = idx_->bns->anns[i].name;
+                                      uint32_t len = idx_->bns->anns[i].len;
+                                      uint8_t* rseq = nullptr;
+                                      int64_t tstart, tend, compLen, l_pac = idx_->bns->l_pac;
+                                      tstart  = idx_->bns->anns[i].offset;
+                                      tend = tstart + len;
+                                      rseq = bns_get_seq(l_pac, idx_->pac, tstart, tend, &compLen);
+                                      if (compLen != len) {
+                                          logger_->error(
+                                                  "For transcript {}, stored length ({}) != computed length ({}) --- index may be corrupt. exiting\n",
+                                                  name, compLen, len);
+                                          corrupt = true;
+                                      } else if (len >= k) {
+                                          uint64_t kmer{0};
+                                          for (uint32_t s = 0; s < len; ++s) {
+                                              kmer = ((kmer << 2) | (rseq[s] & 0x3)) & kmerMask;
+                                              if (s + 1 >= k) { out.push_back(kmer); }
+                                          }
                                       }
+                                      free(rseq);
                                   }
-                              }
+                                  // Drop the repeats within this chunk right away
+                                  std::sort(out.begin() + chunkStart, out.end());
+                                  out.erase(std::unique(out.begin() + chunkStart, out.end()), out.end());
+                              });
+                          if (corrupt) { std::exit(1); }
+                          size_t total{0};
+                          for (auto& l : localKmers) { total += l.size(); }
+                          kmers.reserve(total);
+                          for (auto& l : localKmers) {
+                              kmers.insert(kmers.end(), l.begin(), l.end());
+                              std::vector<uint64_t>().swap(l);
                           }
+                          tbb::parallel_sort(kmers.begin(), kmers.end());
+                          kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
                           // Since we have the de-coded reference sequences, we no longer need
                           // the encoded sequences, so free them.
                           free(idx_->pac); idx_->pac = nullptr;
                           // ====== Done streaming through transcripts
+                          logger_->info("Found {} distinct {}-mers in {:.2f} s", kmers.size(), k,
+                                        std::chrono::duration<double>(Clock::now() - start).count());
+                       }
+
+                       // Search for the interval of each distinct k-mer, in parallel
+                       auto searchStart = Clock::now();
+                       std::atomic<size_t> numSearched{0};
+                       size_t stepSize = std::max(size_t(1), kmers.size() / 10);
+                       // (read outside of updateMutex, so atomic)
+                       std::atomic<size_t> nextUpdate{stepSize};
+                       std::mutex updateMutex;
+                       tbb::enumerable_thread_specific<std::vector<std::pair<uint64_t, bwtintv_t>>> localIntervals;
+                       tbb::parallel_for(
+                           BlockedRange(size_t(0), kmers.size()),
+                           [&](const BlockedRange& range) {
+                               auto& out = localIntervals.local();
+                               std::vector<uint8_t> seq(k);
+                               for (auto i : boost::irange(range.begin(), range.end())) {
+                                   uint64_t kmer = kmers[i];
+                                   for (int32_t s = k - 1; s >= 0; --s, kmer >>= 2) {
+                                       seq[s] = kmer & 0x3;
+                                   }
+                                   bwtintv_t resInterval;
+                                   // If we found the interval for this k-mer
+                                   if (bwautils::getIntervalForKmer(idx_->bwt, k, seq.data(), resInterval)) {
+                                       out.emplace_back(kmers[i], resInterval);
+                                   }
+                               }
+                               size_t searched = numSearched += range.size();
+                               if (searched >= nextUpdate.load(std::memory_order_relaxed) and updateMutex.try_lock()) {
+                                   if (searched >= nextUpdate) {
+                                       double secs = std::chrono::duration<double>(Clock::now() - searchStart).count();
+                                       logger_->info("Searched {} / {} k-mers ({:.2f} M k-mers / s)",
+                                                     searched, kmers.size(), (searched / 1e6) / secs);
+                                       nextUpdate += stepSize;
+                                   }
+                                   updateMutex.unlock();
+                               }
+                           });
+
+                       // Put them all in the map
+                       std::vector<std::pair<uint64_t, bwtintv_t>> intervals;
+                       {
+                           size_t total{0};
+                           for (auto& l : localIntervals) { total += l.size(); }
+                           intervals.reserve(total);
+                           for (auto& l : localIntervals) {
+                               intervals.insert(intervals.end(), l.begin(), l.end());
+                               std::vector<std::pair<uint64_t, bwtintv_t>>().swap(l);
+                           }
                        }
+                       size_t numFound = intervals.size();
+                       auxIdx_.build(k, intervals);
+                       double secs = std::chrono::duration<double>(Clock::now() - searchStart).count();
+                       logger_->info("Found the intervals of {} k-mers in {:.2f} s ({:.2f} M k-mers / s)",
+                                     numFound, secs, (kmers.size() / 1e6) / std::max(secs, 1e-9));
+
+                       logger_->info("Auxiliary index takes {:.2f} MB ({:.2f} bytes / k-mer)",
+                                     auxIdx_.sizeInBytes() / (1024.0 * 1024.0),
+                                     auxIdx_.sizeInBytes() / std::max(1.0, static_cast<double>(numFound)));
 
                        bfs::path auxIndexFile = indexDir / "aux.idx";
-                       auxIdx_.save(auxIndexFile);
+                       if (!auxIdx_.save(auxIndexFile)) {
+                           logger_->error("Couldn't write the auxiliary index to {}", auxIndexFile);
+                           return false;
+                       }
                        return true;
             }
 
@@ -161,7 +262,7 @@ class SalmonIndex{
             RapMapSAIndex<int64_t, PerfectHash<int64_t>>* quasiIndexPerfectHash64() { return quasiIndexPerfectHash64_.get(); }
 
             bool hasAuxKmerIndex() { return versionInfo_.hasAuxKmerIndex(); }
-            KmerIntervalMap& auxIndex() { return auxIdx_; }
+            const KmerIntervalMap& auxIndex() const { return auxIdx_; }
 
             SalmonIndexType indexType() { return versionInfo_.indexType(); }
 
@@ -197,19 +298,30 @@ class SalmonIndex{
                                 std::vector<std::string>& bwaArgVec,
                                 uint32_t k) {
                 namespace bfs = boost::filesystem;
-                char* bwaArgv[] = {
-                    const_cast<char*>(bwaArgVec[0].c_str()),
-                    const_cast<char*>(bwaArgVec[1].c_str()),
-                    const_cast<char*>(bwaArgVec[2].c_str()),
-                    const_cast<char*>(bwaArgVec[3].c_str()),
-                    const_cast<char*>(bwaArgVec[4].c_str()),
-                    const_cast<char*>(bwaArgVec[5].c_str()) };
-                int bwaArgc = 6;
-                int ret = bwa_index(bwaArgc, bwaArgv);
+                // The arguments are those of `bwa index` (-s, -p and the
+                // FASTA file), plus the number of threads (-t).
+                int saInterval{32};
+                uint32_t numThreads{1};
+                std::string prefix;
+                std::string fastaFile;
+                for (size_t i = 1; i < bwaArgVec.size(); ++i) {
+                    auto& arg = bwaArgVec[i];
+                    if (arg == "-s" and i + 1 < bwaArgVec.size()) {
+                        saInterval = std::stoi(bwaArgVec[++i]);
+                    } else if (arg == "-p" and i + 1 < bwaArgVec.size()) {
+                        prefix = bwaArgVec[++i];
+                    } else if (arg == "-t" and i + 1 < bwaArgVec.size()) {
+                        numThreads = std::stoul(bwaArgVec[++i]);
+                    } else {
+                        fastaFile = arg;
+                    }
+                }
+                int ret = salmon::fmd::buildIndex(fastaFile, prefix, saInterval,
+                                                  numThreads, logger_);
 
                 bool buildAux = (k > 0);
                 if (buildAux) {
-                    buildAux_(indexDir, k);
+                    buildAux_(indexDir, k, numThreads);
                 }
 
                 bfs::path versionFile = indexDir / "versionInfo.json";
@@ -256,8 +368,12 @@ class SalmonIndex{
                   // Read the aux index
                   logger_->info("Loading auxiliary index");
                   bfs::path auxIdxFile = indexDir / "aux.idx";
-                  auxIdx_.setK(versionInfo_.auxKmerLength());
-                  auxIdx_.load(auxIdxFile);
+                  if (!auxIdx_.load(auxIdxFile) or auxIdx_.k() != versionInfo_.auxKmerLength()) {
+                      logger_->error("Couldn't load the auxiliary index from {} (it may have been "
+                                     "written by an older version of salmon); please re-build the index",
+                                     auxIdxFile);
+                      std::exit(1);
+                  }
                   logger_->info("Auxiliary index contained {} k-mers", auxIdx_.size());
                   logger_->info("done");
               }
@@ -279,6 +395,15 @@ class SalmonIndex{
 
           bool loadQuasiIndex_(const boost::filesystem::path& indexDir) {
               namespace bfs = boost::filesystem;
+              loadStats_.maxRSSBeforeKB = IndexLoadStats::currentMaxRSSKB();
+
+              // Ask for the pages of the index files ahead of time, so that
+              // reading them from disk overlaps the deserialization below.
+              // The mappings only need to live until the index is loaded.
+              IndexReadahead readahead;
+              readahead.start(indexDir, loadStats_);
+
+              auto loadStart = std::chrono::steady_clock::now();
               logger_->info("Loading Quasi index");
               // Read the actual Quasi index
               { // quasi-based
@@ -349,7 +474,12 @@ class SalmonIndex{
                     }
                   }
               }
+              auto loadStop = std::chrono::steady_clock::now();
+              loadStats_.loadSeconds =
+                  std::chrono::duration<double>(loadStop - loadStart).count();
+              loadStats_.maxRSSAfterKB = IndexLoadStats::currentMaxRSSKB();
               logger_->info("done");
+              loadStats_.log(logger_);
               return true;
           }
 
@@ -372,6 +502,7 @@ class SalmonIndex{
           std::shared_ptr<spdlog::logger> logger_;
 	  std::string seqHash_;
 	  std::string nameHash_;
+          IndexLoadStats loadStats_;
 };
 
 #endif //__SALMON_INDEX_HPP
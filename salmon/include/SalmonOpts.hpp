@@ -10,6 +10,7 @@
 #include <ostream>
 #include <memory> // for shared_ptr
 
+class MappingCacheWriter;
 
 enum class SalmonQuantMode { MAP = 1, ALIGN = 2 };
 
@@ -54,6 +55,8 @@ struct SalmonOpts {
 
     bool dumpEqWeights; 	     // Dump the equivalence classes rich weights 
 
+    std::string dumpEqFormat; // The format ("text" or "binary") in which to dump the equivalence classes
+
     bool fasterMapping; // [Developer]: Disables some extra checks during quasi-mapping. This may make mapping a 
                         // little bit faster at the potential cost of returning too many mappings (i.e. some sub-optimal mappings) 
                         // for certain reads. Only use this option if you know what it does (enables NIP-skipping)
@@ -123,7 +126,7 @@ struct SalmonOpts {
 
     uint64_t numRequiredFragments; //
   uint64_t minRequiredFrags;
-    bool reduceGCMemory;  // Use a memory-efficient (rank-based) data structure for computing fragment GC content
+    bool reduceGCMemory;  // Use a sparser (more memory-efficient) GC index for computing fragment GC content
   //uint32_t gcSampFactor; // The factor by which to down-sample the GC distribution of transcripts
     uint32_t pdfSampFactor; // The factor by which to down-sample the fragment length pmf when
                             // evaluating gc-bias for effective length correction.
@@ -136,6 +139,12 @@ struct SalmonOpts {
     bool extraSeedPass; // Perform extra pass trying to find seeds to cover the read
 
     bool disableMappingCache; // Don't write mapping results to temporary mapping cache file
+
+    bool writeMappingCache{false}; // Write the quasi-mappings to a binary cache that later runs can replay
+
+    std::string fromCache; // Replay the mappings from this cache file rather than mapping the reads
+
+    std::shared_ptr<MappingCacheWriter> mappingCacheWriter{nullptr}; // Writer for the mapping cache (if enabled)
     
     bool meta; // Set other options to be optimized for metagenomic data
 
@@ -190,6 +199,9 @@ struct SalmonOpts {
     bool posBiasCorrect{false}; // Perform positional bias correction
     size_t numConditionalGCBins{3};
     size_t numFragGCBins{20};
+    uint32_t numBiasRounds{1}; // The number of rounds of bias (and effective length) re-estimation in the EM
+    double biasUpdateThreshold{0.05}; // In later rounds, only update the expected bias contributions of
+                                      // transcripts whose weight changed by more than this (relative) amount
     std::atomic<int32_t> numBiasSamples{1000000}; // The number of fragment mappings to consider when building
 						  // the sequence-specific "foreground" distribution.
 
@@ -60,6 +60,8 @@ namespace salmon {
             */
 
         uint8_t* encodeSequenceInSAM(const char* src, size_t len);
+        // Encode into target, which must hold (len + 1) / 2 zeroed bytes
+        void encodeSequenceInSAM(const char* src, size_t len, uint8_t* target);
 
         /**
            Incomplete: currently only rev for 'ATCG'
@@ -34,6 +34,7 @@ extern "C" {
 #include "RapMapUtils.hpp"
 
 class ReadExperiment;
+class ExpectedBiasState;
 class LibraryFormat;
 class FragmentLengthDistribution;
 
@@ -118,10 +119,16 @@ Eigen::VectorXd updateEffectiveLengths(
 	bool finalRound = false);
 */
 
+/**
+ * If `biasState` is non-null, the expected bias distributions are
+ * accumulated there; if an earlier call already filled it in, they are
+ * updated incrementally (see ExpectedBiasState).
+ */
 template <typename AbundanceVecT, typename ReadExpT>
 Eigen::VectorXd updateEffectiveLengths(SalmonOpts& sopt, ReadExpT& readExp,
                                                       Eigen::VectorXd& effLensIn,
-                                       AbundanceVecT& alphas, std::vector<bool>& available, bool finalRound=false);
+                                       AbundanceVecT& alphas, std::vector<bool>& available, bool finalRound=false,
+                                       ExpectedBiasState* biasState=nullptr);
 
 
 /*
@@ -197,9 +204,26 @@ bool writeCmdInfo(SalmonOpts& sopt, OrderedOptionsT& orderedOptions) {
 
 void aggregateEstimatesToGeneLevel(TranscriptGeneMap& tgm, boost::filesystem::path& inputPath);
 
-// NOTE: Throws an invalid_argument exception of the quant or quant_bias_corrected files do
-// not exist!
-void generateGeneLevelEstimates(boost::filesystem::path& geneMapPath,
+/**
+ * Aggregate the final (transcript-level) estimates of `experiment` to the
+ * gene level, and write them to `outputPath`.  Each transcript is mapped to
+ * its gene once, and the estimates are summed by gene id.
+ **/
+template <typename ExpT>
+void aggregateEstimatesToGeneLevel(TranscriptGeneMap& tgm, ExpT& experiment,
+                                   boost::filesystem::path& outputPath);
+
+/**
+ * Load the transcript <-> gene map in sopt.geneMapPath (a GTF / GFF file, or a
+ * file of transcript / gene pairs).  The parsed map is cached (in binary) in
+ * the index directory, and this cache is used by later runs with the same
+ * annotation file.
+ **/
+TranscriptGeneMap loadTranscriptGeneMap(const SalmonOpts& sopt);
+
+// Write estDir/quant.genes.sf from the final estimates of `experiment`
+template <typename ExpT>
+void generateGeneLevelEstimates(const SalmonOpts& sopt, ExpT& experiment,
                                 boost::filesystem::path& estDir);
 
     enum class OrphanStatus: uint8_t { LeftOrphan = 0, RightOrphan = 1, Paired = 2 };
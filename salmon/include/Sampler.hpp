@@ -109,6 +109,7 @@ namespace salmon {
                 auto& clusterForest = alnLib.clusterForest();
                 auto& fragmentQueue = alnLib.fragmentQueue();
                 auto& alignmentGroupQueue = alnLib.alignmentGroupQueue();
+                auto& poolRefilled = alnLib.poolRefilled();
                 auto& fragLengthDist = *(alnLib.fragmentLengthDistribution());
                 auto& alnMod = alnLib.alignmentModel();
 
@@ -161,6 +162,10 @@ namespace salmon {
                             // for a single read).
                             for (auto alnGroup : alignmentGroups) {
                                 double sumOfAlignProbs{LOG_0};
+
+                                // A consistent view of the fragment length distribution for this read
+                                auto fldSnapshot = fragLengthDist.snapshot();
+
                                 // update the cluster-level properties
                                 bool transcriptUnique{true};
                                 auto firstTranscriptID = alnGroup->alignments().front()->transcriptID();
@@ -188,20 +193,14 @@ namespace salmon {
 
                                     if (flen > 0.0 and aln->isPaired() and useFragLengthDist and considerCondProb) {
                                       size_t fl = flen;
-                                      double lenProb = fragLengthDist.pmf(fl); 
+                                      double lenProb = fldSnapshot->pmf(fl); 
                                       if (burnedIn) {
                                         /* condition fragment length prob on txp length */
-                                        double refLengthCM = fragLengthDist.cmf(static_cast<size_t>(refLength)); 
+                                        double refLengthCM = fldSnapshot->cmf(static_cast<size_t>(refLength)); 
                                         bool computeMass = fl < refLength and !salmon::math::isLog0(refLengthCM);
                                         logFragProb = (computeMass) ?
                                                                 (lenProb - refLengthCM) :
                                           salmon::math::LOG_EPSILON;
-                                        if (computeMass and refLengthCM < lenProb) {
-                                          // Threading is hard!  It's possible that an update to the PMF snuck in between when we asked to cache the CMF and when the
-                                          // "burnedIn" variable was last seen as false.
-                                          log->info("reference length = {}, CMF[refLen] = {}, fragLen = {}, PMF[fragLen] = {}",
-                                                    refLength, std::exp(refLengthCM), aln->fragLen(), std::exp(lenProb));
-                                        }
                                       } else if (useAuxParams) {
                                         logFragProb = lenProb;
                                       }
@@ -315,7 +314,7 @@ namespace salmon {
                             } // end read group
                         }// end timer
 
-                        miniBatch->release(fragmentQueue, alignmentGroupQueue);
+                        miniBatch->release(fragmentQueue, alignmentGroupQueue, poolRefilled);
                         delete miniBatch;
                         --activeBatches;
                         processedReads += batchReads;
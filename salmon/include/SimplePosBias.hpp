@@ -2,6 +2,7 @@
 #define SIMPLE_POS_BIAS_HPP
 
 #include "spline.h"
+#include <algorithm>
 #include <array>
 #include <vector>
 #include "spdlog/spdlog.h"
@@ -18,9 +19,28 @@ public:
   // and add @mass to the appropriate bin
   void addMass(int32_t pos, int32_t length, double mass);
 
+  // Add a (linear-space) mass of @mass to bin @bin.  These masses are
+  // summed directly, and only folded into the (log-space) model when it
+  // is finalized; this is much cheaper than addMass for the many small
+  // updates made while mapping.
+  void addLinearMass(int32_t bin, double mass) { pending_[bin] += mass; }
+
+  // As above, for @pos on a transcript of length @length
+  void addLinearMass(int32_t pos, int32_t length, double mass) {
+    pending_[bin(pos, length)] += mass;
+  }
+
+  // The bin for @pos on a transcript of length @length
+  int32_t bin(int32_t pos, int32_t length) const;
+
+  int32_t numBins() const { return numBins_; }
+
+  // The (finalized) weight at fractional position @frac
+  double weight(double frac) const { return std::max(0.001, s_(frac)); }
+
   // Project, via linear interpolation, the weights contained in "bins"
   // into the vector @out.
-  void projectWeights(std::vector<double>& out);
+  void projectWeights(std::vector<double>& out) const;
 
   // Combine the distribution @other
   // with this distribution
@@ -30,12 +50,20 @@ public:
   // compute the cdf etc.
   void finalize();
 
+  // Discard all mass (and any finalization), returning this to an
+  // empty, log-space distribution.
+  void reset();
+
   // Seralize this model.
   bool writeBinary(boost::iostreams::filtering_ostream& out) const; 
 
 private:
+  // Fold the pending (linear-space) masses into masses_
+  void flushPending_();
+
   int32_t numBins_;
   std::vector<double> masses_;
+  std::vector<double> pending_;
   bool isLogged_{true};
   bool isFinalized_{false};
   tk::spline s_;
@@ -46,4 +74,24 @@ private:
                                            .9,  .92, .94, .96, .98, 1.0}};
 };
 
+/**
+ * The ratio of an observed to an expected (finalized) positional bias model,
+ * tabulated at numPoints + 1 evenly-spaced fractional positions.  Projecting
+ * the ratio onto a transcript then interpolates linearly in this table,
+ * rather than evaluating both splines at every position.
+ */
+class PosBiasRatio {
+public:
+  static constexpr uint32_t numPoints{4096};
+
+  PosBiasRatio(const SimplePosBias& obs, const SimplePosBias& exp);
+
+  // Fill out[p], for p in [0, len), with the ratio at fractional
+  // position p / len.
+  void project(int32_t len, double* out) const;
+
+private:
+  std::vector<double> table_;
+};
+
 #endif // SIMPLE_POS_BIAS_HPP
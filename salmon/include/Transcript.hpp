@@ -11,24 +11,12 @@
 #include "SalmonMath.hpp"
 #include "SequenceBiasModel.hpp"
 #include "FragmentLengthDistribution.hpp"
+#include "GCIndex.hpp"
 #include "tbb/atomic.h"
 
-#include "rapmap/bit_array.h"
-#include "rapmap/rank9b.h"
-
 class Transcript {
 public:
 
-  struct BitArrayDeleter {
-    void operator()(BIT_ARRAY* b) {
-      if(b != nullptr) {
-        bit_array_free(b);
-      }
-    }
-  };
-  using BitArrayPointer = std::unique_ptr<BIT_ARRAY, BitArrayDeleter>;
-  using Rank9bPointer = std::unique_ptr<rank9b>;
-
     Transcript() :
         RefName(nullptr), RefLength(std::numeric_limits<uint32_t>::max()),
         CompleteLength(std::numeric_limits<uint32_t>::max()),
@@ -72,12 +60,7 @@ public:
 
         SAMSequence_ = std::move(other.SAMSequence_);
         Sequence_ = std::move(other.Sequence_);
-        GCCount_ = std::move(other.GCCount_);
-        reduceGCMemory_ = other.reduceGCMemory_;
-        gcFracLen_ = other.gcFracLen_;
-        lastRegularSample_ = other.lastRegularSample_;
-        gcBitArray_ = std::move(other.gcBitArray_);
-        gcRank_ = std::move(other.gcRank_);
+        gcIndex_ = std::move(other.gcIndex_);
 
         uniqueCount_.store(other.uniqueCount_);
         totalCount_.store(other.totalCount_.load());
@@ -103,12 +86,7 @@ public:
         EffectiveLength = other.EffectiveLength;
         SAMSequence_ = std::move(other.SAMSequence_);
         Sequence_ = std::move(other.Sequence_);
-        GCCount_ = std::move(other.GCCount_);
-        reduceGCMemory_ = other.reduceGCMemory_;
-        gcFracLen_ = other.gcFracLen_;
-        lastRegularSample_ = other.lastRegularSample_;
-        gcBitArray_ = std::move(other.gcBitArray_);
-        gcRank_ = std::move(other.gcRank_);
+        gcIndex_ = std::move(other.gcIndex_);
 
         uniqueCount_.store(other.uniqueCount_);
         totalCount_.store(other.totalCount_.load());
@@ -331,112 +309,57 @@ public:
 
         double contextSize = outsideContext + insideContext;
         int lastPos = RefLength - 1;
-        if (!reduceGCMemory_) {
-            auto cs = (s > 0) ? GCCount_[s - 1] : 0;
-            auto ce = GCCount_[e];
-
-            int fs = s - outside5p;
-            int fe = s + inside5p;
-            int ts = e - inside3p;
-            int te = e + outside3p;
-
-            bool fpLeftExists = (fs >= 0);
-            bool fpRightExists = (fe <= lastPos);
-            bool tpLeftExists = (ts >= 0);
-            bool tpRightExists = (te <= lastPos);
-
-            auto fps = (fpLeftExists) ? GCCount_[fs] : 0;
-            auto fpe = (fpRightExists) ? GCCount_[fe] : ce;
-            auto tps = (tpLeftExists) ? GCCount_[ts] : 0;
-            auto tpe = (tpRightExists) ? GCCount_[te] : ce;
-
-            // now, clamp to actual bounds
-            fs = (fs < 0) ? 0 : fs;
-            fe = (fe > lastPos) ? lastPos : fe;
-            ts = (ts < 0) ? 0 : ts;
-            te = (te > lastPos) ? lastPos : te;
-            int fpContextSize = (!fpLeftExists) ? (fe + 1) : (fe - fs);
-            int tpContextSize = (!tpLeftExists) ? (te + 1) : (te - ts);
-            contextSize = static_cast<double>(fpContextSize + tpContextSize);
-            if (contextSize == 0) {
-              //std::cerr << "" << std::endl;
-              return GCDesc();
-            }
-            valid = true;
-
-            int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-            int32_t contextFrac = std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (contextSize))));
-            /*
-            if (contextFrac > 100) {
-              std::cerr << "NOTE : 5' count = " << (fpeCount - fpsCount) << ", 3' count =" << (tpeCount - tpsCount) << ", context size = " << contextSize << std::endl;
-              std::cerr << "s = " << s << ", e = " << e << ", l = " << RefLength << ", fs = " << fs  << ", fe =  " << fe << ", ts = " << ts << ", te = " << te << std::endl;
-              std::cerr << "fpsCount = " << fpsCount << 
-                ", fpeCount = " << fpeCount << 
-                ", tpsCount = " << tpsCount <<
-                ", tpeCount = " << tpeCount  <<
-                ", fpContextSize = " << fpContextSize  <<
-                ", tpContextSize = " << tpContextSize << std::endl;
-
-            } 
-            */
-            GCDesc desc = {fragFrac, contextFrac};
-            return desc;
-        } else {
-            auto cs = (s > 0) ? gcCountInterp_(s - 1) : 0;
-            auto ce = gcCountInterp_(e);
-
-            int fs = s - outside5p;
-            int fe = s + inside5p;
-            int ts = e - inside3p;
-            int te = e + outside3p;
-
-            bool fpLeftExists = (fs >= 0);
-            bool fpRightExists = (fe <= lastPos);
-            bool tpLeftExists = (ts >= 0);
-            bool tpRightExists = (te <= lastPos);
-
-            auto fps = (fpLeftExists) ? gcCountInterp_(fs) : 0;
-            auto fpe = (fpRightExists) ? gcCountInterp_(fe) : ce;
-            auto tps = (tpLeftExists) ? gcCountInterp_(ts) : 0;
-            auto tpe = (tpRightExists) ? gcCountInterp_(te) : ce;
-
-            // now, clamp to actual bounds
-            fs = (fs < 0) ? 0 : fs;
-            fe = (fe > lastPos) ? lastPos : fe;
-            ts = (ts < 0) ? 0 : ts;
-            te = (te > lastPos) ? lastPos : te;
-            int fpContextSize = (!fpLeftExists) ? (fe + 1) : (fe - fs);
-            int tpContextSize = (!tpLeftExists) ? (te + 1) : (te - ts);
-            contextSize = static_cast<double>(fpContextSize + tpContextSize);
-            if (contextSize == 0) {
-              return GCDesc();
-            }
-            valid = true;
-
-            int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-            int32_t contextFrac = std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (contextSize))));
-            GCDesc desc = {fragFrac, contextFrac};
-            return desc;
-            /** PREVIOUS SAMPLED IMPL (before May 23, 2017) **/
-            /*
-              auto cs = gcCountInterp_(s);
-              auto ce = gcCountInterp_(e);
-
-              valid = true;
-              auto fps = (s >= outside5p) ? gcCountInterp_(s-outside5p) : 0;
-              auto fpe = (inside5p > 0) ? gcCountInterp_(std::min(s+inside5p, lastPos)) : cs;
-              auto tps = (inside3p > 0) ?
-              ((e >= inside3p) ? gcCountInterp_(e-inside3p) : 0) : ce;
-              auto tpe = gcCountInterp_(std::min(e+outside3p, lastPos));
-
-              int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-              int32_t contextFrac = std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (2.0 * contextSize))));
-              GCDesc desc = {fragFrac, contextFrac};
-              return desc;
-            */
+
+        int fs = s - outside5p;
+        int fe = s + inside5p;
+        int ts = e - inside3p;
+        int te = e + outside3p;
+
+        bool fpLeftExists = (fs >= 0);
+        bool fpRightExists = (fe <= lastPos);
+        bool tpLeftExists = (ts >= 0);
+        bool tpRightExists = (te <= lastPos);
+
+        // The (exclusive) prefix counts needed for the fragment and its two
+        // context windows, all fetched in one batch.  A window that starts
+        // before the transcript starts at 0, and one that ends past it ends
+        // with the fragment.
+        uint32_t pos[6] = {
+          static_cast<uint32_t>(s),
+          static_cast<uint32_t>(e + 1),
+          static_cast<uint32_t>(fpLeftExists ? fs + 1 : 0),
+          static_cast<uint32_t>(fpRightExists ? fe + 1 : e + 1),
+          static_cast<uint32_t>(tpLeftExists ? ts + 1 : 0),
+          static_cast<uint32_t>(tpRightExists ? te + 1 : e + 1)
+        };
+        uint32_t counts[6];
+        gcIndex_.ranks(pos, 6, counts);
+        auto cs = counts[0];
+        auto ce = counts[1];
+        auto fps = counts[2];
+        auto fpe = counts[3];
+        auto tps = counts[4];
+        auto tpe = counts[5];
+
+        // now, clamp to actual bounds
+        fs = (fs < 0) ? 0 : fs;
+        fe = (fe > lastPos) ? lastPos : fe;
+        ts = (ts < 0) ? 0 : ts;
+        te = (te > lastPos) ? lastPos : te;
+        int fpContextSize = (!fpLeftExists) ? (fe + 1) : (fe - fs);
+        int tpContextSize = (!tpLeftExists) ? (te + 1) : (te - ts);
+        contextSize = static_cast<double>(fpContextSize + tpContextSize);
+        if (contextSize == 0) {
+          return GCDesc();
         }
+        valid = true;
 
+        int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
+        int32_t contextFrac = std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (contextSize))));
+        GCDesc desc = {fragFrac, contextFrac};
+        return desc;
     }
+
     inline double gcAt(int32_t s) const {
         return (s < 0) ? 0.0 : ((s >= RefLength) ? gcCount_(RefLength-1) : gcCount_(s));
     }
@@ -444,18 +367,15 @@ public:
     // Return the fractional GC content along this transcript
     // in the interval [s,e] (note; this interval is closed on both sides).
     inline int32_t gcFrac(int32_t s, int32_t e) const {
-        if (!reduceGCMemory_) {
-            auto cs = (s > 0) ? GCCount_[s - 1] : 0;
-            auto ce = GCCount_[e];
-            return std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-        } else {
-            auto cs = (s > 0) ? gcCountInterp_(s - 1) : 0;
-            auto ce = gcCountInterp_(e);
-            return std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-        }
-        return 0;
+        auto cs = gcIndex_.rank(s);
+        auto ce = gcIndex_.rank(e + 1);
+        return std::lrint((100.0 * (ce - cs)) / (e - s + 1));
     }
 
+    // The index over this transcript's G/C content (for batched queries);
+    // this is empty unless the sequence was set with needGC.
+    const GCIndex& gcIndex() const { return gcIndex_; }
+
     // Will *not* delete seq on destruction
     void setSequenceBorrowed(const char* seq, bool needGC=false, bool reduceGCMemory=false) {
         Sequence_ = std::unique_ptr<const char, void(*)(const char*)>(
@@ -518,123 +438,13 @@ public:
 private:
     // NOTE: Is it worth it to check if we have GC here?
     // we should never access these without bias correction.
-    inline double gcCount_(int32_t p) {
-      return (!reduceGCMemory_) ? static_cast<double>(GCCount_[p]) : gcCountInterp_(p);
-    }
     inline double gcCount_(int32_t p) const {
-      return (!reduceGCMemory_) ? static_cast<double>(GCCount_[p]) : gcCountInterp_(p);
-    }
-
-  /*
-    inline int32_t closestBin_(int32_t p) const {
-      return static_cast<int32_t>(std::round( static_cast<double>(p) / gcStep_ ));
-    }
-  */
-
-  inline double gcCountInterp_(int32_t p) const {
-    if (p >= RefLength) { p = RefLength - 1; }
-    return static_cast<double>(gcRank_->rank(p + 1));
-  }
-
-  /** Previous GC count interp implementation (May 23, 2017) **/
-  /*
-    inline double gcCountInterp_(int32_t p) const {
-      //std::cerr << "in gcCountInterp\n";
-      if (p == RefLength - 1) {
-        // If p is the last position, just return the last value
-        return static_cast<double>(GCCount_.back());
-      }
-
-      // The index of the closest bin
-      auto cb = closestBin_(p);
-      // The actual position to which this bin corresponds
-      int32_t binPos = cb * gcStep_;
-      // Can't go past the end
-      if (binPos > RefLength - 1) {
-        binPos = RefLength - 1;
-        cb = GCCount_.size() - 1;
-      }
-
-      // The count of {G,C} at the checkpoint
-      auto binCount = GCCount_[cb];
-      // The count before or after the bin, until p
-      int32_t count{0};
-      const char* seq = Sequence_.get();
-
-      // we hit a sampled position
-      if (binPos == p) {
-      } else if (binPos > p) {
-        for (size_t i = binPos; i > p; --i) {
-          auto c = seq[i];
-          // If the character is a G or C, we subtract 1
-          count -= (c == 'G' or c == 'C') ? 1 : 0;
-        }
-      } else {
-        for (size_t i = binPos + 1; i <= p; ++i) {
-          auto c = seq[i];
-          // If the character is a G or C, we add 1
-          count += (c == 'G' or c == 'C') ? 1 : 0;
-        }
-      }
-      return  binCount + count;
-    }
-  */
-
-  /*
-    void computeGCContentSampled_(uint32_t step) {
-        gcStep_ = step;
-        const char* seq = Sequence_.get();
-        size_t nsamp = std::ceil(static_cast<double>(RefLength) / step);
-        GCCount_.reserve(nsamp + 2);
-
-        size_t lastSamp{0};
-        size_t totGC{0};
-        for (size_t i = 0; i < RefLength; ++i) {
-            auto c = std::toupper(seq[i]);
-            if (c == 'G' or c == 'C') {
-                totGC++;
-            }
-            if (i % step == 0) {
-                GCCount_.push_back(totGC);
-                lastSamp = i;
-            }
-        }
-
-        if (lastSamp < RefLength - 1) {
-            GCCount_.push_back(totGC);
-        }
-
-        gcFracLen_ = static_cast<double>(RefLength - 1) / gcStep_;
-        lastRegularSample_ = std::ceil(gcFracLen_);
+      return static_cast<double>(gcIndex_.rank(p + 1));
     }
-  */
 
     void computeGCContent_(bool reduceGCMemory) {
-        reduceGCMemory_ = reduceGCMemory;
-        const char* seq = Sequence_.get();
-        GCCount_.clear();
-        if (!reduceGCMemory) {
-            GCCount_.resize(RefLength, 0);
-            size_t totGC{0};
-            for (size_t i = 0; i < RefLength; ++i) {
-                auto c = std::toupper(seq[i]);
-                if (c == 'G' or c == 'C') {
-                    totGC++;
-                }
-                GCCount_[i] = totGC;
-            }
-        } else {
-          BIT_ARRAY* rawArray = bit_array_create(RefLength);
-          for (size_t i = 0; i < RefLength; ++i) {
-            auto c = std::toupper(seq[i]);
-            if (c == 'G' or c == 'C') {
-              bit_array_set_bit(rawArray, i);
-            }
-          }
-          gcBitArray_.reset(rawArray);
-          gcRank_.reset(new rank9b(gcBitArray_->words, RefLength));
-          //computeGCContentSampled_(gcSampFactor);
-        }
+        // With reduceGCMemory, keep relative counts at a coarser interval
+        gcIndex_ = GCIndex(Sequence_.get(), RefLength, reduceGCMemory);
     }
 
     std::unique_ptr<uint8_t, void(*)(uint8_t*)> SAMSequence_ =
@@ -661,12 +471,7 @@ private:
     std::atomic<bool> hasAnchorFragment_{false};
     bool active_;
 
-    bool reduceGCMemory_{false};
-    double gcFracLen_{0.0};
-    uint32_t lastRegularSample_{0};
-    std::vector<uint32_t> GCCount_;
-    BitArrayPointer gcBitArray_{nullptr};
-    Rank9bPointer gcRank_{nullptr};
+    GCIndex gcIndex_;
 };
 
 #endif //TRANSCRIPT
@@ -0,0 +1,157 @@
+#ifndef __TRANSCRIPT_SEQUENCE_ARENA_HPP__
+#define __TRANSCRIPT_SEQUENCE_ARENA_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
+/**
+ * Contiguous storage for the sequences of a set of transcripts, with a table
+ * of offsets into it.  The sequences either live in a buffer owned by the
+ * arena (one NUL-terminated sequence after another, along with their SAM
+ * (4-bit) encodings), or are borrowed from an existing concatenated text
+ * (e.g. that of the index), in which case the arena only holds the offsets.
+ *
+ * The arena also holds the reverse complements of the sequences, once
+ * computed, laid out the same way; these are shared by every pass of bias
+ * correction.
+ *
+ * The transcripts borrow their sequences from the arena, so it must outlive
+ * them.
+ */
+class TranscriptSequenceArena {
+public:
+  /**
+   * Lay out space for sequences of the given lengths (transcript i gets
+   * lengths[i] bases), and optionally for their SAM encodings.  Any previous
+   * contents are released.
+   */
+  void allocate(const std::vector<uint32_t>& lengths, bool withSAM) {
+    reset_(lengths);
+    size_t n = lengths.size();
+    samOffsets_.assign(n + 1, 0);
+    uint64_t seqLen{0};
+    for (size_t i = 0; i < n; ++i) {
+      seqOffsets_[i] = seqLen;
+      seqLen += lengths[i] + 1;
+      samOffsets_[i + 1] = samOffsets_[i] + (withSAM ? (lengths[i] + 1) / 2 : 0);
+    }
+    seqOffsets_[n] = seqLen;
+    ownedSeqs_.reset(new char[seqLen + 1]);
+    sams_.reset(withSAM ? new uint8_t[samOffsets_[n] + 1]() : nullptr);
+    seqs_ = ownedSeqs_.get();
+  }
+
+  /**
+   * Borrow the sequences from text, where transcript i is the lengths[i]
+   * bases starting at text + offsets[i].  Any previous contents are released.
+   */
+  template <typename OffsetT>
+  void borrow(const char* text, const std::vector<OffsetT>& offsets,
+              const std::vector<uint32_t>& lengths) {
+    reset_(lengths);
+    for (size_t i = 0; i < lengths.size(); ++i) {
+      seqOffsets_[i] = offsets[i];
+    }
+    seqs_ = text;
+  }
+
+  size_t size() const { return lengths_.size(); }
+  uint32_t length(size_t i) const { return lengths_[i]; }
+  bool ownsSequences() const { return ownedSeqs_ != nullptr; }
+
+  const char* sequence(size_t i) const { return seqs_ + seqOffsets_[i]; }
+  // Only for sequences owned by the arena
+  char* writableSequence(size_t i) { return ownedSeqs_.get() + seqOffsets_[i]; }
+  uint8_t* samSequence(size_t i) {
+    return sams_ ? sams_.get() + samOffsets_[i] : nullptr;
+  }
+
+  /**
+   * Compute the reverse complement of every sequence (in parallel).  That
+   * of transcript i has rcLengths[i] bases (normally length(i)); were that
+   * longer than the sequence, the missing bases are taken to be 'N'.
+   */
+  void computeReverseComplements(const std::vector<uint32_t>& rcLengths) {
+    size_t n = size();
+    rcOffsets_.assign(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      rcOffsets_[i + 1] = rcOffsets_[i] + rcLengths[i];
+    }
+    rcs_.reset(new char[rcOffsets_[n] + 1]);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, n),
+        [&](const tbb::blocked_range<size_t>& r) {
+          for (size_t i = r.begin(); i != r.end(); ++i) {
+            uint32_t l = rcLengths[i];
+            uint32_t avail = std::min(l, length(i));
+            const char* s = sequence(i);
+            char* o = rcs_.get() + rcOffsets_[i];
+            std::fill(o, o + (l - avail), 'N');
+            o += l - avail;
+            for (int64_t j = static_cast<int64_t>(avail) - 1; j >= 0; --j) {
+              *o++ = complement_(s[j]);
+            }
+          }
+        });
+  }
+
+  bool hasReverseComplements() const { return rcs_ != nullptr; }
+  const char* reverseComplement(size_t i) const { return rcs_.get() + rcOffsets_[i]; }
+
+  size_t sizeInBytes() const {
+    return (ownedSeqs_ ? seqOffsets_.back() : 0) +
+           (samOffsets_.empty() ? 0 : samOffsets_.back()) +
+           (rcOffsets_.empty() ? 0 : rcOffsets_.back()) +
+           (seqOffsets_.size() + samOffsets_.size() + rcOffsets_.size()) * sizeof(uint64_t) +
+           lengths_.size() * sizeof(uint32_t);
+  }
+
+private:
+  static inline char complement_(char c) {
+    switch (c) {
+    case 'A':
+    case 'a':
+      return 'T';
+    case 'C':
+    case 'c':
+      return 'G';
+    case 'T':
+    case 't':
+      return 'A';
+    case 'G':
+    case 'g':
+      return 'C';
+    default:
+      return 'N';
+    }
+  }
+
+  void reset_(const std::vector<uint32_t>& lengths) {
+    lengths_ = lengths;
+    seqOffsets_.assign(lengths.size() + 1, 0);
+    samOffsets_.clear();
+    rcOffsets_.clear();
+    ownedSeqs_.reset();
+    sams_.reset();
+    rcs_.reset();
+    seqs_ = nullptr;
+  }
+
+  std::vector<uint32_t> lengths_;
+  std::vector<uint64_t> seqOffsets_;
+  std::vector<uint64_t> samOffsets_;
+  std::vector<uint64_t> rcOffsets_;
+  // Either ownedSeqs_, or the text the sequences are borrowed from
+  const char* seqs_{nullptr};
+  std::unique_ptr<char[]> ownedSeqs_;
+  std::unique_ptr<uint8_t[]> sams_;
+  std::unique_ptr<char[]> rcs_;
+};
+
+#endif // __TRANSCRIPT_SEQUENCE_ARENA_HPP__
@@ -411,6 +411,11 @@ void AlignmentModel::update(bam_seq_t* read, Transcript& ref, double p, double m
     // unsigned version of transcriptIdx
     size_t uTranscriptIdx = static_cast<size_t>(transcriptIdx);
 
+    // A read that starts past the end of the transcript has likelihood
+    // LOG_0 (see logLikelihood()); don't walk off the end of the transcript
+    // to update the model with it.
+    if (uTranscriptIdx >= transcriptLen) { return; }
+
     //std::stringstream readStream, matchStream, refStream;
 
     uint32_t* cigar = bam_cigar(read);
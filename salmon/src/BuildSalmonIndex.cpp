@@ -87,7 +87,8 @@ int salmonIndex(int argc, char* argv[]) {
          "the transcript name at the first \'|\' character.  These reduced names will be used in the "
          "output and when looking for these transcripts in a gene to transcript GTF.")
     ("threads,p", po::value<uint32_t>(&numThreads)->default_value(2)->required(),
-                            "Number of threads to use (only used for computing bias features)")
+                            "Number of threads to use (for computing bias features, and building "
+                            "the suffix array and BWT of the FMD index)")
     ("perfectHash", po::bool_switch(&perfectHash)->default_value(false), 
                              "[quasi index only] Build the index using a perfect hash rather than a dense hash.  This "
                              "will require less memory (especially during quantification), but will take longer to construct")
@@ -220,6 +221,8 @@ Creates a salmon index.
             argVec->push_back(optWriter.str());
             argVec->push_back("-p");
             argVec->push_back(outputPrefix.string());
+            argVec->push_back("-t");
+            argVec->push_back(std::to_string(numThreads));
             argVec->push_back(transcriptFile);
             sidx.reset(new SalmonIndex(jointLog, SalmonIndexType::FMD));
     	    // Disable the auxiliary k-mer index for now
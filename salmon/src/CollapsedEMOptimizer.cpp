@@ -21,6 +21,7 @@
 #include "AlignmentLibrary.hpp"
 #include "BootstrapWriter.hpp"
 #include "CollapsedEMOptimizer.hpp"
+#include "ExpectedBiasState.hpp"
 #include "MultinomialSampler.hpp"
 #include "ReadExperiment.hpp"
 #include "ReadPair.hpp"
@@ -910,6 +911,11 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
   double maxRelDiff = -std::numeric_limits<double>::max();
   bool needBias = doBiasCorrect;
   size_t targetIt{10};
+  // The number of times we'll re-estimate the biases (and effective lengths).
+  // After the first, each round only updates the expected bias contributions
+  // of transcripts whose abundance changed, using the state kept here.
+  uint32_t biasRoundsLeft = std::max(sopt.numBiasRounds, 1u);
+  ExpectedBiasState biasState(sopt.numConditionalGCBins, sopt.numFragGCBins);
   /* -- v0.8.x
   double alphaSum = 0.0;
   */
@@ -919,7 +925,8 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
 
       jointLog->info("iteration {}, adjusting effective lengths to account for biases", itNum);
       effLens = salmon::utils::updateEffectiveLengths(sopt, readExp, effLens,
-                                                      alphas, available, true);
+                                                      alphas, available, true,
+                                                      &biasState);
       // if we're doing the VB optimization, update the priors
       if (useVBEM) {
           priorAlphas = populatePriorAlphas_(transcripts, effLens, priorValue, perTranscriptPrior);
@@ -932,7 +939,12 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
         }
       }
       updateEqClassWeights(eqVec, effLens);
-      needBias = false;
+      --biasRoundsLeft;
+      // Bias correction may have been disabled (e.g. for lack of data)
+      bool stillCorrecting = sopt.biasCorrect or sopt.gcBiasCorrect or sopt.posBiasCorrect;
+      needBias = (biasRoundsLeft > 0) and stillCorrecting;
+      // Let the abundances settle under the new lengths before the next round
+      targetIt = itNum + 10;
     }
 
     if (useVBEM) {
@@ -1,102 +1,157 @@
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <unordered_map>
+#include <limits>
 #include <random>
 
+#include <zlib.h>
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
 #include "jellyfish/mer_dna.hpp"
-#include "FastxParser.hpp"
+#include "xxhash.h"
 
 #include "FASTAParser.hpp"
+#include "MappedFile.hpp"
+#include "MinimalPerfectHash.hpp"
 #include "Transcript.hpp"
+#include "TranscriptSequenceArena.hpp"
 #include "SalmonStringUtils.hpp"
 #include "SalmonOpts.hpp"
 
+namespace {
+// The extent of one record in the FASTA text
+struct FASTARecord {
+  const char* name;
+  size_t nameLen;
+  const char* seq;
+  const char* seqEnd;
+};
+
+inline uint64_t hashName(const char* name, size_t len) {
+  return XXH64(static_cast<const void*>(name), len, 0);
+}
 
-FASTAParser::FASTAParser(const std::string& fname): fname_(fname) {}
-
-void FASTAParser::populateTargets(std::vector<Transcript>& refs, SalmonOpts& sopt) {
-    using single_parser = fastx_parser::FastxParser<fastx_parser::ReadSeq>;
+// Read the whole of a (possibly gzipped) file into buf
+bool readWholeFile(const std::string& fname, std::string& buf) {
+  gzFile in = gzopen(fname.c_str(), "rb");
+  if (in == nullptr) { return false; }
+  constexpr unsigned chunkSize{1u << 22};
+  int n{0};
+  do {
+    size_t prev = buf.size();
+    buf.resize(prev + chunkSize);
+    n = gzread(in, &buf[prev], chunkSize);
+    buf.resize(prev + ((n > 0) ? n : 0));
+  } while (n > 0);
+  gzclose(in);
+  return n == 0;
+}
+}
 
-    using std::string;
-    using std::unordered_map;
+FASTAParser::FASTAParser(const std::string& fname): fname_(fname) {}
 
-    unordered_map<string, size_t> nameToID;
-    for (auto& ref : refs) {
-      nameToID[ref.RefName] = ref.id;
+void FASTAParser::populateTargets(std::vector<Transcript>& refs,
+                                  TranscriptSequenceArena& arena,
+                                  SalmonOpts& sopt) {
+    // Map the file if we can; gzipped input (or anything that can't be
+    // mapped, like a pipe) is inflated into memory instead.
+    salmon::MappedFile mapped(fname_);
+    std::string inflated;
+    const char* textBegin = mapped.begin();
+    const char* textEnd = mapped.end();
+    bool gzipped = (textEnd - textBegin >= 2) and
+                   static_cast<unsigned char>(textBegin[0]) == 0x1f and
+                   static_cast<unsigned char>(textBegin[1]) == 0x8b;
+    if (!mapped.good() or textBegin == textEnd or gzipped) {
+      if (!readWholeFile(fname_, inflated)) {
+        sopt.jointLog->critical("Could not read the reference FASTA file {}", fname_);
+        sopt.jointLog->flush();
+        std::exit(1);
+      }
+      textBegin = inflated.data();
+      textEnd = textBegin + inflated.size();
     }
 
     // Separators for the header (default ' ' and '\t')
     // If we have the gencode flag, then add '|'.
-    std::string sepStr = " \t";
-    if (sopt.gencodeRef) {
-        sepStr += '|';
+    bool gencodeSep = sopt.gencodeRef;
+    auto isSep = [gencodeSep](char c) -> bool {
+      return std::isspace(static_cast<unsigned char>(c)) or (gencodeSep and c == '|');
+    };
+
+    // One pass over the text to find where each record's name and sequence lie
+    std::vector<FASTARecord> records;
+    const char* p = textBegin;
+    while (p < textEnd and *p != '>') {
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', textEnd - p));
+      p = (nl == nullptr) ? textEnd : nl + 1;
+    }
+    while (p < textEnd) {
+      // p is at the '>' of a header
+      FASTARecord rec;
+      rec.name = p + 1;
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', textEnd - p));
+      const char* headerEnd = (nl == nullptr) ? textEnd : nl;
+      const char* nameEnd = rec.name;
+      while (nameEnd < headerEnd and !isSep(*nameEnd)) { ++nameEnd; }
+      rec.nameLen = nameEnd - rec.name;
+      rec.seq = (nl == nullptr) ? textEnd : nl + 1;
+      // The record ends at the next line starting with '>'
+      const char* q = rec.seq;
+      while (q < textEnd and *q != '>') {
+        nl = static_cast<const char*>(std::memchr(q, '\n', textEnd - q));
+        q = (nl == nullptr) ? textEnd : nl + 1;
+      }
+      rec.seqEnd = q;
+      records.push_back(rec);
+      p = q;
     }
 
-    std::vector<std::string> readFiles{fname_};
-    size_t maxReadGroup{1000}; // Number of files to read simultaneously
-    size_t concurrentFile{1}; // Number of reads in each "job"
-
-    single_parser parser(readFiles, 1, 1, maxReadGroup);
-    parser.start();
-
-    constexpr char bases[] = {'A', 'C', 'G', 'T'};
-    // Create a random uniform distribution
-    std::random_device rd;
-    std::default_random_engine eng(rd());
-    std::uniform_int_distribution<> dis(0, 3);
-    uint64_t numNucleotidesReplaced{0};
-
-    // All header names we encounter in the fasta file
-    std::unordered_set<std::string> fastaNames;
-
-    auto rg = parser.getReadGroup();
-    while (parser.refill(rg)) {
-      for (auto& read : rg) {
-        std::string& header = read.name;
-        std::string name = header.substr(0, header.find_first_of(sepStr));
-        fastaNames.insert(name);
-
-        auto it = nameToID.find(name);
-        if (it == nameToID.end()) {
-          sopt.jointLog->warn("Transcript {} appears in the reference but did not appear in the BAM", name);
-        } else {
-
-          //std::string& seq = j->data[i].seq;
-          std::string& seq = read.seq;
-          size_t readLen = seq.length();
-
-          refs[it->second].setSAMSequenceOwned(salmon::stringtools::encodeSequenceInSAM(seq.c_str(), readLen));
-
-          // Replace non-ACGT bases
-          for (size_t b = 0; b < readLen; ++b) {
-            seq[b] = ::toupper(seq[b]);
-            int c = jellyfish::mer_dna::code(seq[b]);
-            // Replace non-ACGT bases with pseudo-random bases
-            if (jellyfish::mer_dna::not_dna(c)) {
-              char rbase = bases[dis(eng)];
-              c = jellyfish::mer_dna::code(rbase);
-              seq[b] = rbase;
-              ++numNucleotidesReplaced;
-            }
-          }
+    // Resolve the record names against those in the BAM header, through a
+    // perfect hash over the (hashes of the) latter.
+    std::vector<uint64_t> refHashes;
+    refHashes.reserve(refs.size());
+    for (auto& ref : refs) {
+      refHashes.push_back(hashName(ref.RefName.data(), ref.RefName.size()));
+    }
+    std::vector<uint64_t> keys(refHashes);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    MinimalPerfectHash nameHash(keys);
+    constexpr uint32_t noRef = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> slotToRef(keys.size(), noRef);
+    for (size_t i = 0; i < refs.size(); ++i) {
+      slotToRef[nameHash.lookup(refHashes[i])] = i;
+    }
 
-          // allocate space for the new copy
-          char* seqCopy = new char[seq.length()+1];
-          std::strcpy(seqCopy, seq.c_str());
-          refs[it->second].setSequenceOwned(seqCopy, sopt.gcBiasCorrect, sopt.reduceGCMemory);
-          // seqCopy will only be freed when the transcript is destructed!
-        }
+    // The record for each transcript (if a name appears more than once, the
+    // last record wins, as before)
+    std::vector<const FASTARecord*> refRecord(refs.size(), nullptr);
+    for (auto& rec : records) {
+      uint64_t slot = nameHash.lookup(hashName(rec.name, rec.nameLen));
+      uint32_t id = (slot < slotToRef.size()) ? slotToRef[slot] : noRef;
+      // The hash can't tell foreign names apart, so check the name itself
+      if (id == noRef or refs[id].RefName.size() != rec.nameLen or
+          std::memcmp(refs[id].RefName.data(), rec.name, rec.nameLen) != 0) {
+        sopt.jointLog->warn("Transcript {} appears in the reference but did not appear in the BAM",
+                            std::string(rec.name, rec.nameLen));
+      } else {
+        refRecord[id] = &rec;
       }
     }
 
     // Check that every sequence present in the BAM header was also present in the
     // transcriptome fasta.
     bool missingTxpError{false};
-    for (auto& kv : nameToID) {
-      auto& name = kv.first;
-      if (fastaNames.find(name) == fastaNames.end()) {
-        sopt.jointLog->critical("Transcript {} appeared in the BAM header, but was not in the provided FASTA file", name);
+    for (size_t i = 0; i < refs.size(); ++i) {
+      if (refRecord[i] == nullptr) {
+        sopt.jointLog->critical("Transcript {} appeared in the BAM header, but was not in the provided FASTA file", refs[i].RefName);
         missingTxpError = true;
       }
     }
@@ -111,7 +166,57 @@ void FASTAParser::populateTargets(std::vector<Transcript>& refs, SalmonOpts& sop
       std::exit(1);
     }
 
-    sopt.jointLog->info("replaced {} non-ACGT nucleotides with random nucleotides",  numNucleotidesReplaced);
+    auto isBase = [](char c) -> bool {
+      return !std::isspace(static_cast<unsigned char>(c));
+    };
+
+    // Size every sequence, and lay them all out in the arena
+    std::vector<uint32_t> lengths(refs.size(), 0);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, refs.size()),
+        [&](const tbb::blocked_range<size_t>& r) {
+          for (size_t i = r.begin(); i != r.end(); ++i) {
+            auto rec = refRecord[i];
+            lengths[i] = std::count_if(rec->seq, rec->seqEnd, isBase);
+          }
+        });
+    arena.allocate(lengths, true);
+
+    // Fill in the sequences, their SAM encodings and their GC content
+    constexpr char bases[] = {'A', 'C', 'G', 'T'};
+    std::atomic<uint64_t> numNucleotidesReplaced{0};
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, refs.size()),
+        [&](const tbb::blocked_range<size_t>& r) {
+          for (size_t i = r.begin(); i != r.end(); ++i) {
+            auto rec = refRecord[i];
+            char* seq = arena.writableSequence(i);
+            *std::copy_if(rec->seq, rec->seqEnd, seq, isBase) = '\0';
+            uint32_t len = lengths[i];
+
+            salmon::stringtools::encodeSequenceInSAM(seq, len, arena.samSequence(i));
+
+            // Replace non-ACGT bases with pseudo-random bases; the generator
+            // is seeded by the transcript, so this doesn't depend on the
+            // order in which transcripts are filled.
+            std::minstd_rand eng(i + 1);
+            std::uniform_int_distribution<> dis(0, 3);
+            uint64_t numReplaced{0};
+            for (uint32_t b = 0; b < len; ++b) {
+              seq[b] = ::toupper(seq[b]);
+              int c = jellyfish::mer_dna::code(seq[b]);
+              if (jellyfish::mer_dna::not_dna(c)) {
+                seq[b] = bases[dis(eng)];
+                ++numReplaced;
+              }
+            }
+            numNucleotidesReplaced += numReplaced;
 
-}
+            refs[i].setSAMSequenceBorrowed(arena.samSequence(i));
+            refs[i].setSequenceBorrowed(seq, sopt.gcBiasCorrect, sopt.reduceGCMemory);
+          }
+        });
+
+    sopt.jointLog->info("replaced {} non-ACGT nucleotides with random nucleotides",  numNucleotidesReplaced.load());
 
+}
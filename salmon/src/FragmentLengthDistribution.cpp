@@ -9,6 +9,7 @@
 
 #include "FragmentLengthDistribution.hpp"
 #include "SalmonMath.hpp"
+#include <algorithm>
 #include <numeric>
 #include <cassert>
 #include <boost/assign.hpp>
@@ -19,25 +20,37 @@
 
 using namespace std;
 
+// The number of observations a thread makes between reporting them.
+constexpr uint64_t localReportInterval = 256;
+// The minimum number of observations between two snapshots.  Beyond this,
+// snapshots are published geometrically (every 25% growth), so only a
+// logarithmic number of them is ever created.
+constexpr uint64_t minPublishInterval = 4096;
+// How far (in log space) an observation's mass may exceed the scale of the
+// histogram it goes into before the histogram is rescaled.  This keeps every
+// linear-space bin well below the largest double.
+constexpr double maxLogMassAboveScale = 256.0;
+
 FragmentLengthDistribution::FragmentLengthDistribution(double alpha, size_t max_val,
                                        size_t prior_mu, size_t prior_sigma,
                                        size_t kernel_n, double kernel_p,
                                        size_t bin_size)
-    : hist_(max_val/bin_size+1),
-      cachedCMF_(hist_.size()),
-      haveCachedCMF_(false),
-      totMass_(salmon::math::LOG_0),
-      sum_(salmon::math::LOG_0),
+    : priorHist_(max_val/bin_size+1, 0.0),
+      priorTotMass_(0.0),
+      priorLenMass_(0.0),
+      threadHist_(static_cast<LocalHist*>(nullptr)),
+      current_(nullptr),
+      frozen_(false),
+      numObs_(0),
+      nextPublish_(minPublishInterval),
       min_(max_val/bin_size),
-      binSize_(bin_size) {
+      binSize_(bin_size),
+      numBins_(max_val/bin_size+1) {
 
-    using salmon::math::logAdd;
   max_val = max_val/bin_size;
   kernel_n = kernel_n/bin_size;
   assert(kernel_n % 2 == 0);
 
-  double tot = log(alpha);
-
   // Set to prior distribution
   if (prior_mu) {
     boost::math::normal norm(prior_mu/bin_size,
@@ -46,42 +59,151 @@ FragmentLengthDistribution::FragmentLengthDistribution(double alpha, size_t max_
     for (size_t i = 0; i <= max_val; ++i) {
       double norm_mass = boost::math::cdf(norm, i+0.5) -
                          boost::math::cdf(norm, i-0.5);
-      double mass = salmon::math::LOG_EPSILON;
+      double mass = std::exp(salmon::math::LOG_EPSILON);
       if (norm_mass != 0) {
-        mass = tot + log(norm_mass);
+        mass = alpha * norm_mass;
       }
-      hist_[i].compare_and_swap(mass, hist_[i]);
-      sum_.compare_and_swap(logAdd(sum_, log((double)i)+mass), sum_);
-      totMass_.compare_and_swap(logAdd(totMass_, mass), totMass_);
+      priorHist_[i] = mass;
+      priorLenMass_ += i * mass;
+      priorTotMass_ += mass;
     }
   } else {
-      hist_ = vector<tbb::atomic<double>>(max_val + 1, tot - log((double)max_val));
-      hist_[0].compare_and_swap(salmon::math::LOG_0, hist_[0]);
-      sum_.compare_and_swap(hist_[1] + log((double)(max_val * (max_val + 1))) - log(2.), sum_);
-      totMass_ = tot;
+      for (size_t i = 1; i <= max_val; ++i) {
+        priorHist_[i] = alpha / max_val;
+        priorLenMass_ += i * priorHist_[i];
+      }
+      priorTotMass_ = alpha;
   }
 
   // Define kernel
   boost::math::binomial_distribution<double> binom(kernel_n, kernel_p);
   kernel_ = vector<double>(kernel_n + 1);
   for (size_t i = 0; i <= kernel_n; i++) {
-    kernel_[i] = log(boost::math::pdf(binom, i));
+    kernel_[i] = boost::math::pdf(binom, i);
   }
+
+  std::lock_guard<std::mutex> lock(publishMut_);
+  publish_();
 }
 
 size_t FragmentLengthDistribution::maxVal() const {
-  return (hist_.size()-1) * binSize_;
+  return (numBins_-1) * binSize_;
 }
 
 size_t FragmentLengthDistribution::minVal() const {
-  if (min_ == hist_.size() - 1) {
+  if (min_ == numBins_ - 1) {
     return 1;
   }
   return min_;
 }
 
+FragmentLengthDistribution::LocalHist& FragmentLengthDistribution::localHist_() {
+  auto& lh = threadHist_.local();
+  if (lh == nullptr) {
+    std::unique_ptr<LocalHist> hist(new LocalHist(numBins_));
+    lh = hist.get();
+    std::lock_guard<std::mutex> lock(localHistMut_);
+    localHists_.push_back(std::move(hist));
+  }
+  return *lh;
+}
+
+void FragmentLengthDistribution::LocalHist::rescale(double newLogScale) {
+  version.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  // (An empty histogram has no mass to rescale, whatever its old scale)
+  if (totMass.load(std::memory_order_relaxed) > 0.0) {
+    double factor = std::exp(logScale.load(std::memory_order_relaxed) - newLogScale);
+    for (size_t i = 0; i < numBins; ++i) {
+      mass[i].store(mass[i].load(std::memory_order_relaxed) * factor,
+                    std::memory_order_relaxed);
+    }
+    lenMass.store(lenMass.load(std::memory_order_relaxed) * factor, std::memory_order_relaxed);
+    totMass.store(totMass.load(std::memory_order_relaxed) * factor, std::memory_order_relaxed);
+  }
+  logScale.store(newLogScale, std::memory_order_relaxed);
+  version.fetch_add(1, std::memory_order_release);
+}
+
+void FragmentLengthDistribution::publish_() {
+  std::unique_ptr<Snapshot> snap(new Snapshot);
+  snap->epoch = snapshots_.size();
+  snap->binSize = binSize_;
+
+  // Read each per-thread histogram at a single scale, retrying if its owner
+  // rescales it while we read
+  struct Scaled {
+    double logScale;
+    std::vector<double> mass;
+    double totMass;
+    double lenMass;
+  };
+  std::vector<Scaled> reads;
+  double maxLogScale{salmon::math::LOG_1};
+  {
+    std::lock_guard<std::mutex> lock(localHistMut_);
+    for (auto& lh : localHists_) {
+      Scaled r;
+      r.mass.resize(numBins_);
+      while (true) {
+        uint64_t before = lh->version.load(std::memory_order_acquire);
+        if (before & 1) { continue; }
+        r.logScale = lh->logScale.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < numBins_; ++i) {
+          r.mass[i] = lh->mass[i].load(std::memory_order_relaxed);
+        }
+        r.totMass = lh->totMass.load(std::memory_order_relaxed);
+        r.lenMass = lh->lenMass.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (lh->version.load(std::memory_order_relaxed) == before) { break; }
+      }
+      if (r.totMass > 0.0) {
+        maxLogScale = std::max(maxLogScale, r.logScale);
+        reads.push_back(std::move(r));
+      }
+    }
+  }
+
+  // Sum the observations (in linear space, at the largest scale), and then
+  // add the prior in log space, since the observed mass may dwarf it
+  // beyond the range of a double.
+  std::vector<double> hist(numBins_, 0.0);
+  double totMass{0.0};
+  double lenMass{0.0};
+  for (auto& r : reads) {
+    double factor = std::exp(r.logScale - maxLogScale);
+    for (size_t i = 0; i < numBins_; ++i) { hist[i] += r.mass[i] * factor; }
+    totMass += r.totMass * factor;
+    lenMass += r.lenMass * factor;
+  }
+  auto withPrior = [maxLogScale](double prior, double observed) -> double {
+    return salmon::math::logAdd(salmon::math::log(prior),
+                                salmon::math::log(observed) + maxLogScale);
+  };
+
+  // The totals are accumulated separately from the bins; normalize by the
+  // sum of the bins we actually read so that the snapshot is self-consistent.
+  snap->totMass = withPrior(priorTotMass_, totMass);
+  snap->mean = withPrior(priorLenMass_, lenMass) - snap->totMass;
+  snap->pmfBins.resize(numBins_);
+  snap->cmfBins.resize(numBins_);
+  double cum{salmon::math::LOG_0};
+  for (size_t i = 0; i < numBins_; ++i) {
+    snap->pmfBins[i] = withPrior(priorHist_[i], hist[i]);
+    cum = salmon::math::logAdd(cum, snap->pmfBins[i]);
+    snap->cmfBins[i] = cum;
+  }
+  double logTot = cum;
+  for (size_t i = 0; i < numBins_; ++i) {
+    snap->pmfBins[i] -= logTot;
+    snap->cmfBins[i] -= logTot;
+  }
+
+  current_.store(snap.get(), std::memory_order_release);
+  snapshots_.push_back(std::move(snap));
+}
+
 void FragmentLengthDistribution::addVal(size_t len, double mass) {
-    using salmon::math::logAdd;
     //assert(!isnan(mass));
     //assert(kernel_.size());
 
@@ -94,52 +216,48 @@ void FragmentLengthDistribution::addVal(size_t len, double mass) {
     min_ = len;
   }
 
+  // NOTE: It is the *log* of the forgetting mass that grows as
+  // t^(1-forgettingFactor) in the number of mini-batches t, so the mass
+  // itself eventually outgrows a double.  Each histogram therefore holds its
+  // mass relative to a scale, which is moved up whenever an observation
+  // would be too far above it.
+  auto& lh = localHist_();
+  if (lh.numObs == 0 or
+      mass - lh.logScale.load(std::memory_order_relaxed) > maxLogMassAboveScale) {
+    lh.rescale(mass);
+  }
+  double linMass = std::exp(mass - lh.logScale.load(std::memory_order_relaxed));
   size_t offset = len - kernel_.size()/2;
 
   for (size_t i = 0; i < kernel_.size(); i++) {
-    if (offset > 0 && offset < hist_.size()) {
-      double kMass = mass + kernel_[i];
-      double oldVal = hist_[offset];
-      double retVal = oldVal;
-      double newVal = 0.0;
-      do {
-          oldVal = retVal;
-          newVal = logAdd(oldVal, kMass);
-          retVal = hist_[offset].compare_and_swap(newVal, oldVal);
-      } while (retVal != oldVal);
-
-      retVal = sum_;
-      do {
-          oldVal = retVal;
-          newVal = logAdd(oldVal, log(static_cast<double>(offset))+kMass);
-          retVal = sum_.compare_and_swap(newVal, oldVal);
-      } while (retVal != oldVal);
-
-      retVal = totMass_;
-      do {
-          oldVal = retVal;
-          newVal = logAdd(oldVal, kMass);
-          retVal = totMass_.compare_and_swap(newVal, oldVal);
-      } while (retVal != oldVal);
-
+    if (offset > 0 && offset < numBins_) {
+      double kMass = linMass * kernel_[i];
+      lh.add(lh.mass[offset], kMass);
+      lh.add(lh.lenMass, offset * kMass);
+      lh.add(lh.totMass, kMass);
     }
     offset++;
   }
+
+  // Periodically report our observations, and publish a new snapshot if
+  // enough of them have accumulated (and no one else is doing so).
+  if (++lh.numObs % localReportInterval == 0 and !frozen_) {
+    uint64_t numObs = numObs_.fetch_add(localReportInterval) + localReportInterval;
+    if (numObs >= nextPublish_ and publishMut_.try_lock()) {
+      if (!frozen_ and numObs >= nextPublish_) {
+        publish_();
+        nextPublish_ = numObs + std::max(minPublishInterval, numObs / 4);
+      }
+      publishMut_.unlock();
+    }
+  }
 }
 
 /**
  * Returns the *LOG* probability of observing a fragment of length *len*.
  */
 double FragmentLengthDistribution::pmf(size_t len) const {
-  if (haveCachedCMF_) {
-    return (len < cachedPMF_.size()) ? cachedPMF_[len] : cachedPMF_.back();
-  } else {
-    len /= binSize_;
-    if (len > maxVal()) {
-        len = maxVal();
-    }
-    return hist_[len]-totMass_;
-  }
+  return snapshot()->pmf(len);
 }
 
 /**
@@ -152,57 +270,24 @@ void FragmentLengthDistribution::dumpPMF(
 
     minV = minVal();
     maxV = maxVal();
+    auto snap = snapshot();
     pmfOut.clear();
     pmfOut.reserve(maxV - minV + 1);
     for (size_t i = minV; i <= maxV; ++i) {
-        pmfOut.push_back(pmf(i));
+        pmfOut.push_back(snap->pmf(i));
     }
 }
 
 double FragmentLengthDistribution::cmf(size_t len) const {
-    if(haveCachedCMF_) {
-      return (len < cachedCMF_.size()) ? cachedCMF_[len] : cachedCMF_.back();
-    } else {
-        double cum = salmon::math::LOG_0;
-        len /= binSize_;
-        if (len > maxVal()) {
-            len = maxVal();
-        }
-
-        for (size_t i = 0; i <= len; ++i) {
-            cum = salmon::math::logAdd(cum, hist_[i]);
-        }
-        return cum - totMass_;
-    }
-}
-
-std::vector<double> getLockedPMF(FragmentLengthDistribution* fld){
-  std::vector<double> pmfOut;
-  auto maxV = fld->maxVal();
-  pmfOut.reserve(maxV + 1);
-  double totMass = salmon::math::LOG_0;
-  for (size_t i = 0; i <= maxV; ++i) {
-    pmfOut.push_back(fld->pmf(i));
-    totMass = salmon::math::logAdd(totMass, pmfOut.back());
-  }
-  for (size_t i = 0; i <= maxV; ++i) {
-    pmfOut[i] -= totMass;
-  }
-  return pmfOut;
+  return snapshot()->cmf(len);
 }
 
 void FragmentLengthDistribution::cacheCMF() {
-  //std::lock_guard<std::mutex> lg(fldMut_);
-    if (sl_.try_lock()) {
-      if (!haveCachedCMF_) {
-        size_t minV, maxV;
-        cachedPMF_ = getLockedPMF(this);
-        cachedCMF_ = cmf(cachedPMF_);
-        haveCachedCMF_ = true;
-      }
-
-      sl_.unlock();
-    }
+  std::lock_guard<std::mutex> lock(publishMut_);
+  if (!frozen_) {
+    publish_();
+    frozen_ = true;
+  }
 }
 
 /**
@@ -222,30 +307,23 @@ vector<double> FragmentLengthDistribution::cmf(const std::vector<double>& pmf) c
 }
 
 vector<double> FragmentLengthDistribution::cmf() const {
-  double cum = salmon::math::LOG_0;
-  vector<double> cdf(hist_.size());
-  for (size_t i = 0; i < hist_.size(); ++i) {
-    cum = salmon::math::logAdd(cum, hist_[i]);
-    cdf[i] = cum - totMass_;
-  }
-  //assert(approxEq(cum, totMass_));
-
-  return cdf;
+  return snapshot()->cmfBins;
 }
 
 double FragmentLengthDistribution::totMass() const {
-  return totMass_;
+  return snapshot()->totMass;
 }
 
 double FragmentLengthDistribution::mean() const {
-  return sum_ - totMass();
+  return snapshot()->mean;
 }
 
 std::string FragmentLengthDistribution::toString() const {
     std::stringstream ss;
-    for (size_t i = 0; i < hist_.size(); ++i) {
-        ss << std::exp(pmf(i*binSize_));
-        if (i != hist_.size() - 1) { ss << '\t'; }
+    auto snap = snapshot();
+    for (size_t i = 0; i < numBins_; ++i) {
+        ss << std::exp(snap->pmf(i*binSize_));
+        if (i != numBins_ - 1) { ss << '\t'; }
     }
     ss << "\n";
     return ss.str();
@@ -1,9 +1,15 @@
+#include <atomic>
 #include <ctime>
 #include <fstream>
 
 #include "cereal/archives/json.hpp"
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/task_scheduler_init.h"
+
 #include "DistributionUtils.hpp"
+#include "EquivClassFile.hpp"
 #include "GZipWriter.hpp"
 #include "SalmonOpts.hpp"
 #include "ReadExperiment.hpp"
@@ -47,11 +53,73 @@ bool writeVectorToFile(boost::filesystem::path path,
     return true;
 }
 
+/**
+ * Write the equivalence class information to the binary file (path);
+ * see EquivClassFile.hpp for the format.  Blocks of classes are encoded and
+ * compressed in parallel, a bounded number at a time, and then written in
+ * order.
+ */
+template <typename ExpT>
+bool writeEquivCountsBinary(const boost::filesystem::path& path,
+                            const SalmonOpts& opts, ExpT& experiment) {
+  namespace eqc = salmon::eqclass;
+
+  auto& transcripts = experiment.transcripts();
+  std::vector<std::pair<const TranscriptGroup, TGValue>>& eqVec =
+        experiment.equivalenceClassBuilder().eqVec();
+  bool dumpRichWeights = opts.dumpEqWeights;
+
+  std::ofstream out(path.string(), std::ios::binary);
+  std::vector<std::string> names;
+  names.reserve(transcripts.size());
+  for (auto& t : transcripts) { names.push_back(t.RefName); }
+  if (!eqc::writeHeader(out, names, eqVec.size(), dumpRichWeights)) {
+    return false;
+  }
+
+  size_t numBlocks = (eqVec.size() + eqc::classesPerBlock - 1) / eqc::classesPerBlock;
+  size_t blocksPerRound = 4 * std::max(opts.numThreads, 1u);
+  std::vector<std::string> blocks(blocksPerRound);
+  std::atomic<bool> ok{true};
+  tbb::task_scheduler_init tbbScheduler(std::max(opts.numThreads, 1u));
+  for (size_t firstBlock = 0; firstBlock < numBlocks; firstBlock += blocksPerRound) {
+    size_t lastBlock = std::min(numBlocks, firstBlock + blocksPerRound);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(firstBlock, lastBlock),
+        [&](const tbb::blocked_range<size_t>& range) -> void {
+          std::string raw;
+          for (size_t b = range.begin(); b < range.end(); ++b) {
+            size_t start = b * eqc::classesPerBlock;
+            size_t end = std::min(eqVec.size(), start + eqc::classesPerBlock);
+            raw.clear();
+            for (size_t i = start; i < end; ++i) {
+              auto& eq = eqVec[i];
+              const std::vector<uint32_t>& txps = eq.first.txps;
+              const double* weights =
+                  dumpRichWeights ? eq.second.combinedWeights.data() : nullptr;
+              eqc::encodeClass(raw, txps.data(), txps.size(), weights,
+                               eq.second.count);
+            }
+            auto& block = blocks[b - firstBlock];
+            block.clear();
+            if (!eqc::compressBlock(raw, end - start, block)) { ok = false; }
+          }
+        });
+    for (size_t b = firstBlock; b < lastBlock; ++b) {
+      auto& block = blocks[b - firstBlock];
+      out.write(block.data(), block.size());
+    }
+  }
+  out.close();
+  return ok and out.good();
+}
+
 /**
  * Write the equivalence class information to file.
  * The header will contain the transcript / target ids in
  * a fixed order, then each equivalence class will consist
- * of a line / row.
+ * of a line / row.  With --dumpEqFormat binary, the classes are
+ * instead written in the binary format of EquivClassFile.hpp.
  */
 template <typename ExpT>
 bool GZipWriter::writeEquivCounts(
@@ -62,6 +130,17 @@ bool GZipWriter::writeEquivCounts(
 
   bfs::path auxDir = path_ / opts.auxDir;
   bool auxSuccess = boost::filesystem::create_directories(auxDir);
+
+  if (opts.dumpEqFormat == "binary") {
+    bfs::path eqFilePath = auxDir / "eq_classes.bin";
+    bool wrote = writeEquivCountsBinary(eqFilePath, opts, experiment);
+    if (!wrote) {
+      logger_->error("Failed to write the equivalence classes to {}",
+                     eqFilePath.string());
+    }
+    return wrote;
+  }
+
   bfs::path eqFilePath = auxDir / "eq_classes.txt";
 
   std::ofstream equivFile(eqFilePath.string());
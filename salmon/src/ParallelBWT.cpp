@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "tbb/blocked_range.h"
+#include "tbb/combinable.h"
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+#include "tbb/task_scheduler_init.h"
+
+extern "C" {
+#include "bntseq.h"
+#include "bwt.h"
+#include "utils.h"
+int bwa_index(int argc, char* argv[]);
+}
+
+#include "ParallelBWT.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * The text, 32 bases to a word (most significant bits first), with zeros
+ * after the end.
+ */
+class PackedText {
+public:
+  PackedText(const uint8_t* pac, uint64_t n) : n_(n), words_((n >> 5) + 2, 0) {
+    uint64_t pacLen = (n + 3) >> 2;
+    tbb::parallel_for(
+        tbb::blocked_range<uint64_t>(0, (n + 31) >> 5),
+        [&](const tbb::blocked_range<uint64_t>& r) {
+          for (uint64_t w = r.begin(); w != r.end(); ++w) {
+            uint64_t word{0};
+            for (uint64_t b = 0; b < 8; ++b) {
+              uint64_t i = (w << 3) + b;
+              word = (word << 8) | ((i < pacLen) ? pac[i] : 0);
+            }
+            words_[w] = word;
+          }
+        });
+    // Clear anything after the end of the text in its last word
+    if (n & 31) {
+      words_[n >> 5] &= ~uint64_t(0) << (64 - ((n & 31) << 1));
+    }
+  }
+
+  uint64_t size() const { return n_; }
+
+  // The (up to) 32 bases starting at i
+  inline uint64_t word(uint64_t i) const {
+    uint64_t w = i >> 5;
+    uint32_t s = (i & 31) << 1;
+    return (s == 0) ? words_[w] : ((words_[w] << s) | (words_[w + 1] >> (64 - s)));
+  }
+
+  inline uint8_t at(uint64_t i) const {
+    return (words_[i >> 5] >> (62 - ((i & 31) << 1))) & 3;
+  }
+
+private:
+  uint64_t n_;
+  std::vector<uint64_t> words_;
+};
+
+// Thrown when two suffixes share a prefix longer than SuffixLess::maxDepth
+struct DeepRepeat {};
+
+/**
+ * Orders suffixes that are known to share their first `skip` bases (those
+ * in the same bucket).  A suffix that is a prefix of another is the smaller
+ * one, as though the text were terminated by a '$'.
+ *
+ * Comparing two suffixes costs time proportional to the length of their
+ * common prefix, so texts with very long repeats (e.g. a megabase of A's)
+ * would take quadratic time; rather than that, this gives up (by throwing
+ * DeepRepeat) once two suffixes agree on their first maxDepth bases.  No
+ * transcript is nearly that long.
+ */
+struct SuffixLess {
+  static constexpr uint64_t maxDepth{uint64_t(1) << 18};
+
+  const PackedText& text;
+  uint32_t skip;
+
+  inline bool operator()(uint64_t a, uint64_t b) const {
+    uint64_t n = text.size();
+    uint64_t la = n - a;
+    uint64_t lb = n - b;
+    if (la <= skip or lb <= skip) { return la < lb; }
+    for (uint64_t d = skip;; d += 32) {
+      uint64_t ra = la - d;
+      uint64_t rb = lb - d;
+      uint64_t wa = text.word(a + d);
+      uint64_t wb = text.word(b + d);
+      if (wa != wb) {
+        // The first differing base decides, unless one of the suffixes
+        // ends before it.
+        uint64_t firstDiff = __builtin_clzll(wa ^ wb) >> 1;
+        if (firstDiff < ra and firstDiff < rb) { return wa < wb; }
+        return ra < rb;
+      }
+      if (ra <= 32 or rb <= 32) { return ra < rb; }
+      if (d >= maxDepth) { throw DeepRepeat(); }
+    }
+  }
+};
+constexpr uint64_t SuffixLess::maxDepth;
+
+// The BWT, one 2-bit row at a time, 16 rows to a word (most significant
+// bits first, as in bwt_t::bwt); rows may be set concurrently.
+class PackedRows {
+public:
+  explicit PackedRows(uint64_t numRows) : words_((numRows + 15) >> 4, 0) {}
+
+  inline void set(uint64_t r, uint8_t c) {
+    if (c != 0) {
+      __atomic_fetch_or(&words_[r >> 4], uint32_t(c) << ((15 - (r & 15)) << 1),
+                        __ATOMIC_RELAXED);
+    }
+  }
+  inline uint8_t at(uint64_t r) const {
+    return (words_[r >> 4] >> ((15 - (r & 15)) << 1)) & 3;
+  }
+
+private:
+  std::vector<uint32_t> words_;
+};
+
+}
+
+namespace salmon {
+namespace fmd {
+
+bwt_t* buildBWT(const uint8_t* pac, uint64_t seqLen, int saInterval,
+                spdlog::logger* log, uint64_t maxRoundSuffixes) {
+  using BlockedRange = tbb::blocked_range<uint64_t>;
+  uint64_t n = seqLen;
+  auto start = Clock::now();
+
+  bwt_t* bwt = static_cast<bwt_t*>(calloc(1, sizeof(bwt_t)));
+  bwt->seq_len = n;
+  bwt->bwt_size = (n + 15) >> 4;
+  bwt->sa_intv = saInterval;
+  bwt->n_sa = (n + saInterval) / saInterval;
+  bwt->sa = static_cast<bwtint_t*>(calloc(bwt->n_sa, sizeof(bwtint_t)));
+  bwt->bwt = static_cast<uint32_t*>(calloc(bwt->bwt_size, 4));
+
+  PackedText text(pac, n);
+
+  // Bucket the suffixes by their first q bases (~64 suffixes per bucket)
+  uint32_t q{4};
+  while (q < 12 and (uint64_t(1) << (2 * q + 6)) < n) { ++q; }
+  uint32_t keyShift = 64 - 2 * q;
+  uint64_t numBuckets = uint64_t(1) << (2 * q);
+
+  tbb::combinable<std::vector<uint64_t>> localCounts(
+      [numBuckets]() { return std::vector<uint64_t>(numBuckets, 0); });
+  tbb::combinable<std::array<uint64_t, 4>> localBaseCounts(
+      []() { return std::array<uint64_t, 4>{{0, 0, 0, 0}}; });
+  tbb::parallel_for(BlockedRange(0, n), [&](const BlockedRange& r) {
+    auto& counts = localCounts.local();
+    auto& baseCounts = localBaseCounts.local();
+    for (uint64_t p = r.begin(); p != r.end(); ++p) {
+      ++counts[text.word(p) >> keyShift];
+      ++baseCounts[text.at(p)];
+    }
+  });
+  // bucketStart[k] is the rank, among all suffixes, of the first in bucket k
+  std::vector<uint64_t> bucketStart(numBuckets + 1, 0);
+  localCounts.combine_each([&](const std::vector<uint64_t>& counts) {
+    for (uint64_t k = 0; k < numBuckets; ++k) { bucketStart[k + 1] += counts[k]; }
+  });
+  for (uint64_t k = 0; k < numBuckets; ++k) { bucketStart[k + 1] += bucketStart[k]; }
+
+  bwt->L2[0] = 0;
+  localBaseCounts.combine_each([&](const std::array<uint64_t, 4>& counts) {
+    for (size_t c = 0; c < 4; ++c) { bwt->L2[c + 1] += counts[c]; }
+  });
+  for (size_t c = 2; c <= 4; ++c) { bwt->L2[c] += bwt->L2[c - 1]; }
+
+  if (log) {
+    log->info("[BWT] counted {} suffixes into {} buckets in {:.2f} s", n,
+              numBuckets, secondsSince(start));
+  }
+
+  // Row 0 of the (n + 1)-row matrix is the empty suffix ($); the suffixes
+  // of the text are rows 1 to n, in order.
+  PackedRows rows(n + 1);
+  std::atomic<uint64_t> primary{0};
+  if (n > 0) { rows.set(0, text.at(n - 1)); }
+
+  std::vector<uint64_t> positions;
+  uint64_t firstBucket{0};
+  uint32_t round{0};
+  while (firstBucket < numBuckets) {
+    auto roundStart = Clock::now();
+    // Take as many buckets as fit (but at least one)
+    uint64_t lastBucket = firstBucket + 1;
+    while (lastBucket < numBuckets and
+           bucketStart[lastBucket + 1] - bucketStart[firstBucket] <= maxRoundSuffixes) {
+      ++lastBucket;
+    }
+    uint64_t roundBase = bucketStart[firstBucket];
+    uint64_t roundSize = bucketStart[lastBucket] - roundBase;
+    uint64_t keyBegin = firstBucket;
+    uint64_t keyEnd = lastBucket;
+
+    // Gather the suffixes of this round's buckets
+    positions.resize(roundSize);
+    std::vector<std::atomic<uint64_t>> cursor(lastBucket - firstBucket);
+    for (uint64_t k = firstBucket; k < lastBucket; ++k) {
+      cursor[k - firstBucket] = bucketStart[k] - roundBase;
+    }
+    tbb::parallel_for(BlockedRange(0, n), [&](const BlockedRange& r) {
+      for (uint64_t p = r.begin(); p != r.end(); ++p) {
+        uint64_t key = text.word(p) >> keyShift;
+        if (key >= keyBegin and key < keyEnd) {
+          positions[cursor[key - keyBegin].fetch_add(1, std::memory_order_relaxed)] = p;
+        }
+      }
+    });
+
+    // Sort each bucket; large ones are sorted in parallel themselves
+    SuffixLess less{text, q};
+    try {
+      tbb::parallel_for(
+          BlockedRange(firstBucket, lastBucket),
+          [&](const BlockedRange& r) {
+            for (uint64_t k = r.begin(); k != r.end(); ++k) {
+              auto first = positions.begin() + (bucketStart[k] - roundBase);
+              auto last = positions.begin() + (bucketStart[k + 1] - roundBase);
+              if (last - first > (1 << 16)) {
+                tbb::parallel_sort(first, last, less);
+              } else {
+                std::sort(first, last, less);
+              }
+            }
+          });
+    } catch (const DeepRepeat&) {
+      if (log) {
+        log->warn("[BWT] the text has a repeat longer than {} bases; giving up",
+                  SuffixLess::maxDepth);
+      }
+      free(bwt->bwt);
+      free(bwt->sa);
+      free(bwt);
+      return nullptr;
+    }
+
+    // Emit the BWT (the base preceding each suffix) and the SA samples
+    tbb::parallel_for(BlockedRange(0, roundSize), [&](const BlockedRange& r) {
+      for (uint64_t i = r.begin(); i != r.end(); ++i) {
+        uint64_t p = positions[i];
+        uint64_t row = 1 + roundBase + i;
+        if (p == 0) {
+          primary = row;
+        } else {
+          rows.set(row, text.at(p - 1));
+        }
+        if (row % saInterval == 0) { bwt->sa[row / saInterval] = p; }
+      }
+    });
+
+    if (log) {
+      log->info("[BWT] round {}: sorted {} suffixes in {:.2f} s", round, roundSize,
+                secondsSince(roundStart));
+    }
+    firstBucket = lastBucket;
+    ++round;
+  }
+  std::vector<uint64_t>().swap(positions);
+
+  // The BWT leaves out the primary row (that of the whole text, which is
+  // preceded by the '$')
+  bwt->primary = primary;
+  uint64_t prim = primary;
+  tbb::parallel_for(BlockedRange(0, bwt->bwt_size), [&](const BlockedRange& r) {
+    for (uint64_t w = r.begin(); w != r.end(); ++w) {
+      uint32_t word{0};
+      for (uint64_t i = w << 4; i < std::min((w + 1) << 4, n); ++i) {
+        uint64_t row = (i < prim) ? i : i + 1;
+        word |= uint32_t(rows.at(row)) << ((15 - (i & 15)) << 1);
+      }
+      bwt->bwt[w] = word;
+    }
+  });
+  // As bwt_cal_sa leaves it
+  bwt->sa[0] = static_cast<bwtint_t>(-1);
+
+  if (log) {
+    log->info("[BWT] built the BWT and SA samples of {} bases in {:.2f} s", n,
+              secondsSince(start));
+  }
+  return bwt;
+}
+
+int buildIndex(const std::string& fastaFile, const std::string& prefix,
+               int saInterval, uint32_t numThreads,
+               std::shared_ptr<spdlog::logger> log) {
+  if (saInterval <= 0 or (saInterval & (saInterval - 1)) != 0) {
+    log->critical("The SA sample interval must be a power of 2, but was {}", saInterval);
+    return 1;
+  }
+  std::string interval = std::to_string(saInterval);
+  char* bwaArgv[] = {const_cast<char*>("index"), const_cast<char*>("-s"),
+                     const_cast<char*>(interval.c_str()), const_cast<char*>("-p"),
+                     const_cast<char*>(prefix.c_str()),
+                     const_cast<char*>(fastaFile.c_str())};
+  // With a single thread, BWA's own (linear-time) construction is faster
+  if (numThreads <= 1) { return bwa_index(6, bwaArgv); }
+
+  tbb::task_scheduler_init tbbScheduler(numThreads);
+  auto start = Clock::now();
+  std::string pacFile = prefix + ".pac";
+  std::string bwtFile = prefix + ".bwt";
+  std::string saFile = prefix + ".sa";
+
+  {
+    auto t = Clock::now();
+    gzFile fp = xzopen(fastaFile.c_str(), "r");
+    bns_fasta2bntseq(fp, prefix.c_str(), 0);
+    err_gzclose(fp);
+    log->info("[FMD index] packed the FASTA in {:.2f} s", secondsSince(t));
+  }
+
+  bwt_t* bwt{nullptr};
+  {
+    // The sequence length is recorded in the .pac file's last byte, as the
+    // number of bases in the last (partial) byte before it.
+    std::ifstream pacStream(pacFile, std::ios::binary);
+    std::vector<uint8_t> pac((std::istreambuf_iterator<char>(pacStream)),
+                             std::istreambuf_iterator<char>());
+    if (pac.size() < 2) {
+      log->critical("Could not read the packed sequence {}", pacFile);
+      return 1;
+    }
+    uint64_t seqLen = (pac.size() - 2) * 4 + pac.back();
+    auto t = Clock::now();
+    bwt = buildBWT(pac.data(), seqLen, saInterval, log.get());
+    if (bwt == nullptr) {
+      // Leave texts with very long repeats to BWA's own construction
+      log->warn("[FMD index] falling back to single-threaded BWT construction");
+      return bwa_index(6, bwaArgv);
+    }
+    log->info("[FMD index] constructed the BWT and SA of {} bases with {} threads in {:.2f} s",
+              seqLen, numThreads, secondsSince(t));
+  }
+
+  {
+    auto t = Clock::now();
+    bwt_bwtupdate_core(bwt);
+    bwt_dump_bwt(bwtFile.c_str(), bwt);
+    log->info("[FMD index] added occurrence counts in {:.2f} s", secondsSince(t));
+  }
+
+  {
+    auto t = Clock::now();
+    gzFile fp = xzopen(fastaFile.c_str(), "r");
+    bns_fasta2bntseq(fp, prefix.c_str(), 1);
+    err_gzclose(fp);
+    log->info("[FMD index] packed the forward-only FASTA in {:.2f} s", secondsSince(t));
+  }
+
+  bwt_dump_sa(saFile.c_str(), bwt);
+  bwt_destroy(bwt);
+  log->info("[FMD index] done in {:.2f} s", secondsSince(start));
+  return 0;
+}
+
+} // namespace fmd
+} // namespace salmon
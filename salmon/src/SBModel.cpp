@@ -104,8 +104,11 @@ double SBModel::evaluateLog(const char* seqIn) {
 }
 
 double SBModel::evaluateLog(const Mer& mer) {
-    double p = 0;
+    if (!_logTable.empty()) {
+      return _logTable[packedContext(mer)];
+    }
 
+    double p = 0;
     for (int32_t i = 0; i < _contextLength; ++i) {
         uint64_t idx = mer.get_bits(_shifts[i], _widths[i]);
         p += _probs(idx, i);
@@ -113,6 +116,25 @@ double SBModel::evaluateLog(const Mer& mer) {
     return p;
 }
 
+/**
+ * Fill _logTable with the log-probability of every possible context, so
+ * that evaluating the model is a single lookup rather than a sum over the
+ * context positions.  The sub-context of position i is bits
+ * [_shifts[i], _shifts[i] + _widths[i]) of the packed context.
+ **/
+void SBModel::_compileLogTable() {
+  size_t numContexts = constExprPow(4, _contextLength);
+  _logTable.assign(numContexts, 0.0);
+  for (int32_t i = 0; i < _contextLength; ++i) {
+    uint64_t mask = (1ULL << _widths[i]) - 1;
+    int32_t shift = _shifts[i];
+    auto col = _probs.col(i);
+    for (uint64_t ctx = 0; ctx < numContexts; ++ctx) {
+      _logTable[ctx] += col((ctx >> shift) & mask);
+    }
+  }
+}
+
  
 /** inlined member functions 
 
@@ -212,6 +234,7 @@ bool SBModel::normalize() {
     return (x > 0.0) ? std::log(x) : logSmall;
   };
   _probs = _probs.unaryExpr(takeLog);
+  _compileLogTable();
   _trained = true;
   return true;
 }
@@ -58,6 +58,7 @@ int help(std::vector<std::string> opts) { //}int argc, char* argv[]) {
     helpMsg.write("Commands:\n");
     helpMsg.write("     index Create a salmon index\n");
     helpMsg.write("     quant Quantify a sample\n");
+    helpMsg.write("     eqconvert Convert binary equivalence classes to text\n");
     helpMsg.write("     swim  Perform super-secret operation\n");
     //helpMsg.write("     quantmerge Merge multiple quantifications into a single file\n");
 
@@ -152,6 +153,7 @@ int salmonIndex(int argc, char* argv[]);
 int salmonQuantify(int argc, char* argv[]);
 int salmonAlignmentQuantify(int argc, char* argv[]);
 int salmonQuantMerge(int argc, char* argv[]);
+int salmonEqConvert(int argc, char* argv[]);
 
 bool verbose = false;
 
@@ -221,6 +223,7 @@ int main( int argc, char* argv[] ) {
       {"index", salmonIndex},
       {"quant", salmonQuantify},
       {"quantmerge", salmonQuantMerge},
+      {"eqconvert", salmonEqConvert},
       {"swim", salmonSwim}
     });
 
@@ -0,0 +1,147 @@
+/**
+>HEADER
+    Copyright (c) 2013, 2014, 2015, 2016, 2017 Rob Patro rob.patro@cs.stonybrook.edu
+
+    This file is part of Salmon.
+
+    Salmon is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Salmon is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Salmon.  If not, see <http://www.gnu.org/licenses/>.
+<HEADER
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+// C++ string formatting library
+#include "spdlog/fmt/fmt.h"
+// logger includes
+#include "spdlog/spdlog.h"
+
+#include "EquivClassFile.hpp"
+
+/**
+ * Convert the binary equivalence class file `inputName` (eq_classes.bin)
+ * into the text format of eq_classes.txt, written to `outputName`.
+ */
+bool convertEquivClasses(const std::string& inputName,
+                         const std::string& outputName,
+                         std::shared_ptr<spdlog::logger> log) {
+  namespace eqc = salmon::eqclass;
+  eqc::EquivClassReader reader(inputName);
+  if (!reader.good()) {
+    log->critical("Could not read {}: {}", inputName, reader.error());
+    return false;
+  }
+
+  std::ofstream out(outputName);
+  if (!out.good()) {
+    log->critical("Could not open {} for writing", outputName);
+    return false;
+  }
+
+  fmt::MemoryWriter w;
+  w << reader.numTranscripts() << '\n' << reader.numClasses() << '\n';
+  for (auto& n : reader.transcriptNames()) {
+    w << n << '\n';
+  }
+
+  eqc::EquivClass ec;
+  size_t numWritten{0};
+  while (reader.next(ec)) {
+    w << ec.txps.size() << '\t';
+    for (auto tid : ec.txps) { w << tid << '\t'; }
+    for (auto wt : ec.weights) { w.write("{:g}\t", wt); }
+    w << ec.count << '\n';
+    ++numWritten;
+    // Flush the buffer periodically
+    if (w.size() > (1 << 20)) {
+      out.write(w.data(), w.size());
+      w.clear();
+    }
+  }
+  out.write(w.data(), w.size());
+
+  if (!reader.good()) {
+    log->critical("Error reading {}: {}", inputName, reader.error());
+    return false;
+  }
+  log->info("converted {} equivalence classes", numWritten);
+  return out.good();
+}
+
+int salmonEqConvert(int argc, char* argv[]) {
+  using std::string;
+  namespace po = boost::program_options;
+
+  string inputName;
+  string outputName;
+  po::options_description generic("\n"
+                                  "basic options");
+  generic.add_options()("version,v", "print version string")
+    (
+      "help,h", "produce help message")
+    (
+      "input,i", po::value<string>(&inputName)->required(),
+      "Binary equivalence class file (eq_classes.bin) to convert.")
+    (
+      "output,o", po::value<string>(&outputName)->required(),
+      "Output (text) equivalence class file.");
+
+  po::options_description all("salmon eqconvert options");
+  all.add(generic);
+
+  po::variables_map vm;
+  try {
+    auto orderedOptions =
+        po::command_line_parser(argc, argv).options(all).run();
+
+    po::store(orderedOptions, vm);
+
+    if (vm.count("help")) {
+      auto hstring = R"(
+eqconvert
+=========
+Convert a binary equivalence class file (written with
+--dumpEq --dumpEqFormat binary) into the text format.
+)";
+      std::cerr << hstring << std::endl;
+      std::cerr << all << std::endl;
+      std::exit(0);
+    }
+
+    po::notify(vm);
+
+    auto consoleSink = std::make_shared<spdlog::sinks::ansicolor_stdout_sink_mt>();
+    auto consoleLog = spdlog::create("eqConvertLog", {consoleSink});
+
+    if (!convertEquivClasses(inputName, outputName, consoleLog)) {
+      std::exit(1);
+    }
+
+  } catch (po::error& e) {
+    std::cerr << "Exception : [" << e.what() << "]. Exiting.\n";
+    std::exit(1);
+  } catch (const spdlog::spdlog_ex& ex) {
+    std::cerr << "logger failed with : [" << ex.what() << "]. Exiting.\n";
+    std::exit(1);
+  } catch (std::exception& e) {
+    std::cerr << "Exception : [" << e.what() << "]\n";
+    std::cerr << argv[0] << " eqconvert was invoked improperly.\n";
+    std::cerr << "For usage information, try " << argv[0]
+              << " eqconvert --help\nExiting.\n";
+    std::exit(1);
+  }
+
+  return 0;
+}
@@ -19,15 +19,29 @@
 <HEADER
 **/
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
-// C++ string formatting library #include "spdlog/fmt/fmt.h"
+
+#include "tbb/parallel_for.h"
+#include "tbb/task_scheduler_init.h"
+
+// C++ string formatting library
+#include "spdlog/fmt/fmt.h"
 // logger includes
 #include "spdlog/spdlog.h"
 
+#include "QuantFileParser.hpp"
+
 enum class TargetColumn {LEN, ELEN, TPM, NREADS};
 
 class QuantMergeOptions {
@@ -36,6 +50,8 @@ public:
   std::vector<std::string> names;
   std::string outputName;
   std::string outputCol;
+  std::string outputFormat;
+  uint32_t numThreads;
   std::shared_ptr<spdlog::logger> log;
   TargetColumn tcol;
 
@@ -55,6 +71,7 @@ public:
       log->info("sample names : [ {} ]", nlist);
     }
     log->info("output column : {}", outputCol);
+    log->info("output format : {}", outputFormat);
     log->info("output file : {}", outputName);
   }
 };
@@ -102,94 +119,449 @@ bool validateOptions(boost::program_options::variables_map& vm,
     std::exit(1);
   }
 
+  if (qmOpts.outputFormat != "text" and qmOpts.outputFormat != "binary") {
+    qmOpts.log->critical("The output format should be one of {{text, binary}}, "
+                         "but {} was given.", qmOpts.outputFormat);
+    std::exit(1);
+  }
+  if (qmOpts.numThreads == 0) { qmOpts.numThreads = 1; }
+
   return true;
 }
 
-struct ExpressionRecord {
-  uint32_t snum;
-  uint32_t len;
-  double effectiveLen;
-  double tpm;
-  double numReads;
+/**
+ * The layout of the merged matrix: one row per target, one column per
+ * sample.  Only the requested column of each quant.sf is used.  Missing
+ * entries are NaN.
+ *
+ * Every quant.sf written by salmon against the same index lists the targets
+ * in the same order, so the first sample fixes the row order, and a sample
+ * whose targets are exactly (a prefix of) those rows is "aligned".  The
+ * values of aligned samples aren't kept; they are streamed from the files,
+ * a block of rows at a time, as the output is written (see MergedRowReader).
+ * Only the other samples (e.g. those quantified against another index) have
+ * their whole column held in memory.
+ */
+struct MergedQuants {
+  std::vector<std::string> quantFiles;
+  // The targets of the first sample, then those that only appear later
+  std::vector<std::string> rowNames;
+  size_t numSharedRows{0};
+  // The whole column of each sample that isn't aligned (empty if it is)
+  std::vector<std::vector<double>> storedColumns;
+  size_t numStoredColumns{0};
 };
 
-bool doMerge(QuantMergeOptions& qmOpts) {
-  std::unordered_map<std::string, std::vector<ExpressionRecord>> recs;
-  for (uint32_t n = 0; n < qmOpts.samples.size(); ++n) {
+inline double selectColumn(const salmon::quantfile::QuantRecord& rec,
+                           TargetColumn tcol) {
+  switch (tcol) {
+  case TargetColumn::LEN:
+    return rec.len;
+  case TargetColumn::ELEN:
+    return rec.effectiveLen;
+  case TargetColumn::TPM:
+    return rec.tpm;
+  case TargetColumn::NREADS:
+    return rec.numReads;
+  }
+  return rec.tpm;
+}
+
+/**
+ * Scan every sample's quant.sf, in parallel, to lay out the merged matrix.
+ *
+ * The first sample defines the rows.  Each other sample is compared to them
+ * positionally (by comparing names in place); at the first target that isn't
+ * in its expected row, the sample is re-read into a stored column, looking
+ * its targets up by name (the name -> row table for this is only built if
+ * some sample needs it).  Targets that don't appear in the first sample are
+ * appended as new rows.
+ */
+bool parseSamples(QuantMergeOptions& qmOpts, MergedQuants& merged) {
+  namespace qf = salmon::quantfile;
+  constexpr double missing = std::numeric_limits<double>::quiet_NaN();
+  size_t numSamples = qmOpts.samples.size();
+  merged.quantFiles.resize(numSamples);
+  for (size_t n = 0; n < numSamples; ++n) {
     auto& sampDir = qmOpts.samples[n];
     auto quantFile = boost::filesystem::path(sampDir) / "quant.sf";
-    if (boost::filesystem::exists(quantFile) and boost::filesystem::is_regular_file(quantFile)) {
-      qmOpts.log->info("Parsing {}", quantFile.string());
-      std::ifstream ifile(quantFile.string());
-      std::string header;
-      std::getline(ifile, header);
-      std::string targetName;
-      uint32_t len;
-      double effectiveLen, tpm, numReads;
-      while (ifile >> targetName >> len >> effectiveLen >> tpm >> numReads) {
-        recs[targetName].push_back({n, len, effectiveLen, tpm, numReads});
-      }
-      ifile.close();
-    } else {
+    if (!boost::filesystem::exists(quantFile) or
+        !boost::filesystem::is_regular_file(quantFile)) {
       qmOpts.log->critical("The sample directory {} either doesn't exist, "
                            "or doesn't contain a quant.sf file", sampDir);
       return false;
     }
+    merged.quantFiles[n] = quantFile.string();
   }
 
-  auto outputPath = boost::filesystem::absolute(boost::filesystem::path(qmOpts.outputName)).parent_path();
-  if (!boost::filesystem::exists(outputPath)) {
-    if (!boost::filesystem::create_directories(outputPath)) {
-      qmOpts.log->critical("Couldn't create output path {}", outputPath.string());
-      std::exit(1);
+  // The first sample defines the rows
+  {
+    qf::MappedFile mf(merged.quantFiles[0]);
+    if (!mf.good()) {
+      qmOpts.log->critical("Couldn't read {}", merged.quantFiles[0]);
+      return false;
+    }
+    qf::QuantFileParser parser(mf.begin(), mf.end());
+    qf::QuantRecord rec;
+    while (parser.next(rec)) {
+      merged.rowNames.emplace_back(rec.name, rec.nameLen);
+    }
+    if (parser.error()) {
+      qmOpts.log->critical("Malformed record in {}", merged.quantFiles[0]);
+      return false;
     }
   }
+  size_t numRows = merged.rowNames.size();
+  merged.numSharedRows = numRows;
+  merged.storedColumns.resize(numSamples);
+
+  std::unordered_map<std::string, uint32_t> rowIndex;
+  std::once_flag rowIndexBuilt;
+  auto buildRowIndex = [&]() {
+    rowIndex.reserve(numRows);
+    for (size_t i = 0; i < numRows; ++i) {
+      rowIndex.emplace(merged.rowNames[i], i);
+    }
+  };
+
+  // The (name, value) pairs of each sample's targets that aren't rows
+  std::vector<std::vector<std::pair<std::string, double>>> extras(numSamples);
+  std::vector<uint8_t> failed(numSamples, 0);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(1, numSamples, 1),
+      [&](const tbb::blocked_range<size_t>& range) {
+        qf::QuantRecord rec;
+        for (size_t n = range.begin(); n < range.end(); ++n) {
+          qf::MappedFile mf(merged.quantFiles[n]);
+          if (!mf.good()) {
+            failed[n] = 1;
+            continue;
+          }
+          // Is every target in its expected row?
+          qf::QuantFileParser parser(mf.begin(), mf.end());
+          size_t i{0};
+          bool aligned{true};
+          while (aligned and parser.next(rec)) {
+            aligned = (i < numRows and merged.rowNames[i].size() == rec.nameLen and
+                       std::memcmp(merged.rowNames[i].data(), rec.name, rec.nameLen) == 0);
+            ++i;
+          }
+          if (parser.error()) {
+            failed[n] = 2;
+            continue;
+          }
+          if (aligned) { continue; }
+
+          // If not, read the sample again, into a stored column
+          std::call_once(rowIndexBuilt, buildRowIndex);
+          auto& col = merged.storedColumns[n];
+          col.assign(numRows, missing);
+          parser = qf::QuantFileParser(mf.begin(), mf.end());
+          i = 0;
+          while (parser.next(rec)) {
+            double v = selectColumn(rec, qmOpts.tcol);
+            if (i < numRows and merged.rowNames[i].size() == rec.nameLen and
+                std::memcmp(merged.rowNames[i].data(), rec.name, rec.nameLen) == 0) {
+              col[i] = v;
+            } else {
+              std::string name(rec.name, rec.nameLen);
+              auto it = rowIndex.find(name);
+              if (it != rowIndex.end()) {
+                col[it->second] = v;
+              } else {
+                extras[n].emplace_back(std::move(name), v);
+              }
+            }
+            ++i;
+          }
+        }
+      });
+  for (size_t n = 1; n < numSamples; ++n) {
+    if (failed[n]) {
+      qmOpts.log->critical("{} {}", (failed[n] == 1) ? "Couldn't read" : "Malformed record in",
+                           merged.quantFiles[n]);
+      return false;
+    }
+    if (!merged.storedColumns[n].empty()) { ++merged.numStoredColumns; }
+  }
 
-  size_t missingValues{0};
-  // Now, the path exists
-  std::ofstream outFile(qmOpts.outputName);
-  if (!outFile.is_open()) {
+  // Append the targets missing from the first sample, in order of appearance
+  std::unordered_map<std::string, uint32_t> extraIndex;
+  for (auto& ex : extras) {
+    for (auto& kv : ex) {
+      if (extraIndex.find(kv.first) == extraIndex.end()) {
+        extraIndex.emplace(kv.first, merged.rowNames.size());
+        merged.rowNames.push_back(kv.first);
+      }
+    }
+  }
+  if (!extraIndex.empty()) {
+    size_t totalRows = merged.rowNames.size();
+    for (size_t n = 0; n < numSamples; ++n) {
+      if (merged.storedColumns[n].empty()) { continue; }
+      merged.storedColumns[n].resize(totalRows, missing);
+      for (auto& kv : extras[n]) {
+        merged.storedColumns[n][extraIndex[kv.first]] = kv.second;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Reads the merged matrix a block of rows at a time, with the samples in
+ * parallel.  Each aligned sample's quant.sf stays mapped, and is parsed
+ * just far enough for each block; the pages already parsed are released, so
+ * that only about a block's worth of each file is resident at once.
+ */
+class MergedRowReader {
+public:
+  MergedRowReader(QuantMergeOptions& qmOpts, const MergedQuants& merged)
+      : qmOpts_(qmOpts), merged_(merged), files_(merged.quantFiles.size()),
+        parsers_(merged.quantFiles.size()) {
+    for (size_t n = 0; n < files_.size(); ++n) {
+      if (!merged_.storedColumns[n].empty()) { continue; }
+      files_[n].reset(new salmon::quantfile::MappedFile(merged_.quantFiles[n]));
+      if (!files_[n]->good()) {
+        qmOpts_.log->critical("Couldn't read {}", merged_.quantFiles[n]);
+        good_ = false;
+        return;
+      }
+      parsers_[n].reset(new salmon::quantfile::QuantFileParser(files_[n]->begin(),
+                                                               files_[n]->end()));
+    }
+  }
+
+  bool good() const { return good_; }
+
+  /**
+   * Read rows [first, first + count) into `block`, one sample after
+   * another (the value of row first + i of sample n is block[n * count + i]).
+   * The blocks must be read in order.
+   */
+  bool read(size_t first, size_t count, std::vector<double>& block) {
+    constexpr double missing = std::numeric_limits<double>::quiet_NaN();
+    size_t numSamples = files_.size();
+    block.assign(numSamples * count, missing);
+    std::vector<uint8_t> failed(numSamples, 0);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, numSamples, 1),
+        [&](const tbb::blocked_range<size_t>& range) {
+          salmon::quantfile::QuantRecord rec;
+          for (size_t n = range.begin(); n < range.end(); ++n) {
+            double* out = block.data() + n * count;
+            auto& col = merged_.storedColumns[n];
+            if (!col.empty()) {
+              std::copy(col.begin() + first, col.begin() + first + count, out);
+              continue;
+            }
+            // An aligned sample has no values beyond the rows it lists
+            size_t end = std::min(first + count, merged_.numSharedRows);
+            auto& parser = *parsers_[n];
+            for (size_t i = first; i < end and parser.next(rec); ++i) {
+              out[i - first] = selectColumn(rec, qmOpts_.tcol);
+            }
+            if (parser.error()) { failed[n] = 1; }
+            // The records read so far won't be needed again
+            files_[n]->release(parser.position());
+          }
+        });
+    for (size_t n = 0; n < numSamples; ++n) {
+      if (failed[n]) {
+        qmOpts_.log->critical("Malformed record in {}", merged_.quantFiles[n]);
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  QuantMergeOptions& qmOpts_;
+  const MergedQuants& merged_;
+  std::vector<std::unique_ptr<salmon::quantfile::MappedFile>> files_;
+  std::vector<std::unique_ptr<salmon::quantfile::QuantFileParser>> parsers_;
+  bool good_{true};
+};
+
+// The number of rows read at a time, so that a block holds ~2^22 values
+size_t rowsPerRead(size_t numSamples) {
+  constexpr size_t valuesPerRead{size_t(1) << 22};
+  return std::max(size_t(1), valuesPerRead / std::max(size_t(1), numSamples));
+}
+
+/**
+ * Write the merged matrix as tab-separated text.  Each block of rows read
+ * is formatted in parallel (in pieces), and the pieces are written out in
+ * order.
+ */
+bool writeMergedText(QuantMergeOptions& qmOpts, MergedQuants& merged,
+                     size_t& missingValues) {
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> outFile(
+      std::fopen(qmOpts.outputName.c_str(), "w"), std::fclose);
+  if (!outFile) {
     qmOpts.log->critical("Couldn't create output file {}", qmOpts.outputName);
-    outFile.close();
     std::exit(1);
   }
 
-  outFile << "Name";
+  fmt::MemoryWriter header;
+  header << "Name";
   for (size_t n = 0; n < qmOpts.samples.size(); ++n) {
-    outFile << '\t' << qmOpts.names[n];
+    header << '\t' << qmOpts.names[n];
   }
-  outFile << '\n';
-
-  for (auto& kv : recs) {
-    auto& trecs = kv.second;
-    outFile << kv.first;
-    uint32_t nextTrec{0};
-    for (uint32_t n = 0; n < qmOpts.samples.size(); ++n) {
-      if (nextTrec < trecs.size() and trecs[nextTrec].snum == n) {
-        switch (qmOpts.tcol) {
-        case TargetColumn::LEN:
-          outFile << '\t' << trecs[nextTrec].len;
-          break;
-        case TargetColumn::ELEN:
-          outFile << '\t' << trecs[nextTrec].effectiveLen;
-          break;
-        case TargetColumn::TPM:
-          outFile << '\t' << trecs[nextTrec].tpm;
-          break;
-        case TargetColumn::NREADS:
-          outFile << '\t' << trecs[nextTrec].numReads;
-          break;
-        }
-        ++nextTrec;
-      } else {
-        ++missingValues;
-        outFile << '\t' << "NA";
-      }
+  header << '\n';
+  std::fwrite(header.data(), 1, header.size(), outFile.get());
+
+  MergedRowReader reader(qmOpts, merged);
+  if (!reader.good()) { return false; }
+
+  constexpr size_t rowsPerPiece{4096};
+  size_t numRows = merged.rowNames.size();
+  size_t numSamples = merged.quantFiles.size();
+  size_t rowsPerBlock = rowsPerRead(numSamples);
+  bool isLength = (qmOpts.tcol == TargetColumn::LEN);
+  std::vector<double> block;
+  std::vector<fmt::MemoryWriter> pieces;
+  std::vector<size_t> pieceMissing;
+  for (size_t first = 0; first < numRows; first += rowsPerBlock) {
+    size_t count = std::min(rowsPerBlock, numRows - first);
+    if (!reader.read(first, count, block)) { return false; }
+    size_t numPieces = (count + rowsPerPiece - 1) / rowsPerPiece;
+    pieces.resize(numPieces);
+    pieceMissing.assign(numPieces, 0);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, numPieces, 1),
+        [&](const tbb::blocked_range<size_t>& range) {
+          for (size_t p = range.begin(); p < range.end(); ++p) {
+            auto& w = pieces[p];
+            w.clear();
+            size_t nmissing{0};
+            size_t rowEnd = std::min(count, (p + 1) * rowsPerPiece);
+            for (size_t i = p * rowsPerPiece; i < rowEnd; ++i) {
+              w << merged.rowNames[first + i];
+              for (size_t n = 0; n < numSamples; ++n) {
+                double v = block[n * count + i];
+                if (std::isnan(v)) {
+                  ++nmissing;
+                  w << "\tNA";
+                } else if (isLength) {
+                  w.write("\t{}", static_cast<uint64_t>(v));
+                } else {
+                  // The same format as the default ostream formatting
+                  w.write("\t{:g}", v);
+                }
+              }
+              w << '\n';
+            }
+            pieceMissing[p] = nmissing;
+          }
+        });
+    for (size_t p = 0; p < numPieces; ++p) {
+      std::fwrite(pieces[p].data(), 1, pieces[p].size(), outFile.get());
+      missingValues += pieceMissing[p];
     }
-    outFile << '\n';
   }
-  outFile.close();
+  if (std::ferror(outFile.get())) {
+    qmOpts.log->critical("Error writing output file {}", qmOpts.outputName);
+    return false;
+  }
+  return true;
+}
 
+/**
+ * Write the merged matrix in binary.  All fixed-width values are
+ * little-endian.
+ *
+ *   magic ("SALMONQM", u64), version (u32), flags (u32, currently 0),
+ *   # rows (u64), # columns (u64),
+ *   the column (sample) names, then the row (target) names, each as its
+ *   length (u32) followed by the name, and
+ *   the values, as float32, one column after another (column-major);
+ *   missing values are NaN.
+ *
+ * The rows are read a block at a time, so each block's piece of every
+ * column is written at that column's offset.
+ */
+bool writeMergedBinary(QuantMergeOptions& qmOpts, MergedQuants& merged,
+                       size_t& missingValues) {
+  constexpr uint64_t magic{0x4d514e4f4d4c4153}; // "SALMONQM"
+  constexpr uint32_t version{1};
+  std::ofstream out(qmOpts.outputName, std::ios::binary);
+  if (!out.is_open()) {
+    qmOpts.log->critical("Couldn't create output file {}", qmOpts.outputName);
+    std::exit(1);
+  }
+  auto writeNames = [&out](const std::vector<std::string>& names) {
+    for (auto& n : names) {
+      uint32_t len = n.size();
+      out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+      out.write(n.data(), len);
+    }
+  };
+  uint32_t flags{0};
+  uint64_t numRows = merged.rowNames.size();
+  uint64_t numCols = merged.quantFiles.size();
+  out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+  out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+  out.write(reinterpret_cast<const char*>(&numRows), sizeof(numRows));
+  out.write(reinterpret_cast<const char*>(&numCols), sizeof(numCols));
+  writeNames(qmOpts.names);
+  writeNames(merged.rowNames);
+  std::streamoff valuesStart = out.tellp();
+
+  MergedRowReader reader(qmOpts, merged);
+  if (!reader.good()) { return false; }
+
+  size_t rowsPerBlock = rowsPerRead(numCols);
+  std::vector<double> block;
+  std::vector<float> buf;
+  for (size_t first = 0; first < numRows; first += rowsPerBlock) {
+    size_t count = std::min<size_t>(rowsPerBlock, numRows - first);
+    if (!reader.read(first, count, block)) { return false; }
+    buf.assign(block.begin(), block.end());
+    for (auto v : buf) { missingValues += std::isnan(v) ? 1 : 0; }
+    for (size_t n = 0; n < numCols; ++n) {
+      out.seekp(valuesStart + static_cast<std::streamoff>((n * numRows + first) * sizeof(float)));
+      out.write(reinterpret_cast<const char*>(buf.data() + n * count), count * sizeof(float));
+    }
+  }
+  if (!out.good()) {
+    qmOpts.log->critical("Error writing output file {}", qmOpts.outputName);
+    return false;
+  }
+  return true;
+}
+
+bool doMerge(QuantMergeOptions& qmOpts) {
+  tbb::task_scheduler_init tbbScheduler(qmOpts.numThreads);
+  auto start = std::chrono::steady_clock::now();
+
+  MergedQuants merged;
+  if (!parseSamples(qmOpts, merged)) { return false; }
+  auto parsed = std::chrono::steady_clock::now();
+  qmOpts.log->info("Parsed {} samples ({} targets) in {:.2f} s",
+                   qmOpts.samples.size(), merged.rowNames.size(),
+                   std::chrono::duration<double>(parsed - start).count());
+  if (merged.numStoredColumns > 0) {
+    qmOpts.log->info("{} samples don't list the targets in the same order as the "
+                     "first one; their values are held in memory",
+                     merged.numStoredColumns);
+  }
+
+  auto outputPath = boost::filesystem::absolute(boost::filesystem::path(qmOpts.outputName)).parent_path();
+  if (!boost::filesystem::exists(outputPath)) {
+    if (!boost::filesystem::create_directories(outputPath)) {
+      qmOpts.log->critical("Couldn't create output path {}", outputPath.string());
+      std::exit(1);
+    }
+  }
+
+  // Now, the path exists
+  size_t missingValues{0};
+  bool success = (qmOpts.outputFormat == "binary")
+                     ? writeMergedBinary(qmOpts, merged, missingValues)
+                     : writeMergedText(qmOpts, merged, missingValues);
+  if (!success) { return false; }
 
   if (missingValues > 0) {
     qmOpts.log->warn("There were {} missing entries (recorded as \"NA\") in the output", missingValues);
@@ -225,6 +597,14 @@ int salmonQuantMerge(int argc, char* argv[]) {
      "The name of the column that will be merged together into the output files. "
      "The options are {len, elen, tpm, numreads}"
     )
+    (
+      "format,f", po::value<string>(&qmOpts.outputFormat)->default_value("text"),
+      "The format of the output file; one of {text, binary}.  The binary format is a "
+      "dense, column-major float32 matrix, with the sample and target names.")
+    (
+      "threads,p",
+      po::value<uint32_t>(&qmOpts.numThreads)->default_value(std::thread::hardware_concurrency()),
+      "The number of threads used to parse the quantification files.")
     (
 
       "output,o", po::value<std::string>(&qmOpts.outputName)->required(),
@@ -266,7 +646,7 @@ a single file.
     validateOptions(vm, qmOpts, consoleLog);
     qmOpts.print();
 
-    doMerge(qmOpts);
+    if (!doMerge(qmOpts)) { std::exit(1); }
 
   } catch (po::error& e) {
     std::cerr << "Exception : [" << e.what() << "]. Exiting.\n";
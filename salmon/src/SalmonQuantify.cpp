@@ -27,6 +27,7 @@
 #include <exception>
 #include <functional>
 #include <iterator>
+#include <fstream>
 #include <map>
 #include <mutex>
 #include <queue>
@@ -115,6 +116,8 @@ extern "C" {
 #include "GZipWriter.hpp"
 #include "HitManager.hpp"
 #include "KmerIntervalMap.hpp"
+#include "MappingCache.hpp"
+#include "ReadBiasSampleBuffer.hpp"
 
 #include "RapMapUtils.hpp"
 #include "ReadExperiment.hpp"
@@ -256,6 +259,9 @@ void processMiniBatch(ReadExperiment& readExp, ForgettingMassCalculator& fmCalc,
       // We start out with probability 0
       double sumOfAlignProbs{LOG_0};
 
+      // A consistent view of the fragment length distribution for this read
+      auto fldSnapshot = fragLengthDist.snapshot();
+
       // Record whether or not this read is unique to a single transcript.
       bool transcriptUnique{true};
 
@@ -344,19 +350,14 @@ void processMiniBatch(ReadExperiment& readExp, ForgettingMassCalculator& fmCalc,
           
           if (flen > 0.0 and useFragLengthDist and considerCondProb) {
             size_t fl = flen;
-            double lenProb = fragLengthDist.pmf(fl); 
+            double lenProb = fldSnapshot->pmf(fl); 
             if (burnedIn) {
               /* condition fragment length prob on txp length */
-              double refLengthCM = fragLengthDist.cmf(static_cast<size_t>(refLength)); 
+              double refLengthCM = fldSnapshot->cmf(static_cast<size_t>(refLength)); 
               bool computeMass = fl < refLength and !salmon::math::isLog0(refLengthCM);
               logFragProb = (computeMass) ?
                                       (lenProb - refLengthCM) :
                 salmon::math::LOG_EPSILON;
-              if (computeMass and refLengthCM < lenProb) {
-                // Threading is hard!  It's possible that an update to the PMF snuck in between when we asked to cache the CMF and when the
-                // "burnedIn" variable was last seen as false.
-                log->info("reference length = {}, CMF[refLen] = {}, fragLen = {}, PMF[fragLen] = {}", refLength, std::exp(refLengthCM), aln.fragLength(), std::exp(lenProb));
-              }
             } else if (useAuxParams) {
               logFragProb = lenProb;
             }
@@ -578,6 +579,8 @@ void processMiniBatch(ReadExperiment& readExp, ForgettingMassCalculator& fmCalc,
 
         if (posBiasCorrect) {
           auto lengthClassIndex = transcript.lengthClassIndex();
+          // Positional observations are accumulated in linear space
+          double alnMass = std::exp(aln.logProb);
           switch (aln.mateStatus) {
           case rapmap::utils::MateStatus::PAIRED_END_PAIRED: {
             // TODO: Handle the non opposite strand case
@@ -590,10 +593,10 @@ void processMiniBatch(ReadExperiment& readExp, ForgettingMassCalculator& fmCalc,
               posRC = posRC < 0 ? 0 : posRC;
               posRC = posRC >= transcript.RefLength ? transcript.RefLength - 1
                                                     : posRC;
-              observedPosBiasFwd[lengthClassIndex].addMass(
-                  posFW, transcript.RefLength, aln.logProb);
-              observedPosBiasRC[lengthClassIndex].addMass(
-                  posRC, transcript.RefLength, aln.logProb);
+              observedPosBiasFwd[lengthClassIndex].addLinearMass(
+                  posFW, transcript.RefLength, alnMass);
+              observedPosBiasRC[lengthClassIndex].addLinearMass(
+                  posRC, transcript.RefLength, alnMass);
             }
           } break;
           case rapmap::utils::MateStatus::PAIRED_END_LEFT:
@@ -603,11 +606,11 @@ void processMiniBatch(ReadExperiment& readExp, ForgettingMassCalculator& fmCalc,
             pos = pos < 0 ? 0 : pos;
             pos = pos >= transcript.RefLength ? transcript.RefLength - 1 : pos;
             if (aln.fwd) {
-              observedPosBiasFwd[lengthClassIndex].addMass(
-                  pos, transcript.RefLength, aln.logProb);
+              observedPosBiasFwd[lengthClassIndex].addLinearMass(
+                  pos, transcript.RefLength, alnMass);
             } else {
-              observedPosBiasRC[lengthClassIndex].addMass(
-                  pos, transcript.RefLength, aln.logProb);
+              observedPosBiasRC[lengthClassIndex].addLinearMass(
+                  pos, transcript.RefLength, alnMass);
             }
           } break;
           default:
@@ -704,6 +707,126 @@ void processMiniBatch(ReadExperiment& readExp, ForgettingMassCalculator& fmCalc,
   }
 }
 
+/**
+ * Attempt to draw a sequence-specific bias sample from the properly-paired
+ * mapping `h` to transcript `t`.  If the read-start contexts of both mates
+ * lie within the transcript, their locations are pushed onto `biasSamples`
+ * (to be added to the appropriate observed bias model when the buffer is
+ * flushed), and this function returns true.
+ **/
+inline bool sampleReadBiasPaired(const QuasiAlignment& h, Transcript& t,
+                                 SBModel& readBiasFW, SBModel& readBiasRC,
+                                 ReadBiasSampleBuffer& biasSamples) {
+  // The "start" position is the leftmost position if
+  // map to the forward strand, and the leftmost
+  // position + the read length if we map to the reverse complement.
+
+  // read 1
+  int32_t pos1 = static_cast<int32_t>(h.pos);
+  auto dir1 = salmon::utils::boolToDirection(h.fwd);
+  int32_t startPos1 = h.fwd ? pos1 : (pos1 + h.readLen - 1);
+
+  // read 2
+  int32_t pos2 = static_cast<int32_t>(h.matePos);
+  auto dir2 = salmon::utils::boolToDirection(h.mateIsFwd);
+  int32_t startPos2 = h.mateIsFwd ? pos2 : (pos2 + h.mateLen - 1);
+
+  bool success = false;
+
+  if ((dir1 != dir2) and // Shouldn't be from the same strand
+      (startPos1 > 0 and startPos1 < t.RefLength) and
+      (startPos2 > 0 and startPos2 < t.RefLength)) {
+
+    auto& readBias1 = (h.fwd) ? readBiasFW : readBiasRC;
+    auto& readBias2 = (h.mateIsFwd) ? readBiasFW : readBiasRC;
+
+    bool read1RC = !h.fwd;
+    bool read2RC = !h.mateIsFwd;
+
+    if ((startPos1 >= readBias1.contextBefore(read1RC) and
+         startPos1 + readBias1.contextAfter(read1RC) < t.RefLength) and
+        (startPos2 >= readBias2.contextBefore(read2RC) and
+         startPos2 + readBias2.contextAfter(read2RC) < t.RefLength)) {
+
+      int32_t fwPos = (h.fwd) ? startPos1 : startPos2;
+      int32_t rcPos = (h.fwd) ? startPos2 : startPos1;
+      if (fwPos < rcPos) {
+        biasSamples.push(h.tid, startPos1 - readBias1.contextBefore(read1RC),
+                         read1RC);
+        biasSamples.push(h.tid, startPos2 - readBias2.contextBefore(read2RC),
+                         read2RC);
+        success = true;
+      }
+    }
+  }
+  return success;
+}
+
+/**
+ * Attempt to draw a sequence-specific bias sample from the single-end
+ * (or orphan) mapping `h` to transcript `t`.  Returns true if the location
+ * of the read-start context was pushed onto `biasSamples`.
+ **/
+inline bool sampleReadBiasSingle(const QuasiAlignment& h, Transcript& t,
+                                 SBModel& readBiasFW, SBModel& readBiasRC,
+                                 ReadBiasSampleBuffer& biasSamples) {
+  // the "start" position is the leftmost position if
+  // we hit the forward strand, and the leftmost
+  // position + the read length if we hit the reverse complement
+  int32_t pos = static_cast<int32_t>(h.pos);
+  int32_t startPos = h.fwd ? pos : pos + h.readLen;
+
+  bool success{false};
+  if (startPos > 0 and startPos < t.RefLength) {
+    auto& readBias = (h.fwd) ? readBiasFW : readBiasRC;
+
+    // If the context exists around the read, record it as an observed
+    // read start.
+    if (startPos >= readBias.contextBefore(!h.fwd) and
+        startPos + readBias.contextAfter(!h.fwd) < t.RefLength) {
+      biasSamples.push(h.tid, startPos - readBias.contextBefore(!h.fwd), !h.fwd);
+      success = true;
+    }
+  }
+  return success;
+}
+
+/**
+ * Draw (at most) one sequence-specific bias sample from the mappings
+ * `jointHits` of a single fragment.  In a paired-end library, only
+ * properly-paired fragments contribute, through one of their mappings
+ * chosen uniformly at random; in a single-end library, a read contributes
+ * through its first mapping whose read-start context lies within the
+ * transcript.  Both the quasi-mapping pass and the replay of the mapping
+ * cache sample this way, so that they estimate the same bias model.
+ **/
+inline void sampleReadBias(const std::vector<QuasiAlignment>& jointHits,
+                           bool pairedLibrary, std::vector<Transcript>& transcripts,
+                           SBModel& readBiasFW, SBModel& readBiasRC,
+                           ReadBiasSampleBuffer& biasSamples,
+                           std::default_random_engine& eng, SalmonOpts& salmonOpts) {
+  if (jointHits.empty() or salmonOpts.numBiasSamples <= 0) { return; }
+  if (pairedLibrary) {
+    if (jointHits.front().mateStatus != MateStatus::PAIRED_END_PAIRED) {
+      return;
+    }
+    std::uniform_int_distribution<size_t> dis(0, jointHits.size() - 1);
+    auto& h = jointHits[dis(eng)];
+    if (sampleReadBiasPaired(h, transcripts[h.tid], readBiasFW, readBiasRC,
+                             biasSamples)) {
+      salmonOpts.numBiasSamples -= 1;
+    }
+  } else {
+    for (auto& h : jointHits) {
+      if (sampleReadBiasSingle(h, transcripts[h.tid], readBiasFW, readBiasRC,
+                               biasSamples)) {
+        salmonOpts.numBiasSamples -= 1;
+        break;
+      }
+    }
+  }
+}
+
 /// START QUASI
 
 // To use the parser in the following, we get "jobs" until none is
@@ -790,9 +913,8 @@ void processReadsQuasi(
   auto& readBiasRC =
       observedBiasParams
           .seqBiasModelRC; // readExp.readBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
-  // k-mers for sequence bias context
-  Mer leftMer;
-  Mer rightMer;
+  // Locations of the sequence bias samples drawn by this thread
+  ReadBiasSampleBuffer biasSamples;
 
   auto expectedLibType = rl.format();
 
@@ -840,9 +962,18 @@ void processReadsQuasi(
   auto* daLog = salmonOpts.daLog.get();
   bool dumpAlignments = (daLog != nullptr);
 
+  // If requested, each mini-batch of mappings is also written to the mapping
+  // cache so that a later run (with --fromCache) can replay it.
+  MappingCacheWriter* cacheWriter = (writeToCache and initialRound)
+                                        ? salmonOpts.mappingCacheWriter.get()
+                                        : nullptr;
+  MappingCacheBlock cacheBlock;
+  uint32_t batchUpperBoundHits{0};
+
   auto rg = parser->getReadGroup();
   while (parser->refill(rg)) {
       rangeSize = rg.size();
+    batchUpperBoundHits = 0;
 
     if (rangeSize > structureVec.size()) {
       salmonOpts.jointLog->error("rangeSize = {}, but structureVec.size() = {} "
@@ -898,6 +1029,7 @@ void processReadsQuasi(
 
         if (initialRound) {
           upperBoundHits += (jointHits.size() > 0);
+          batchUpperBoundHits += (jointHits.size() > 0);
         }
 
         // If the read mapped to > maxReadOccs places, discard it
@@ -930,8 +1062,8 @@ void processReadsQuasi(
       // If we have mappings, then process them.
       bool isPaired{false};
       if (jointHits.size() > 0) {
-        bool isPaired = jointHits.front().mateStatus ==
-                        rapmap::utils::MateStatus::PAIRED_END_PAIRED;
+        isPaired = jointHits.front().mateStatus ==
+                   rapmap::utils::MateStatus::PAIRED_END_PAIRED;
         if (isPaired) { 
             mapType = salmon::utils::MappingType::PAIRED_MAPPED; 
         }
@@ -978,95 +1110,13 @@ void processReadsQuasi(
           }
         }
 
-        bool needBiasSample = salmonOpts.biasCorrect;
-
-        std::uniform_int_distribution<> dis(0, jointHits.size());
-        // Randomly select a hit from which to draw the bias sample.
-        int32_t hitSamp{dis(eng)};
-        int32_t hn{0};
+        // ---- Collect bias samples ------ //
+        if (salmonOpts.biasCorrect) {
+          sampleReadBias(jointHits, true, transcripts, readBiasFW, readBiasRC,
+                         biasSamples, eng, salmonOpts);
+        }
 
         for (auto& h : jointHits) {
-
-          // ---- Collect bias samples ------ //
-
-          // If bias correction is turned on, and we haven't sampled a mapping
-          // for this read yet, and we haven't collected the required number of
-          // samples overall.
-          if (needBiasSample and salmonOpts.numBiasSamples > 0 and isPaired and
-              hn == hitSamp) {
-            auto& t = transcripts[h.tid];
-
-            // The "start" position is the leftmost position if
-            // map to the forward strand, and the leftmost
-            // position + the read length if we map to the reverse complement.
-
-            // read 1
-            int32_t pos1 = static_cast<int32_t>(h.pos);
-            auto dir1 = salmon::utils::boolToDirection(h.fwd);
-            int32_t startPos1 = h.fwd ? pos1 : (pos1 + h.readLen - 1);
-
-            // read 2
-            int32_t pos2 = static_cast<int32_t>(h.matePos);
-            auto dir2 = salmon::utils::boolToDirection(h.mateIsFwd);
-            int32_t startPos2 = h.mateIsFwd ? pos2 : (pos2 + h.mateLen - 1);
-
-            bool success = false;
-
-            if ((dir1 != dir2) and // Shouldn't be from the same strand
-                (startPos1 > 0 and startPos1 < t.RefLength) and
-                (startPos2 > 0 and startPos2 < t.RefLength)) {
-
-              const char* txpStart = t.Sequence();
-              const char* txpEnd = txpStart + t.RefLength;
-
-              const char* readStart1 = txpStart + startPos1;
-              auto& readBias1 = (h.fwd) ? readBiasFW : readBiasRC;
-
-              const char* readStart2 = txpStart + startPos2;
-              auto& readBias2 = (h.mateIsFwd) ? readBiasFW : readBiasRC;
-
-              int32_t fwPre = readBias1.contextBefore(!h.fwd);
-              int32_t fwPost = readBias1.contextAfter(!h.fwd);
-
-              int32_t rcPre = readBias2.contextBefore(!h.mateIsFwd);
-              int32_t rcPost = readBias2.contextAfter(!h.mateIsFwd);
-
-              bool read1RC = !h.fwd;
-              bool read2RC = !h.mateIsFwd;
-
-              if ((startPos1 >= readBias1.contextBefore(read1RC) and
-                   startPos1 + readBias1.contextAfter(read1RC) <
-                       t.RefLength) and
-                  (startPos2 >= readBias2.contextBefore(read2RC) and
-                   startPos2 + readBias2.contextAfter(read2RC) < t.RefLength)) {
-
-                int32_t fwPos = (h.fwd) ? startPos1 : startPos2;
-                int32_t rcPos = (h.fwd) ? startPos2 : startPos1;
-                if (fwPos < rcPos) {
-                  leftMer.from_chars(txpStart + startPos1 -
-                                     readBias1.contextBefore(read1RC));
-                  rightMer.from_chars(txpStart + startPos2 -
-                                      readBias2.contextBefore(read2RC));
-                  if (read1RC) {
-                    leftMer.reverse_complement();
-                  } else {
-                    rightMer.reverse_complement();
-                  }
-
-                  success = readBias1.addSequence(leftMer, 1.0);
-                  success = readBias2.addSequence(rightMer, 1.0);
-                }
-              }
-
-              if (success) {
-                salmonOpts.numBiasSamples -= 1;
-                needBiasSample = false;
-              }
-            }
-          }
-          // ---- Collect bias samples ------ //
-          ++hn;
-
           switch (h.mateStatus) {
           case MateStatus::PAIRED_END_LEFT: {
             h.format = salmon::utils::hitType(h.pos, h.fwd);
@@ -1172,6 +1222,12 @@ void processReadsQuasi(
         orphanLinks.clear();
     }
 
+    if (cacheWriter) {
+      cacheBlock.fill(structureVec.begin(), structureVec.begin() + rangeSize,
+                      rangeSize, batchUpperBoundHits);
+      cacheWriter->writeBlock(cacheBlock);
+    }
+
     prevObservedFrags = numObservedFragments;
     AlnGroupVecRange<QuasiAlignment> hitLists = boost::make_iterator_range(
         structureVec.begin(), structureVec.begin() + rangeSize);
@@ -1179,7 +1235,9 @@ void processReadsQuasi(
         readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
         transcripts, clusterForest, fragLengthDist, observedBiasParams,
         numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac);
+    biasSamples.flushIfFull(transcripts, readBiasFW, readBiasRC);
   }
+  biasSamples.flush(transcripts, readBiasFW, readBiasRC);
 
   if (maxZeroFrac > 0.0) {
       salmonOpts.jointLog->info("Thread saw mini-batch with a maximum of {0:.2f}\% zero probability fragments", 
@@ -1228,7 +1286,8 @@ void processReadsQuasi(
 
   auto& readBiasFW = observedBiasParams.seqBiasModelFW;
   auto& readBiasRC = observedBiasParams.seqBiasModelRC;
-  Mer context;
+  // Locations of the sequence bias samples drawn by this thread
+  ReadBiasSampleBuffer biasSamples;
 
   const char* txomeStr = qidx->seq.c_str();
 
@@ -1266,11 +1325,20 @@ void processReadsQuasi(
   fmt::MemoryWriter sstream;
   auto* qmLog = salmonOpts.qmLog.get();
   bool writeQuasimappings = (qmLog != nullptr);
+
+  // If requested, each mini-batch of mappings is also written to the mapping
+  // cache so that a later run (with --fromCache) can replay it.
+  MappingCacheWriter* cacheWriter = (writeToCache and initialRound)
+                                        ? salmonOpts.mappingCacheWriter.get()
+                                        : nullptr;
+  MappingCacheBlock cacheBlock;
+  uint32_t batchUpperBoundHits{0};
   
 
  auto rg = parser->getReadGroup();
   while (parser->refill(rg)) {
       rangeSize = rg.size();
+    batchUpperBoundHits = 0;
     if (rangeSize > structureVec.size()) {
       salmonOpts.jointLog->error("rangeSize = {}, but structureVec.size() = {} "
                                  "--- this shouldn't happen.\n"
@@ -1303,6 +1371,7 @@ void processReadsQuasi(
 
       if (initialRound) {
         upperBoundHits += (jointHits.size() > 0);
+        batchUpperBoundHits += (jointHits.size() > 0);
       }
 
       // If the read mapped to > maxReadOccs places, discard it
@@ -1310,51 +1379,13 @@ void processReadsQuasi(
         jointHitGroup.clearAlignments();
       }
 
-      bool needBiasSample = salmonOpts.biasCorrect;
+      // ---- Collect bias samples ------ //
+      if (salmonOpts.biasCorrect) {
+        sampleReadBias(jointHits, false, transcripts, readBiasFW, readBiasRC,
+                       biasSamples, eng, salmonOpts);
+      }
 
       for (auto& h : jointHits) {
-
-        // ---- Collect bias samples ------ //
-        int32_t pos = static_cast<int32_t>(h.pos);
-        auto dir = salmon::utils::boolToDirection(h.fwd);
-
-        // If bias correction is turned on, and we haven't sampled a mapping
-        // for this read yet, and we haven't collected the required number of
-        // samples overall.
-        if (needBiasSample and salmonOpts.numBiasSamples > 0) {
-          // the "start" position is the leftmost position if
-          // we hit the forward strand, and the leftmost
-          // position + the read length if we hit the reverse complement
-          int32_t startPos = h.fwd ? pos : pos + h.readLen;
-
-          auto& t = transcripts[h.tid];
-          if (startPos > 0 and startPos < t.RefLength) {
-            auto& readBias = (h.fwd) ? readBiasFW : readBiasRC;
-            const char* txpStart = t.Sequence();
-            const char* readStart = txpStart + startPos;
-            const char* txpEnd = txpStart + t.RefLength;
-
-            bool success{false};
-            // If the context exists around the read, add it to the observed
-            // read start sequences.
-            if (startPos >= readBias.contextBefore(!h.fwd) and
-                startPos + readBias.contextAfter(!h.fwd) < t.RefLength) {
-              context.from_chars(txpStart + startPos -
-                                 readBias.contextBefore(!h.fwd));
-              if (!h.fwd) {
-                context.reverse_complement();
-              }
-              success = readBias.addSequence(context, 1.0);
-            }
-
-            if (success) {
-              salmonOpts.numBiasSamples -= 1;
-              needBiasSample = false;
-            }
-          }
-        }
-        // ---- Collect bias samples ------ //
-
         switch (h.mateStatus) {
         case MateStatus::SINGLE_END: {
           h.format = salmon::utils::hitType(h.pos, h.fwd);
@@ -1417,6 +1448,12 @@ void processReadsQuasi(
         sstream.clear();
     } 
     
+    if (cacheWriter) {
+      cacheBlock.fill(structureVec.begin(), structureVec.begin() + rangeSize,
+                      rangeSize, batchUpperBoundHits);
+      cacheWriter->writeBlock(cacheBlock);
+    }
+
     prevObservedFrags = numObservedFragments;
     AlnGroupVecRange<QuasiAlignment> hitLists = boost::make_iterator_range(
         structureVec.begin(), structureVec.begin() + rangeSize);
@@ -1424,7 +1461,9 @@ void processReadsQuasi(
         readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
         transcripts, clusterForest, fragLengthDist, observedBiasParams,
         numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac);
+    biasSamples.flushIfFull(transcripts, readBiasFW, readBiasRC);
   }
+  biasSamples.flush(transcripts, readBiasFW, readBiasRC);
   readExp.updateShortFrags(shortFragStats);
 
   if (maxZeroFrac > 0.0) {
@@ -1435,6 +1474,212 @@ void processReadsQuasi(
 
 /// DONE QUASI
 
+/**
+ * Fold the bias parameters observed by each thread into the global
+ * (per-experiment) models, and finalize those that require it.
+ **/
+void combineObservedBiasParams(ReadExperiment& readExp,
+                               std::vector<BiasParams>& observedBiasParams,
+                               SalmonOpts& salmonOpts) {
+  /** GC-fragment bias **/
+  // Set the global distribution based on the sum of local
+  // distributions.
+  double gcFracFwd{0.0};
+  double globalMass{salmon::math::LOG_0};
+  double globalFwdMass{salmon::math::LOG_0};
+  auto& globalGCMass = readExp.observedGC();
+  for (auto& gcp : observedBiasParams) {
+    auto& gcm = gcp.observedGCMass;
+    globalGCMass.combineCounts(gcm);
+
+    auto& fw = readExp.readBiasModelObserved(salmon::utils::Direction::FORWARD);
+    auto& rc =
+        readExp.readBiasModelObserved(salmon::utils::Direction::REVERSE_COMPLEMENT);
+
+    auto& fwloc = gcp.seqBiasModelFW;
+    auto& rcloc = gcp.seqBiasModelRC;
+    fw.combineCounts(fwloc);
+    rc.combineCounts(rcloc);
+
+    /**
+     * positional biases
+     **/
+    auto& posBiasesFW = readExp.posBias(salmon::utils::Direction::FORWARD);
+    auto& posBiasesRC =
+        readExp.posBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
+    for (size_t i = 0; i < posBiasesFW.size(); ++i) {
+      posBiasesFW[i].combine(gcp.posBiasFW[i]);
+      posBiasesRC[i].combine(gcp.posBiasRC[i]);
+    }
+
+    globalMass = salmon::math::logAdd(globalMass, gcp.massFwd);
+    globalMass = salmon::math::logAdd(globalMass, gcp.massRC);
+    globalFwdMass = salmon::math::logAdd(globalFwdMass, gcp.massFwd);
+  }
+  globalGCMass.normalize();
+
+  if (globalMass != salmon::math::LOG_0) {
+    if (globalFwdMass != salmon::math::LOG_0) {
+      gcFracFwd = std::exp(globalFwdMass - globalMass);
+    }
+    readExp.setGCFracForward(gcFracFwd);
+  }
+
+  // finalize the positional biases
+  if (salmonOpts.posBiasCorrect) {
+    auto& posBiasesFW = readExp.posBias(salmon::utils::Direction::FORWARD);
+    auto& posBiasesRC =
+        readExp.posBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
+    for (size_t i = 0; i < posBiasesFW.size(); ++i) {
+      posBiasesFW[i].finalize();
+      posBiasesRC[i].finalize();
+    }
+  }
+  /** END GC-fragment bias **/
+}
+
+/// START MAPPING CACHE
+
+/**
+ * Replay the mappings of read library `rl` from the mapping cache rather than
+ * mapping the reads.  Each thread pulls blocks (one per original mini-batch)
+ * from `cacheReader`, decodes them into its alignment groups, draws any
+ * sequence-specific bias samples, and then processes them exactly as
+ * processReadsQuasi would have.
+ **/
+void replayCachedMappings(
+    MappingCacheReader& cacheReader, uint32_t libraryIndex,
+    ReadExperiment& readExp, ReadLibrary& rl,
+    AlnGroupVec<QuasiAlignment>& structureVec,
+    std::atomic<uint64_t>& numObservedFragments,
+    std::atomic<uint64_t>& numAssignedFragments,
+    std::atomic<uint64_t>& upperBoundHits, std::vector<Transcript>& transcripts,
+    ForgettingMassCalculator& fmCalc, ClusterForest& clusterForest,
+    FragmentLengthDistribution& fragLengthDist, BiasParams& observedBiasParams,
+    SalmonOpts& salmonOpts, bool initialRound, std::atomic<bool>& burnedIn) {
+
+  // Seed with a real random value, if available
+  std::random_device rd;
+
+  // Create a random uniform distribution
+  std::default_random_engine eng(rd());
+  double maxZeroFrac{0.0};
+
+  auto& readBiasFW = observedBiasParams.seqBiasModelFW;
+  auto& readBiasRC = observedBiasParams.seqBiasModelRC;
+  // Locations of the sequence bias samples drawn by this thread
+  ReadBiasSampleBuffer biasSamples;
+
+  bool isPairedLib = (rl.format().type == ReadType::PAIRED_END);
+  uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
+
+  MappingCacheBlock block;
+  while (cacheReader.nextBlock(libraryIndex, block)) {
+    if (block.header.numGroups > structureVec.size()) {
+      salmonOpts.jointLog->error("The mapping cache contains a block of {} fragments, "
+                                 "but structureVec.size() = {} --- this shouldn't happen.\n"
+                                 "Please report this bug on GitHub",
+                                 block.header.numGroups, structureVec.size());
+      std::exit(1);
+    }
+    size_t rangeSize = block.decode(structureVec);
+
+    if (salmonOpts.biasCorrect) {
+      for (size_t i = 0; i < rangeSize; ++i) {
+        sampleReadBias(structureVec[i].alignments(), isPairedLib, transcripts,
+                       readBiasFW, readBiasRC, biasSamples, eng, salmonOpts);
+      }
+    }
+
+    numObservedFragments += block.header.numObserved;
+    if (initialRound) {
+      upperBoundHits += block.header.numUpperBound;
+    }
+
+    AlnGroupVecRange<QuasiAlignment> hitLists = boost::make_iterator_range(
+        structureVec.begin(), structureVec.begin() + rangeSize);
+    processMiniBatch<QuasiAlignment>(
+        readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
+        transcripts, clusterForest, fragLengthDist, observedBiasParams,
+        numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac);
+    biasSamples.flushIfFull(transcripts, readBiasFW, readBiasRC);
+  }
+  biasSamples.flush(transcripts, readBiasFW, readBiasRC);
+
+  if (maxZeroFrac > 0.0) {
+      salmonOpts.jointLog->info("Thread saw mini-batch with a maximum of {0:.2f}\% zero probability fragments",
+                                maxZeroFrac);
+  }
+}
+
+void processCachedReadLibrary(
+    ReadExperiment& readExp, ReadLibrary& rl, uint32_t libraryIndex,
+    MappingCacheReader& cacheReader, std::vector<Transcript>& transcripts,
+    ClusterForest& clusterForest, std::atomic<uint64_t>& numObservedFragments,
+    std::atomic<uint64_t>& numAssignedFragments,
+    std::atomic<uint64_t>& upperBoundHits, bool initialRound,
+    std::atomic<bool>& burnedIn, ForgettingMassCalculator& fmCalc,
+    FragmentLengthDistribution& fragLengthDist, SalmonOpts& salmonOpts,
+    size_t numThreads, std::vector<AlnGroupVec<SMEMAlignment>>& structureVec) {
+  // ERROR
+  salmonOpts.jointLog->error("The mapping cache can only be used with the quasi index "
+                             "--- please report this bug on GitHub");
+  std::exit(1);
+}
+
+void processCachedReadLibrary(
+    ReadExperiment& readExp, ReadLibrary& rl, uint32_t libraryIndex,
+    MappingCacheReader& cacheReader, std::vector<Transcript>& transcripts,
+    ClusterForest& clusterForest, std::atomic<uint64_t>& numObservedFragments,
+    std::atomic<uint64_t>& numAssignedFragments,
+    std::atomic<uint64_t>& upperBoundHits, bool initialRound,
+    std::atomic<bool>& burnedIn, ForgettingMassCalculator& fmCalc,
+    FragmentLengthDistribution& fragLengthDist, SalmonOpts& salmonOpts,
+    size_t numThreads, std::vector<AlnGroupVec<QuasiAlignment>>& structureVec) {
+
+  std::vector<std::thread> threads;
+
+  /** sequence-specific and GC-fragment bias vectors --- each thread gets it's
+   * own **/
+  std::vector<BiasParams> observedBiasParams(numThreads,
+					     BiasParams(salmonOpts.numConditionalGCBins, salmonOpts.numFragGCBins, false));
+
+  for (size_t i = 0; i < numThreads; ++i) {
+    // NOTE: we *must* capture i by value here, b/c it can (sometimes, does)
+    // change value before the lambda below is evaluated --- crazy!
+    auto threadFun = [&, i]() -> void {
+      replayCachedMappings(cacheReader, libraryIndex, readExp, rl,
+                           structureVec[i], numObservedFragments,
+                           numAssignedFragments, upperBoundHits, transcripts,
+                           fmCalc, clusterForest, fragLengthDist,
+                           observedBiasParams[i], salmonOpts, initialRound,
+                           burnedIn);
+    };
+    threads.emplace_back(threadFun);
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // If we don't have a sufficient number of assigned fragments, then
+  // complain here!
+  if (numAssignedFragments < salmonOpts.minRequiredFrags) {
+    readExp.setNumObservedFragments(numObservedFragments);
+    readExp.numAssignedFragmentsAtomic().store(numAssignedFragments);
+    double mappingRate = numAssignedFragments.load() /
+      static_cast<double>(numObservedFragments.load());
+    readExp.setEffectiveMappingRate(mappingRate);
+    throw InsufficientAssignedFragments(numAssignedFragments.load(), salmonOpts.minRequiredFrags);
+  }
+
+  // Set the global bias models based on the sum of the
+  // per-thread models.
+  combineObservedBiasParams(readExp, observedBiasParams, salmonOpts);
+}
+
+/// DONE MAPPING CACHE
+
 template <typename AlnT>
 void processReadLibrary(
     ReadExperiment& readExp, ReadLibrary& rl, SalmonIndex* sidx,
@@ -1590,68 +1835,9 @@ void processReadLibrary(
       throw InsufficientAssignedFragments(numAssignedFragments.load(), salmonOpts.minRequiredFrags);
     }
 
-    /** GC-fragment bias **/
-    // Set the global distribution based on the sum of local
-    // distributions.
-    double gcFracFwd{0.0};
-    double globalMass{salmon::math::LOG_0};
-    double globalFwdMass{salmon::math::LOG_0};
-    auto& globalGCMass = readExp.observedGC();
-    for (auto& gcp : observedBiasParams) {
-      auto& gcm = gcp.observedGCMass;
-      globalGCMass.combineCounts(gcm);
-
-      auto& fw = readExp.readBiasModelObserved(salmon::utils::Direction::FORWARD);
-      auto& rc =
-          readExp.readBiasModelObserved(salmon::utils::Direction::REVERSE_COMPLEMENT);
-
-      auto& fwloc = gcp.seqBiasModelFW;
-      auto& rcloc = gcp.seqBiasModelRC;
-      fw.combineCounts(fwloc);
-      rc.combineCounts(rcloc);
-
-      /**
-       * positional biases
-       **/
-      auto& posBiasesFW = readExp.posBias(salmon::utils::Direction::FORWARD);
-      auto& posBiasesRC =
-          readExp.posBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
-      for (size_t i = 0; i < posBiasesFW.size(); ++i) {
-        posBiasesFW[i].combine(gcp.posBiasFW[i]);
-        posBiasesRC[i].combine(gcp.posBiasRC[i]);
-      }
-      /*
-              for (size_t i = 0; i < fwloc.counts.size(); ++i) {
-                  fw.counts[i] += fwloc.counts[i];
-                  rc.counts[i] += rcloc.counts[i];
-              }
-      */
-
-      globalMass = salmon::math::logAdd(globalMass, gcp.massFwd);
-      globalMass = salmon::math::logAdd(globalMass, gcp.massRC);
-      globalFwdMass = salmon::math::logAdd(globalFwdMass, gcp.massFwd);
-    }
-    globalGCMass.normalize();
-
-    if (globalMass != salmon::math::LOG_0) {
-      if (globalFwdMass != salmon::math::LOG_0) {
-        gcFracFwd = std::exp(globalFwdMass - globalMass);
-      }
-      readExp.setGCFracForward(gcFracFwd);
-    }
-
-    // finalize the positional biases
-    if (salmonOpts.posBiasCorrect) {
-      auto& posBiasesFW = readExp.posBias(salmon::utils::Direction::FORWARD);
-      auto& posBiasesRC =
-          readExp.posBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
-      for (size_t i = 0; i < posBiasesFW.size(); ++i) {
-        posBiasesFW[i].finalize();
-        posBiasesRC[i].finalize();
-      }
-    }
-
-    /** END GC-fragment bias **/
+    // Set the global bias models based on the sum of the
+    // per-thread models.
+    combineObservedBiasParams(readExp, observedBiasParams, salmonOpts);
 
   } // ------ Single-end --------
   else if (rl.format().type == ReadType::SINGLE_END) {
@@ -1760,62 +1946,9 @@ void processReadLibrary(
       threads[i].join();
     }
 
-    /** GC-fragment bias **/
-    // Set the global distribution based on the sum of local
-    // distributions.
-    double gcFracFwd{0.0};
-    double globalMass{salmon::math::LOG_0};
-    double globalFwdMass{salmon::math::LOG_0};
-    auto& globalGCMass = readExp.observedGC();
-    for (auto& gcp : observedBiasParams) {
-      auto& gcm = gcp.observedGCMass;
-      globalGCMass.combineCounts(gcm);
-
-      auto& fw = readExp.readBiasModelObserved(salmon::utils::Direction::FORWARD);
-      auto& rc =
-          readExp.readBiasModelObserved(salmon::utils::Direction::REVERSE_COMPLEMENT);
-
-      auto& fwloc = gcp.seqBiasModelFW;
-      auto& rcloc = gcp.seqBiasModelRC;
-      fw.combineCounts(fwloc);
-      rc.combineCounts(rcloc);
-
-      /**
-       * positional biases
-       **/
-      auto& posBiasesFW = readExp.posBias(salmon::utils::Direction::FORWARD);
-      auto& posBiasesRC =
-          readExp.posBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
-      for (size_t i = 0; i < posBiasesFW.size(); ++i) {
-        posBiasesFW[i].combine(gcp.posBiasFW[i]);
-        posBiasesRC[i].combine(gcp.posBiasRC[i]);
-      }
-
-      globalMass = salmon::math::logAdd(globalMass, gcp.massFwd);
-      globalMass = salmon::math::logAdd(globalMass, gcp.massRC);
-      globalFwdMass = salmon::math::logAdd(globalFwdMass, gcp.massFwd);
-    }
-    globalGCMass.normalize();
-
-    if (globalMass != salmon::math::LOG_0) {
-      if (globalFwdMass != salmon::math::LOG_0) {
-        gcFracFwd = std::exp(globalFwdMass - globalMass);
-      }
-      readExp.setGCFracForward(gcFracFwd);
-    }
-
-    // finalize the positional biases
-    if (salmonOpts.posBiasCorrect) {
-      auto& posBiasesFW = readExp.posBias(salmon::utils::Direction::FORWARD);
-      auto& posBiasesRC =
-          readExp.posBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
-      for (size_t i = 0; i < posBiasesFW.size(); ++i) {
-        posBiasesFW[i].finalize();
-        posBiasesRC[i].finalize();
-      }
-    }
-
-    /** END GC-fragment bias **/
+    // Set the global bias models based on the sum of the
+    // per-thread models.
+    combineObservedBiasParams(readExp, observedBiasParams, salmonOpts);
 
     /* OLD SINGLE END BIAS
     // Set the global distribution based on the sum of local
@@ -1899,6 +2032,42 @@ void quantifyLibrary(ReadExperiment& experiment, bool greedyChain,
   size_t maxReadGroup{miniBatchSize};
   uint32_t structCacheSize = numQuantThreads * maxReadGroup * 10;
 
+  // The mapping cache.  If we were asked to replay a cache (written by an
+  // earlier run), then we read from it instead of mapping the reads.  If we
+  // were asked to write one, we do so as the reads are mapped.
+  boost::filesystem::path cachePath;
+  std::unique_ptr<MappingCacheReader> cacheReader{nullptr};
+  if (!salmonOpts.fromCache.empty()) {
+    cachePath = salmonOpts.fromCache;
+    cacheReader.reset(new MappingCacheReader(cachePath));
+    if (!cacheReader->isValid()) {
+      jointLog->error("Could not read the mapping cache [{}]; please make sure "
+                      "that it was written by this version of salmon.",
+                      cachePath.string());
+      std::exit(1);
+    }
+    auto indexSeqHash = experiment.getIndex()->seqHash();
+    if (cacheReader->numTranscripts() != numTranscripts or
+        (!indexSeqHash.empty() and !cacheReader->seqHash().empty() and
+         indexSeqHash != cacheReader->seqHash())) {
+      jointLog->error("The mapping cache [{}] was not built against the "
+                      "provided index; it cannot be used.",
+                      cachePath.string());
+      std::exit(1);
+    }
+    jointLog->info("Replaying mappings from the mapping cache [{}]",
+                   cachePath.string());
+  } else if (salmonOpts.writeMappingCache) {
+    cachePath = salmonOpts.outputDirectory / salmonOpts.auxDir / "mapping_cache.bin";
+    salmonOpts.mappingCacheWriter.reset(new MappingCacheWriter(
+        cachePath, numTranscripts, experiment.getIndex()->seqHash()));
+    if (!salmonOpts.mappingCacheWriter->isOpen()) {
+      jointLog->error("Could not create the mapping cache file [{}]",
+                      cachePath.string());
+      std::exit(1);
+    }
+  }
+
   // EQCLASS
   bool terminate{false};
 
@@ -1942,7 +2111,8 @@ void quantifyLibrary(ReadExperiment& experiment, bool greedyChain,
       groupVec.emplace_back(maxReadGroup);
     }
 
-    bool writeToCache = !salmonOpts.disableMappingCache;
+    bool writeToCache = (salmonOpts.mappingCacheWriter != nullptr);
+    uint32_t libraryIndex{0};
     auto processReadLibraryCallback =
         [&](ReadLibrary& rl, SalmonIndex* sidx,
             std::vector<Transcript>& transcripts, ClusterForest& clusterForest,
@@ -1950,12 +2120,25 @@ void quantifyLibrary(ReadExperiment& experiment, bool greedyChain,
             std::atomic<uint64_t>& numAssignedFragments, size_t numQuantThreads,
             std::atomic<bool>& burnedIn) -> void {
 
-      processReadLibrary<AlnT>(experiment, rl, sidx, transcripts, clusterForest,
-                               numObservedFragments, totalAssignedFragments,
-                               upperBoundHits, initialRound, burnedIn, fmCalc,
-                               fragLengthDist, memOptions, salmonOpts,
-                               coverageThresh, greedyChain, ioMutex,
-                               numQuantThreads, groupVec, writeToCache);
+      if (cacheReader) {
+        processCachedReadLibrary(experiment, rl, libraryIndex, *cacheReader,
+                                 transcripts, clusterForest,
+                                 numObservedFragments, totalAssignedFragments,
+                                 upperBoundHits, initialRound, burnedIn, fmCalc,
+                                 fragLengthDist, salmonOpts, numQuantThreads,
+                                 groupVec);
+      } else {
+        if (writeToCache) {
+          salmonOpts.mappingCacheWriter->setLibraryIndex(libraryIndex);
+        }
+        processReadLibrary<AlnT>(experiment, rl, sidx, transcripts, clusterForest,
+                                 numObservedFragments, totalAssignedFragments,
+                                 upperBoundHits, initialRound, burnedIn, fmCalc,
+                                 fragLengthDist, memOptions, salmonOpts,
+                                 coverageThresh, greedyChain, ioMutex,
+                                 numQuantThreads, groupVec, writeToCache);
+      }
+      ++libraryIndex;
 
       numAssignedFragments = totalAssignedFragments - prevNumAssignedFragments;
       prevNumAssignedFragments = totalAssignedFragments;
@@ -1969,6 +2152,15 @@ void quantifyLibrary(ReadExperiment& experiment, bool greedyChain,
                             processReadLibraryCallback);
     experiment.setNumObservedFragments(numObservedFragments);
 
+    // The mapping cache is complete once all of the reads have been mapped
+    if (writeToCache) {
+      auto& cacheWriter = salmonOpts.mappingCacheWriter;
+      cacheWriter->close();
+      jointLog->info("Wrote {} mini-batches of mappings to the mapping cache [{}]",
+                     cacheWriter->numBlocks(), cachePath.string());
+      cacheWriter.reset();
+    }
+
     // EQCLASS
     bool done = experiment.equivalenceClassBuilder().finish();
     // skip the extra online rounds
@@ -2078,7 +2270,16 @@ void quantifyLibrary(ReadExperiment& experiment, bool greedyChain,
   jointLog->info("finished quantifyLibrary()");
 }
 
-int salmonQuantify(int argc, char* argv[]) {
+/**
+ * Quantify a single sample.  If `sharedIndex` is empty, the index is loaded
+ * and returned through it, so that later samples of a `--samples` batch can
+ * re-use it.  In such a batch, only the first `numSharedArgs` arguments come
+ * from the command line (the rest come from the manifest), and they must not
+ * give any of the per-sample options.
+ */
+static int salmonQuantifySample(int argc, char* argv[],
+                                std::shared_ptr<SalmonIndex>& sharedIndex,
+                                int numSharedArgs) {
   using std::cerr;
   using std::vector;
   using std::string;
@@ -2121,6 +2322,13 @@ int salmonQuantify(int argc, char* argv[]) {
 
       "output,o", po::value<std::string>()->required(),
       "Output quantification file.")
+    (
+      "samples", po::value<std::string>(),
+      "A tab-separated manifest of samples to quantify, one after another, "
+      "against the same (once-loaded) index.  Each line is "
+      "\"<output_dir> TAB <libType> TAB <mates1> TAB <mates2>\" or "
+      "\"<output_dir> TAB <libType> TAB <unmated>\"; when this is given, -o, -l, "
+      "-1, -2 and -r must not be.  All other options apply to every sample.")
     (
       "allowOrphans",
       po::bool_switch(&(sopt.allowOrphans))->default_value(false),
@@ -2192,7 +2400,8 @@ int salmonQuantify(int argc, char* argv[]) {
   );
 
   sopt.noRichEqClasses = false;
-  // mapping cache has been deprecated
+  // The old (text) mapping cache has been deprecated; see
+  // --writeMappingCache / --fromCache for the binary replacement.
   sopt.disableMappingCache = true;
 
   po::options_description advanced("\n"
@@ -2235,6 +2444,16 @@ int salmonQuantify(int argc, char* argv[]) {
      po::bool_switch(&(sopt.dumpEqWeights))->default_value(false),
      "Includes \"rich\" equivlance class weights in the output when equivalence "
      "class information is being dumped to file.")
+    ("dumpEqFormat",
+     po::value<std::string>(&(sopt.dumpEqFormat))->default_value("text"),
+     "The format in which equivalence classes are dumped (with --dumpEq); one of \"text\" "
+     "(eq_classes.txt) or \"binary\" (eq_classes.bin, a compact, block-compressed format that "
+     "can be converted to text with `salmon eqconvert`).")
+    ("fromCache", po::value<std::string>(&(sopt.fromCache))->default_value(""),
+     "Rather than mapping the reads, replay the mappings stored in the given mapping cache "
+     "(written by a previous run with --writeMappingCache against the same index).  This allows "
+     "re-quantifying a sample with different bias or inference options without mapping it again. "
+     "The read files must still be given to describe the library, but they will not be read.")
     ("fasterMapping",
      po::bool_switch(&(sopt.fasterMapping))->default_value(false),
      "[Developer]: Disables some extra checks during quasi-mapping. This may make mapping a "
@@ -2259,6 +2478,17 @@ int salmonQuantify(int argc, char* argv[]) {
      "when evaluating sequence-specific & GC fragment bias.  Larger values speed up effective "
      "length correction, but may decrease the fidelity of bias modeling "
      "results.")
+    (
+     "numBiasRounds",
+     po::value<std::uint32_t>(&(sopt.numBiasRounds))->default_value(1),
+     "The number of rounds of bias (and effective length) re-estimation to perform during "
+     "the offline EM.  Every round after the first only updates the expected bias contributions of the "
+     "transcripts whose abundance changed by more than --biasUpdateThreshold.")
+    (
+     "biasUpdateThreshold",
+     po::value<double>(&(sopt.biasUpdateThreshold))->default_value(0.05),
+     "The relative change in a transcript's weight (abundance / effective length) above which "
+     "its expected bias contribution is updated in rounds of bias re-estimation after the first.")
     (
      "strictIntersect",
      po::bool_switch(&(sopt.strictIntersect))->default_value(false),
@@ -2400,6 +2630,12 @@ int salmonQuantify(int argc, char* argv[]) {
      "The prior that will be used in the VBEM algorithm.  This is interpreted "
      "as a per-nucleotide prior, unless the --perTranscriptPrior flag "
      "is also given, in which case this is used as a transcript-level prior")
+    (
+     "writeMappingCache",
+     po::bool_switch(&(sopt.writeMappingCache))->default_value(false),
+     "Write the quasi-mappings of all fragments, in a compact binary format, to the file "
+     "mapping_cache.bin in the auxiliary directory.  A later run can pass this cache to --fromCache "
+     "to re-quantify the sample without mapping the reads again.")
     (
      "writeOrphanLinks",
      po::bool_switch(&(sopt.writeOrphanLinks))->default_value(false),
@@ -2517,6 +2753,24 @@ int salmonQuantify(int argc, char* argv[]) {
 
   po::variables_map vm;
   try {
+    if (numSharedArgs < argc) {
+      // (parsed, rather than matched by prefix, so that option values, and
+      // abbreviations of the long names, are told apart correctly)
+      auto sharedOptions =
+          po::command_line_parser(numSharedArgs, argv).options(all).run();
+      for (auto& opt : sharedOptions.options) {
+        if (opt.string_key == "output" or opt.string_key == "libType" or
+            opt.string_key == "mates1" or opt.string_key == "mates2" or
+            opt.string_key == "unmatedReads") {
+          std::cerr << "The option " << opt.original_tokens.front()
+                    << " can't be used with --samples; the sample manifest "
+                       "gives the output directory, library type and read "
+                       "files of each sample. Exiting.\n";
+          std::exit(1);
+        }
+      }
+    }
+
     auto orderedOptions =
         po::command_line_parser(argc, argv).options(all).run();
 
@@ -2567,7 +2821,7 @@ transcript abundance from RNA-seq reads
       }
       std::exit(1);
     }
- 
+
     auto fileLog = sopt.fileLog;
     auto jointLog = sopt.jointLog;
     auto indexDirectory = sopt.indexDirectory;
@@ -2594,7 +2848,13 @@ transcript abundance from RNA-seq reads
     versionInfo.load(versionPath);
     auto idxType = versionInfo.indexType();
 
-    ReadExperiment experiment(readLibraries, indexDirectory, sopt);
+    if (!sharedIndex) {
+      sharedIndex = ReadExperiment::loadIndex(readLibraries, indexDirectory, sopt);
+    } else {
+      // The loggers of the sample that loaded the index are gone
+      sharedIndex->setLogger(jointLog);
+    }
+    ReadExperiment experiment(readLibraries, sharedIndex, sopt);
 
     // This will be the class in charge of maintaining our
     // rich equivalence classes
@@ -2615,6 +2875,16 @@ transcript abundance from RNA-seq reads
                         "Sequence-specific or fragment GC bias correction require "
                         "use of the quasi-index. Disabling all bias correction");
         }
+        if (!sopt.fromCache.empty()) {
+          jointLog->error("The mapping cache (--fromCache) requires use of the quasi-index.");
+          std::exit(1);
+        }
+        if (sopt.writeMappingCache) {
+          sopt.writeMappingCache = false;
+          sopt.disableMappingCache = true;
+          jointLog->warn("The mapping cache (--writeMappingCache) requires use of the "
+                         "quasi-index. No mapping cache will be written");
+        }
         quantifyLibrary<SMEMAlignment>(experiment, greedyChain, memOptions, sopt,
                                       coverageThresh, sopt.numThreads);
       } break;
@@ -2751,7 +3021,7 @@ transcript abundance from RNA-seq reads
     /** If the user requested gene-level abundances, then compute those now **/
     if (vm.count("geneMap")) {
       try {
-        salmon::utils::generateGeneLevelEstimates(sopt.geneMapPath,
+        salmon::utils::generateGeneLevelEstimates(sopt, experiment,
                                                   outputDirectory);
       } catch (std::invalid_argument& e) {
         fmt::print(stderr, "Error: [{}] when trying to compute gene-level "
@@ -2817,3 +3087,140 @@ transcript abundance from RNA-seq reads
 
   return 0;
 }
+
+/**
+ * Parse a sample manifest.  Each (non-empty, non-comment) line is
+ * tab-separated and is either
+ *   <output_dir> <TAB> <libType> <TAB> <mates1> <TAB> <mates2>   (paired-end), or
+ *   <output_dir> <TAB> <libType> <TAB> <unmated>                (single-end).
+ * A read column may list several files, separated by spaces.  Each sample
+ * is returned as the extra command line arguments that select it.
+ */
+static bool parseSampleManifest(const std::string& manifestPath,
+                                std::vector<std::vector<std::string>>& samples) {
+  std::ifstream manifest(manifestPath);
+  if (!manifest.is_open()) {
+    std::cerr << "Could not open the sample manifest " << manifestPath << "\n";
+    return false;
+  }
+
+  auto splitFiles = [](const std::string& field) -> std::vector<std::string> {
+    std::vector<std::string> files;
+    std::istringstream iss(field);
+    std::string f;
+    while (iss >> f) { files.push_back(f); }
+    return files;
+  };
+
+  std::string line;
+  size_t lineNum{0};
+  while (std::getline(manifest, line)) {
+    ++lineNum;
+    if (!line.empty() and line.back() == '\r') { line.pop_back(); }
+    auto firstChar = line.find_first_not_of(" \t");
+    if (firstChar == std::string::npos or line[firstChar] == '#') { continue; }
+
+    std::vector<std::string> fields;
+    std::istringstream iss(line);
+    std::string field;
+    while (std::getline(iss, field, '\t')) {
+      if (!splitFiles(field).empty()) { fields.push_back(field); }
+    }
+
+    if (fields.size() != 3 and fields.size() != 4) {
+      std::cerr << "Line " << lineNum << " of the sample manifest " << manifestPath
+                << " should have 3 (single-end) or 4 (paired-end) tab-separated "
+                   "columns, but it has " << fields.size() << "\n";
+      return false;
+    }
+
+    auto outDir = splitFiles(fields[0]);
+    if (outDir.size() != 1) {
+      std::cerr << "Line " << lineNum << " of the sample manifest " << manifestPath
+                << " has an invalid output directory\n";
+      return false;
+    }
+    auto libType = splitFiles(fields[1]);
+    if (libType.size() != 1) {
+      std::cerr << "Line " << lineNum << " of the sample manifest " << manifestPath
+                << " has an invalid library type\n";
+      return false;
+    }
+    // The library type must come before the read files it describes
+    std::vector<std::string> sampleArgs{"-o", outDir.front(), "-l", libType.front()};
+    if (fields.size() == 4) {
+      sampleArgs.push_back("-1");
+      for (auto& f : splitFiles(fields[2])) { sampleArgs.push_back(f); }
+      sampleArgs.push_back("-2");
+      for (auto& f : splitFiles(fields[3])) { sampleArgs.push_back(f); }
+    } else {
+      sampleArgs.push_back("-r");
+      for (auto& f : splitFiles(fields[2])) { sampleArgs.push_back(f); }
+    }
+    samples.push_back(sampleArgs);
+  }
+
+  if (samples.empty()) {
+    std::cerr << "The sample manifest " << manifestPath << " lists no samples\n";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Quantify every sample in the manifest given to `--samples`, one after
+ * another, in this process.  The index is loaded only once and shared by all
+ * samples; every other option on the command line applies to every sample.
+ */
+static int salmonQuantifyBatch(int argc, char* argv[]) {
+  // The per-sample options (which must not be among these) are rejected
+  // when the first sample's arguments are parsed.
+  std::string manifestPath;
+  std::vector<std::string> sharedArgs{argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--samples") {
+      if (i + 1 >= argc) {
+        std::cerr << "The option --samples requires a manifest file. Exiting.\n";
+        return 1;
+      }
+      manifestPath = argv[++i];
+    } else if (arg.compare(0, 10, "--samples=") == 0) {
+      manifestPath = arg.substr(10);
+    } else {
+      sharedArgs.push_back(arg);
+    }
+  }
+
+  std::vector<std::vector<std::string>> samples;
+  if (!parseSampleManifest(manifestPath, samples)) { return 1; }
+
+  std::shared_ptr<SalmonIndex> sharedIndex{nullptr};
+  int ret{0};
+  for (size_t i = 0; i < samples.size(); ++i) {
+    std::vector<std::string> args(sharedArgs);
+    args.insert(args.end(), samples[i].begin(), samples[i].end());
+    std::vector<char*> sampleArgv;
+    for (auto& a : args) { sampleArgv.push_back(&a[0]); }
+    sampleArgv.push_back(nullptr);
+
+    fmt::print(stderr, "[ sample {} of {} ] => {{ {} }}\n", i + 1,
+               samples.size(), samples[i][1]);
+    ret |= salmonQuantifySample(static_cast<int>(args.size()), sampleArgv.data(),
+                                sharedIndex, static_cast<int>(sharedArgs.size()));
+    // Each sample registers its own (identically named) loggers.
+    spdlog::drop_all();
+  }
+  return ret;
+}
+
+int salmonQuantify(int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--samples") == 0 or
+        std::strncmp(argv[i], "--samples=", 10) == 0) {
+      return salmonQuantifyBatch(argc, argv);
+    }
+  }
+  std::shared_ptr<SalmonIndex> index{nullptr};
+  return salmonQuantifySample(argc, argv, index, argc);
+}
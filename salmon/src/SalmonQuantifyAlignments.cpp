@@ -27,7 +27,6 @@ extern "C" {
 #include <mutex>
 #include <thread>
 #include <memory>
-#include <condition_variable>
 
 #include <tbb/concurrent_queue.h>
 
@@ -42,6 +41,7 @@ extern "C" {
 #include "AlignmentLibrary.hpp"
 #include "MiniBatchInfo.hpp"
 #include "BAMQueue.hpp"
+#include "AdaptiveWait.hpp"
 #include "SalmonMath.hpp"
 #include "FASTAParser.hpp"
 #include "LibraryFormat.hpp"
@@ -98,35 +98,15 @@ void scaleBy(std::vector<T>& vec, T scale) {
     std::for_each(vec.begin(), vec.end(), [scale](T& ele)->void { ele *= scale; });
 }
 
-/*
- * Tries _numTries_ times to get work from _workQueue_.  It returns
- * true immediately if it was able to find work, and false otherwise.
- */
-template <typename FragT>
-inline bool tryToGetWork(MiniBatchQueue<AlignmentGroup<FragT*>>& workQueue,
-                  MiniBatchInfo<AlignmentGroup<FragT*>>*& miniBatch,
-                  uint32_t numTries) {
-
-    uint32_t attempts{1};
-    bool foundWork = workQueue.try_pop(miniBatch);
-    while (!foundWork and attempts < numTries) {
-        foundWork = workQueue.try_pop(miniBatch);
-        ++attempts;
-    }
-    return foundWork;
-}
-
-
-
 template <typename FragT>
 void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
                       ForgettingMassCalculator& fmCalc,
                       uint64_t firstTimestepOfRound,
                       MiniBatchQueue<AlignmentGroup<FragT*>>& workQueue,
                       MiniBatchQueue<AlignmentGroup<FragT*>>* processedCache,
-                      std::condition_variable& workAvailable,
-                      std::mutex& cvmutex,
-                      volatile bool& doneParsing,
+                      AdaptiveWait& workAvailable,
+                      WaitStats& waitStats,
+                      std::atomic<bool>& doneParsing,
                       std::atomic<size_t>& activeBatches,
                       SalmonOpts& salmonOpts,
 		      BiasParams& observedBiasParams,
@@ -134,6 +114,7 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
                       bool initialRound,
                       std::atomic<size_t>& processedReads) {
 
+    auto threadStart = std::chrono::steady_clock::now();
     // Seed with a real random value, if available
     std::random_device rd;
     auto& log = salmonOpts.jointLog;
@@ -178,6 +159,7 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
     auto& clusterForest = alnLib.clusterForest();
     auto& fragmentQueue = alnLib.fragmentQueue();
     auto& alignmentGroupQueue = alnLib.alignmentGroupQueue();
+    auto& poolRefilled = alnLib.poolRefilled();
 
     std::vector<FragmentStartPositionDistribution>& fragStartDists =
         alnLib.fragmentStartPositionDistributions();
@@ -210,17 +192,10 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
     while (!doneParsing or !workQueue.empty()) {
         uint32_t zeroProbFrags{0};
 
-        // Try up to numTries times to get work from the queue before
-        // giving up and waiting on the condition variable
-    	constexpr uint32_t numTries = 100;
-        bool foundWork = tryToGetWork(workQueue, miniBatch, numTries);
-
-        // If work wasn't immediately available, then wait for it using
-    	// a condition variable to avoid burning CPU cycles for no reason.
-        if (!foundWork) {
-            std::unique_lock<std::mutex> l(cvmutex);
-            workAvailable.wait(l, [&miniBatch, &workQueue, &doneParsing]() { return workQueue.try_pop(miniBatch) or doneParsing; });
-        }
+        // Spin briefly, then park, until there is work (or no more will come)
+        workAvailable.wait([&miniBatch, &workQueue, &doneParsing]() -> bool {
+                return workQueue.try_pop(miniBatch) or doneParsing;
+            }, &waitStats);
                  
 
         uint64_t batchReads{0};
@@ -263,6 +238,9 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
 
                     double sumOfAlignProbs{LOG_0};
 
+                    // A consistent view of the fragment length distribution for this read
+                    auto fldSnapshot = fragLengthDist.snapshot();
+
                     // update the cluster-level properties
                     bool transcriptUnique{true};
                     auto firstTranscriptID = alnGroup->alignments().front()->transcriptID();
@@ -291,20 +269,14 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
 
                         if (flen > 0.0 and aln->isPaired() and useFragLengthDist and considerCondProb) {
                           size_t fl = flen;
-                          double lenProb = fragLengthDist.pmf(fl); 
+                          double lenProb = fldSnapshot->pmf(fl); 
                           if (burnedIn) {
                             /* condition fragment length prob on txp length */
-                            double refLengthCM = fragLengthDist.cmf(static_cast<size_t>(refLength)); 
+                            double refLengthCM = fldSnapshot->cmf(static_cast<size_t>(refLength)); 
                             bool computeMass = fl < refLength and !salmon::math::isLog0(refLengthCM);
                             logFragProb = (computeMass) ?
                                                     (lenProb - refLengthCM) :
                               salmon::math::LOG_EPSILON;
-                            if (computeMass and refLengthCM < lenProb) {
-                              // Threading is hard!  It's possible that an update to the PMF snuck in between when we asked to cache the CMF and when the
-                              // "burnedIn" variable was last seen as false.
-                              log->info("reference length = {}, CMF[refLen] = {}, fragLen = {}, PMF[fragLen] = {}",
-                                        refLength, std::exp(refLengthCM), aln->fragLen(), std::exp(lenProb));
-                            }
                           } else if (useAuxParams) {
                             logFragProb = lenProb;
                           }
@@ -770,7 +742,7 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
             // reclaim the memory for these fragments and alignments
             // and delete the mini batch.
             if (processedCache == nullptr) {
-                miniBatch->release(fragmentQueue, alignmentGroupQueue);
+                miniBatch->release(fragmentQueue, alignmentGroupQueue, poolRefilled);
                 delete miniBatch;
             } else {
             // Otherwise, just put the mini-batch on the processed queue
@@ -805,6 +777,8 @@ void processMiniBatch(AlignmentLibrary<FragT>& alnLib,
         log->info("Thread saw mini-batch with a maximum of {0:.2f}\% zero probability fragments", 
                   maxZeroFrac);
     }
+    waitStats.addActive(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - threadStart).count());
 
 }
 
@@ -893,9 +867,9 @@ bool quantifyLibrary(
             }
         }
 
-        volatile bool doneParsing{false};
-        std::condition_variable workAvailable;
-        std::mutex cvmutex;
+        std::atomic<bool> doneParsing{false};
+        AdaptiveWait workAvailable;
+        WaitStats quantWaitStats;
         std::vector<std::thread> workers;
         std::atomic<size_t> activeBatches{0};
         auto currentQuantThreads = (haveCache) ?
@@ -919,7 +893,7 @@ bool quantifyLibrary(
                     firstTimestepOfRound,
                     std::ref(*workQueuePtr),
                     processedCachePtr,
-                    std::ref(workAvailable), std::ref(cvmutex),
+                    std::ref(workAvailable), std::ref(quantWaitStats),
                     std::ref(doneParsing), std::ref(activeBatches),
                     std::ref(salmonOpts),
 		    std::ref(observedBiasParams[i]),
@@ -934,11 +908,12 @@ bool quantifyLibrary(
             BAMQueue<FragT>& bq = alnLib.getAlignmentGroupQueue();
             std::vector<AlignmentGroup<FragT*>*>* alignments = new std::vector<AlignmentGroup<FragT*>*>;
             alignments->reserve(miniBatchSize);
-            AlignmentGroup<FragT*>* ag;
 
-            bool alignmentGroupsRemain = bq.getAlignmentGroup(ag);
+            // Take the parsed alignment groups in bulk, directly into the
+            // current minibatch.
+            size_t numGroups = bq.getAlignmentGroups(*alignments, miniBatchSize);
+            bool alignmentGroupsRemain = (numGroups > 0);
             while (alignmentGroupsRemain or alignments->size() > 0) {
-                if (alignmentGroupsRemain) { alignments->push_back(ag); }
                 // If this minibatch has reached the size limit, or we have nothing
                 // left to fill it up with
                 if (alignments->size() >= miniBatchSize or !alignmentGroupsRemain) {
@@ -947,24 +922,23 @@ bool quantifyLibrary(
                     MiniBatchInfo<AlignmentGroup<FragT*>>* mbi =
                         new MiniBatchInfo<AlignmentGroup<FragT*>>(batchNum, alignments, logForgettingMass);
                     workQueuePtr->push(mbi);
-                    {
-                        std::unique_lock<std::mutex> l(cvmutex);
-                        workAvailable.notify_one();
-                    }
+                    workAvailable.notifyOne();
                     alignments = new std::vector<AlignmentGroup<FragT*>*>;
                     alignments->reserve(miniBatchSize);
                 }
 
-                if ((numProc % 1000000 == 0) or !alignmentGroupsRemain) {
+                if ((numProc / 1000000 != (numProc + numGroups) / 1000000) or
+                    !alignmentGroupsRemain) {
                     fmt::print(stderr, "\r\r{}processed{} {} {}reads in current round{}",
-                            ioutils::SET_GREEN, ioutils::SET_RED, numProc,
+                            ioutils::SET_GREEN, ioutils::SET_RED, numProc + numGroups,
                             ioutils::SET_GREEN, ioutils::RESET_COLOR);
                     fileLog->info("quantification processed {} fragments so far\n",
-                                   numProc);
+                                   numProc + numGroups);
                 }
 
-                ++numProc;
-                alignmentGroupsRemain = bq.getAlignmentGroup(ag);
+                numProc += numGroups;
+                numGroups = bq.getAlignmentGroups(*alignments, miniBatchSize - alignments->size());
+                alignmentGroupsRemain = (numGroups > 0);
             }
             fmt::print(stderr, "\n");
 
@@ -980,30 +954,26 @@ bool quantifyLibrary(
             fmt::print(stderr, "\n");
         }
 
+        // Workers that find the queue empty once parsing is done will exit;
+        // the rest drain what's left of it.
         doneParsing = true;
-
-        /**
-          * This could be a problem for small sets of alignments --- make sure the
-          * work queue is empty!!
-          * --- Thanks for finding a dataset that exposes this bug, Richard (Smith-Unna)!
-          */
-        size_t t = 0;
-        while (!workQueuePtr->empty()) {
-            std::unique_lock<std::mutex> l(cvmutex);
-            workAvailable.notify_one();
-        }
+        workAvailable.notifyAll();
 
         size_t tnum{0};
         for (auto& t : workers) {
             fmt::print(stderr, "\r\rkilling thread {} . . . ", tnum++);
-            {
-                std::unique_lock<std::mutex> l(cvmutex);
-                workAvailable.notify_all();
-            }
             t.join();
             fmt::print(stderr, "done");
         }
         fmt::print(stderr, "\n\n");
+        fileLog->info("{} quantification thread(s) busy {:.2f}s, idle {:.2f}s ({} parked waits)",
+                      currentQuantThreads, quantWaitStats.busySeconds(),
+                      quantWaitStats.idleSeconds(), quantWaitStats.numParks.load());
+        if (!haveCache) {
+            auto& parseWaitStats = alnLib.getAlignmentGroupQueue().consumerWaitStats();
+            fileLog->info("waited {:.2f}s ({} parked waits) for parsed alignment groups",
+                          parseWaitStats.idleSeconds(), parseWaitStats.numParks.load());
+        }
 
         numObservedFragments += alnLib.numMappedFragments();
 
@@ -1115,11 +1085,12 @@ bool quantifyLibrary(
     if (haveCache) {
         auto& fragmentQueue = alnLib.fragmentQueue();
         auto& alignmentGroupQueue = alnLib.alignmentGroupQueue();
+        auto& poolRefilled = alnLib.poolRefilled();
 
         MiniBatchInfo<AlignmentGroup<FragT*>>* mbi = nullptr;
         while (!processedCache.empty()) {
             while (processedCache.try_pop(mbi)) {
-                mbi->release(fragmentQueue, alignmentGroupQueue);
+                mbi->release(fragmentQueue, alignmentGroupQueue, poolRefilled);
                 delete mbi;
             }
         }
@@ -1170,6 +1141,17 @@ bool processSample(AlignmentLibrary<ReadT>& alnLib,
     // Write the main results
     gzw.writeAbundances(sopt, alnLib);
 
+    /** If the user requested gene-level abundances, then compute those now **/
+    if (!sopt.geneMapPath.empty()) {
+      try {
+        salmon::utils::generateGeneLevelEstimates(sopt, alnLib, outputDirectory);
+      } catch (std::exception& e) {
+        fmt::print(stderr, "Error: [{}] when trying to compute gene-level "
+                           "estimates. The gene-level file(s) may not exist",
+                   e.what());
+      }
+    }
+
     // If we are dumping the equivalence classes, then
     // do it here.
     if (sopt.dumpEq) {
@@ -1323,6 +1305,11 @@ int salmonAlignmentQuantify(int argc, char* argv[]) {
        po::bool_switch(&(sopt.dumpEqWeights))->default_value(false),
        "Includes \"rich\" equivlance class weights in the output when equivalence "
        "class information is being dumped to file.")
+      ("dumpEqFormat",
+       po::value<std::string>(&(sopt.dumpEqFormat))->default_value("text"),
+       "The format in which equivalence classes are dumped (with --dumpEq); one of \"text\" "
+       "(eq_classes.txt) or \"binary\" (eq_classes.bin, a compact, block-compressed format that "
+       "can be converted to text with `salmon eqconvert`).")
     ("fldMax" , po::value<size_t>(&(sopt.fragLenDistMax))->default_value(1000), "The maximum fragment length to consider when building the empirical distribution")
     ("fldMean", po::value<size_t>(&(sopt.fragLenDistPriorMean))->default_value(250), "The mean used in the fragment length distribution prior")
     ("fldSD" , po::value<size_t>(&(sopt.fragLenDistPriorSD))->default_value(25), "The standard deviation used in the fragment length distribution prior")
@@ -1348,6 +1335,15 @@ int salmonAlignmentQuantify(int argc, char* argv[]) {
           "when evaluating sequence-specific & GC fragment bias.  Larger values speed up effective "
           "length correction, but may decrease the fidelity of bias modeling "
           "results.")
+    ("numBiasRounds",
+          po::value<std::uint32_t>(&(sopt.numBiasRounds))->default_value(1),
+          "The number of rounds of bias (and effective length) re-estimation to perform during "
+          "the offline EM.  Every round after the first only updates the expected bias contributions of the "
+          "transcripts whose abundance changed by more than --biasUpdateThreshold.")
+    ("biasUpdateThreshold",
+          po::value<double>(&(sopt.biasUpdateThreshold))->default_value(0.05),
+          "The relative change in a transcript's weight (abundance / effective length) above which "
+          "its expected bias contribution is updated in rounds of bias re-estimation after the first.")
     ("mappingCacheMemoryLimit", po::value<uint32_t>(&(sopt.mappingCacheMemoryLimit))->default_value(2000000), "If the file contained fewer than this "
                                         "many mapped reads, then just keep the data in memory for subsequent rounds of inference. Obviously, this value should "
                                         "not be too large if you wish to keep a low memory usage, but setting it large enough to accommodate all of the mapped "
@@ -1571,11 +1567,9 @@ transcript abundance from RNA-seq reads
         // The transcript file contains the target sequences
         bfs::path transcriptFile(vm["targets"].as<std::string>());
 
-        // Currently, one thread is used for parsing the alignment file.
-        // Hopefully, in the future, samtools will implemented multi-threaded
-        // BAM/SAM parsing, as this is the current bottleneck.  For the time
-        // being, however, the number of quantification threads is the
-        // total number of threads - 1.
+        // The parse threads are split between io_lib's block decompression
+        // and the BAMQueue's record decoding (see BAMQueue::fillQueue_);
+        // the rest of the threads are used for quantification.
         uint32_t numParseThreads = std::min(uint32_t(6),
                                             std::max(uint32_t(2), uint32_t(std::ceil(numThreads/2.0))));
         numThreads = std::max(numThreads, numParseThreads);
@@ -1639,20 +1633,6 @@ transcript abundance from RNA-seq reads
           return 1;
         }
 
-        bfs::path estFilePath = outputDirectory / "quant.sf";
-
-        /** If the user requested gene-level abundances, then compute those now **/
-        if (vm.count("geneMap")) {
-            try {
-                salmon::utils::generateGeneLevelEstimates(sopt.geneMapPath,
-                                                            outputDirectory);
-            } catch (std::exception& e) {
-                fmt::print(stderr, "Error: [{}] when trying to compute gene-level "\
-                                   "estimates. The gene-level file(s) may not exist",
-                                   e.what());
-            }
-        }
-
     } catch (po::error& e) {
         std::cerr << "exception : [" << e.what() << "]. Exiting.\n";
         std::exit(1);
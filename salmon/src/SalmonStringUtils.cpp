@@ -5,6 +5,11 @@
 
 uint8_t* salmon::stringtools::encodeSequenceInSAM(const char* src, size_t len) {
     uint8_t* target = new uint8_t[static_cast<size_t>(ceil(len / 2.0))]();
+    encodeSequenceInSAM(src, len, target);
+    return target;
+}
+
+void salmon::stringtools::encodeSequenceInSAM(const char* src, size_t len, uint8_t* target) {
     for(size_t i = 0; i < len; ++i) {
         size_t byte = i >> 1;
         size_t nibble = i & 0x1;
@@ -14,6 +19,5 @@ uint8_t* salmon::stringtools::encodeSequenceInSAM(const char* src, size_t len) {
             target[byte] |= (charToSamEncode[src[i]] << 4);
         }
     }
-    return target;
 }
 
@@ -1,11 +1,14 @@
 #include <algorithm>
+#include <cstdio>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/range/join.hpp>
 #include <boost/thread/thread.hpp>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <set>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
@@ -16,6 +19,8 @@
 
 #include "AlignmentLibrary.hpp"
 #include "DistributionUtils.hpp"
+#include "ExpectedBiasState.hpp"
+#include "ExpectedGCAccumulator.hpp"
 #include "GCFragModel.hpp"
 #include "KmerContext.hpp"
 #include "LibraryFormat.hpp"
@@ -40,6 +45,7 @@
 #include "GenomicFeature.hpp"
 #include "SGSmooth.hpp"
 #include "TranscriptGeneMap.hpp"
+#include "xxhash.h"
 
 #include "StadenUtils.hpp"
 
@@ -1665,6 +1671,13 @@ bool processQuantOptions(SalmonOpts& sopt,
       return false;
     }
 
+    if (sopt.dumpEqFormat != "text" and sopt.dumpEqFormat != "binary") {
+      jointLog->critical("The --dumpEqFormat must be either \"text\" or \"binary\"; "
+                         "you provided \"{}\".", sopt.dumpEqFormat);
+      jointLog->flush();
+      return false;
+    }
+
     if (sopt.noLengthCorrection) {
       bool anyBiasCorrect =
         sopt.gcBiasCorrect or sopt.biasCorrect or sopt.posBiasCorrect;
@@ -1715,7 +1728,8 @@ bool processQuantOptions(SalmonOpts& sopt,
 template <typename AbundanceVecT, typename ReadExpT>
 Eigen::VectorXd updateEffectiveLengths(SalmonOpts& sopt, ReadExpT& readExp,
                                        Eigen::VectorXd& effLensIn,
-                                       AbundanceVecT& alphas, std::vector<bool>& available, bool writeBias) {
+                                       AbundanceVecT& alphas, std::vector<bool>& available, bool writeBias,
+                                       ExpectedBiasState* biasState) {
 
   using std::vector;
   using BlockedIndexRange = tbb::blocked_range<size_t>;
@@ -1818,48 +1832,80 @@ Eigen::VectorXd updateEffectiveLengths(SalmonOpts& sopt, ReadExpT& readExp,
    */
   class CombineableBiasParams {
   public:
-    CombineableBiasParams(uint32_t K, size_t numCondBins, size_t numGCBins) :
-      expectGC(numCondBins, numGCBins, distribution_utils::DistributionSpace::LINEAR) {
-      expectPos5 = std::vector<SimplePosBias>(5);
-      expectPos3 = std::vector<SimplePosBias>(5);
+    CombineableBiasParams(uint32_t K, size_t numCondBins, size_t numGCBins,
+                          size_t numLengthClasses, size_t numPosBins) :
+      expectGC(numCondBins, numGCBins, distribution_utils::DistributionSpace::LINEAR),
+      gcAccumulator(numCondBins, numGCBins) {
+      expectPos5.assign(numLengthClasses, std::vector<double>(numPosBins, 0.0));
+      expectPos3.assign(numLengthClasses, std::vector<double>(numPosBins, 0.0));
     }
 
-    std::vector<SimplePosBias> expectPos5;
-    std::vector<SimplePosBias> expectPos3;
+    // (linear-space) positional masses for each length class and bin
+    std::vector<std::vector<double>> expectPos5;
+    std::vector<std::vector<double>> expectPos3;
     SBModel expectSeqFW;
     SBModel expectSeqRC;
     GCFragModel expectGC;
+    // scratch space for computing expectGC
+    ExpectedGCAccumulator gcAccumulator;
   };
 
-  auto revComplement = [](const char* s, int32_t l, std::string& o) -> void {
-    if (l > o.size()) {
-      o.resize(l, 'A');
-    }
-    int32_t j = 0;
-    for (int32_t i = l - 1; i >= 0; --i, ++j) {
-      switch (s[i]) {
-      case 'A':
-      case 'a':
-        o[j] = 'T';
-        break;
-      case 'C':
-      case 'c':
-        o[j] = 'G';
-        break;
-      case 'T':
-      case 't':
-        o[j] = 'A';
-        break;
-      case 'G':
-      case 'g':
-        o[j] = 'C';
-        break;
-      default:
-        o[j] = 'N';
-        break;
-      }
+  /**
+   * The reverse complement of every transcript, computed once (in the arena
+   * holding the transcript sequences) and shared by all of the passes over
+   * the transcripts below, and by every later call (it's only needed for
+   * sequence-specific bias).
+   */
+  auto& txpSeqs = readExp.transcriptSequences();
+  if (seqBiasCorrect and !txpSeqs.hasReverseComplements()) {
+    std::vector<uint32_t> rcLengths;
+    rcLengths.reserve(transcripts.size());
+    for (const auto& txp : transcripts) {
+      rcLengths.push_back(txp.RefLength);
     }
+    txpSeqs.computeReverseComplements(rcLengths);
+  }
+
+  /**
+   * Per-thread scratch space for the passes over the transcripts below.
+   * Every buffer is sized for the longest transcript, so that the passes
+   * don't allocate per transcript; each transcript uses only the first
+   * refLen entries.
+   */
+  size_t maxRefLen{0};
+  for (const auto& txp : transcripts) {
+    maxRefLen = std::max(maxRefLen, static_cast<size_t>(txp.RefLength));
+  }
+  class BiasWorkspace {
+  public:
+    BiasWorkspace(size_t n)
+        : contextCountsFP(n), contextCountsTP(n), windowLensFP(n),
+          windowLensTP(n), seqFactorsFW(n), seqFactorsRC(n) {
+      posFactorsFW.reserve(n);
+      posFactorsRC.reserve(n);
+    }
+
+    // Zero the context counts of a transcript of length refLen
+    void clearContext(int32_t refLen) {
+      contextCountsFP.head(refLen).setZero();
+      contextCountsTP.head(refLen).setZero();
+      windowLensFP.head(refLen).setZero();
+      windowLensTP.head(refLen).setZero();
+    }
+
+    Eigen::VectorXd contextCountsFP;
+    Eigen::VectorXd contextCountsTP;
+    Eigen::VectorXd windowLensFP;
+    Eigen::VectorXd windowLensTP;
+    Eigen::VectorXd seqFactorsFW;
+    Eigen::VectorXd seqFactorsRC;
+    std::vector<double> posFactorsFW;
+    std::vector<double> posFactorsRC;
   };
+  auto getWorkspace = [maxRefLen]() -> BiasWorkspace {
+    return BiasWorkspace(maxRefLen);
+  };
+  tbb::combinable<BiasWorkspace> workspaces(getWorkspace);
 
   int outsideContext{3};
   int insideContext{2};
@@ -1973,12 +2019,38 @@ int contextSize = outsideContext + insideContext;
   */
 
 
+  // Maps positions to positional bias bins
+  const auto& posBinner = pos5Obs.front();
+
+  /**
+   * The expected distributions are accumulated into `state`.  If the caller
+   * passed in a state that an earlier call filled in, then only the
+   * transcripts whose weight has changed (by more than
+   * sopt.biasUpdateThreshold, relatively) are visited, and each adds the
+   * change in its weight times its contribution.  Otherwise, every
+   * transcript is visited, with a previous weight of 0.
+   */
+  ExpectedBiasState localState(sopt.numConditionalGCBins, sopt.numFragGCBins);
+  ExpectedBiasState& state = (biasState != nullptr) ? *biasState : localState;
+  bool incremental = state.initialized;
+  double updateThreshold = sopt.biasUpdateThreshold;
+  size_t numLengthClasses = pos5Obs.size();
+  size_t numPosBins = posBinner.numBins();
+  if (!incremental) {
+    state.weights.assign(transcripts.size(), 0.0);
+    state.expectPos5.assign(numLengthClasses, std::vector<double>(numPosBins, 0.0));
+    state.expectPos3.assign(numLengthClasses, std::vector<double>(numPosBins, 0.0));
+  }
+  std::atomic<size_t> numUpdatedTranscripts{0};
+
+
   /**
    * The local bias terms from each thread can be combined
    * via simple summation.
    */
-  auto getBiasParams = [K, &sopt]() -> CombineableBiasParams {
-    return CombineableBiasParams(K, sopt.numConditionalGCBins, sopt.numFragGCBins);
+  auto getBiasParams = [K, &sopt, numLengthClasses, numPosBins]() -> CombineableBiasParams {
+    return CombineableBiasParams(K, sopt.numConditionalGCBins, sopt.numFragGCBins,
+                                 numLengthClasses, numPosBins);
   };
   tbb::combinable<CombineableBiasParams> expectedDist(getBiasParams);
   std::atomic<size_t> numBackgroundTranscripts{0};
@@ -1991,10 +2063,11 @@ int contextSize = outsideContext + insideContext;
         auto& expectSeqFW = expectedDist.local().expectSeqFW;
         auto& expectSeqRC = expectedDist.local().expectSeqRC;
         auto& expectGC = expectedDist.local().expectGC;
+        auto& gcAccumulator = expectedDist.local().gcAccumulator;
         auto& expectPos5 = expectedDist.local().expectPos5;
         auto& expectPos3 = expectedDist.local().expectPos3;
+        auto& ws = workspaces.local();
 
-        std::string rcSeq;
         // For each transcript
         for (auto it : boost::irange(range.begin(), range.end())) {
 
@@ -2021,38 +2094,52 @@ int contextSize = outsideContext + insideContext;
             return (x > cdfMaxArg) ? 1.0 : (cdf[x] / cdfMaxVal);
           };
 
-          // Skip transcripts with trivial expression or that are too
-          // short
+          // Transcripts with trivial expression or that are too
+          // short don't contribute
+          double newWeight{0.0};
           if (alphas[it] < minAlpha or
               unprocessedLen <= 0) { // or txp.uniqueUpdateFraction() < 0.90) {
             if (alphas[it] >= minAlpha) {
               ++numExpressedTranscripts;
             }
+          } else {
+            ++numBackgroundTranscripts;
+            // Otherwise, this transcript contributes with the following weight
+            newWeight = (alphas[it] / effLensIn(it));
+          }
+
+          // If this transcript's weight hasn't changed (enough), then keep
+          // its current contribution.
+          double oldWeight = state.weights[it];
+          double weightDiff = newWeight - oldWeight;
+          if (weightDiff == 0.0 or
+              (incremental and
+               std::abs(weightDiff) <= updateThreshold * std::max(newWeight, oldWeight))) {
             continue;
           }
-          ++numBackgroundTranscripts;
+          state.weights[it] = newWeight;
+          ++numUpdatedTranscripts;
 
-          // Otherwise, proceed giving this transcript the following weight
-          double weight = (alphas[it] / effLensIn(it));
+          // Every contribution below is scaled by the *change* in weight
+          double weight = weightDiff;
 
-          Eigen::VectorXd contextCountsFP(refLen);
-          Eigen::VectorXd contextCountsTP(refLen);
-          Eigen::VectorXd windowLensFP(refLen);
-          Eigen::VectorXd windowLensTP(refLen);
-          contextCountsFP.setZero();
-          contextCountsTP.setZero();
-          windowLensFP.setZero();
-          windowLensTP.setZero();
+          auto& contextCountsFP = ws.contextCountsFP;
+          auto& contextCountsTP = ws.contextCountsTP;
+          auto& windowLensFP = ws.windowLensFP;
+          auto& windowLensTP = ws.windowLensTP;
+          ws.clearContext(refLen);
 
-          // This transcript's sequence
+          // This transcript's sequence (and its reverse complement)
           const char* tseq = txp.Sequence();
-          revComplement(tseq, refLen, rcSeq);
-          const char* rseq = rcSeq.c_str();
+          const char* rseq =
+              seqBiasCorrect ? txpSeqs.reverseComplement(it) : nullptr;
 
           Mer fwmer;
-          fwmer.from_chars(tseq);
           Mer rcmer;
-          rcmer.from_chars(rseq);
+          if (seqBiasCorrect) {
+            fwmer.from_chars(tseq);
+            rcmer.from_chars(rseq);
+          }
           int32_t contextLength{expectSeqFW.getContextLength()};
 
           if (gcBiasCorrect and seqBiasCorrect) {
@@ -2090,54 +2177,26 @@ int contextSize = outsideContext + insideContext;
               rcmer.shift_left(rseq[fragStartPos + contextLength]);
             } // end: Seq-specific bias
 
-            // fragment-GC bias
-            if (gcBiasCorrect) {
-              size_t sp =
-                  static_cast<size_t>((locFLDLow > 0) ? locFLDLow - 1 : 0);
-              double prevFLMass = conditionalCDF(sp);
-              int32_t fragStart = fragStartPos;
-              for (int32_t fl = locFLDLow; fl <= locFLDHigh; fl += gcSamp) {
-                int32_t fragEnd = fragStart + fl - 1;
-                if (fragEnd < refLen) {
-                  // The GC fraction for this putative fragment
-                  auto gcFrac = txp.gcFrac(fragStart, fragEnd);
-                  /*
-                  int32_t contextFrac = std::lrint(
-                                                   (contextCountsFP[fragStart] + contextCountsTP[fragEnd]) *
-                                                   cscale);
-                  */ 
-                  double contextLength = (windowLensFP[fragStart] + windowLensTP[fragEnd]);
-                  int32_t contextFrac = (contextLength > 0) ?
-                    (std::lrint(100.0 *
-                               (contextCountsFP[fragStart] + contextCountsTP[fragEnd]) / contextLength)) :
-                    0;
-                  
-                  GCDesc desc{gcFrac, contextFrac};
-                  expectGC.inc(desc,
-                               weight * (conditionalCDF(fl) - prevFLMass));
-                  prevFLMass = conditionalCDF(fl);
-                } else {
-                  break;
-                } // no more valid positions
-              }   // end: for each fragment length
-            }     // end: fragment GC bias
-
             // positional bias
             if (posBiasCorrect) {
               int32_t maxFragLenFW = refLen - fragStartPos + 1;
               int32_t maxFragLenRC = fragStartPos;
               auto densityFW = conditionalCDF(maxFragLenFW);
               auto densityRC = conditionalCDF(maxFragLenRC);
-              if (weight * densityFW > EPSILON) {
-                expectPos5[txp.lengthClassIndex()].addMass(
-                    fragStartPos, txp.RefLength, std::log(weight * densityFW));
-              }
-              if (weight * densityRC > EPSILON) {
-                expectPos3[txp.lengthClassIndex()].addMass(
-                    fragStartPos, txp.RefLength, std::log(weight * densityRC));
-              }
+              auto bin = posBinner.bin(fragStartPos, refLen);
+              expectPos5[txp.lengthClassIndex()][bin] += weight * densityFW;
+              expectPos3[txp.lengthClassIndex()][bin] += weight * densityRC;
             }
           } // end: for every fragment start position
+
+          // fragment-GC bias
+          if (gcBiasCorrect) {
+            gcAccumulator.addTranscript(txp, refLen - K, locFLDLow, locFLDHigh,
+                                        gcSamp, conditionalCDF,
+                                        contextCountsFP, contextCountsTP,
+                                        windowLensFP, windowLensTP, weight,
+                                        expectGC);
+          } // end: fragment GC bias
         }   // end for each transcript
 
       } // end tbb for function
@@ -2156,57 +2215,109 @@ int contextSize = outsideContext + insideContext;
     sopt.biasCorrect = false;
     sopt.gcBiasCorrect = false;
     sopt.posBiasCorrect = false;
+    // The thread-local changes were never folded into the state
+    state.initialized = false;
     return effLensIn;
   }
 
   /**
    * The local bias terms from each thread can be combined
-   * via simple summation.  Here, we combine the locally-computed
-   * bias terms.
+   * via simple summation.  Here, we add the locally-computed
+   * changes to the (running) expected distributions.
    */
-  SBModel exp5;
-  SBModel exp3;
-
-  auto& pos5Exp = readExp.posBiasExpected(salmon::utils::Direction::FORWARD);
-  auto& pos3Exp = readExp.posBiasExpected(salmon::utils::Direction::REVERSE_COMPLEMENT);
-
   auto combineBiasParams =
-      [seqBiasCorrect, gcBiasCorrect, posBiasCorrect, &pos5Exp, &pos3Exp, &exp5,
-       &exp3, &transcriptGCDist](const CombineableBiasParams& p) -> void {
+      [seqBiasCorrect, gcBiasCorrect, posBiasCorrect,
+       &state](const CombineableBiasParams& p) -> void {
     if (seqBiasCorrect) {
-      exp5.combineCounts(p.expectSeqFW);
-      exp3.combineCounts(p.expectSeqRC);
+      state.expectSeqFW.combineCounts(p.expectSeqFW);
+      state.expectSeqRC.combineCounts(p.expectSeqRC);
     }
     if (gcBiasCorrect) {
-      transcriptGCDist.combineCounts(p.expectGC);
+      state.expectGC.combineCounts(p.expectGC);
     }
     if (posBiasCorrect) {
       for (size_t i = 0; i < p.expectPos5.size(); ++i) {
-        pos5Exp[i].combine(p.expectPos5[i]);
-        pos3Exp[i].combine(p.expectPos3[i]);
+        for (size_t b = 0; b < p.expectPos5[i].size(); ++b) {
+          state.expectPos5[i][b] += p.expectPos5[i][b];
+          state.expectPos3[i][b] += p.expectPos3[i][b];
+        }
       }
     }
   };
   expectedDist.combine_each(combineBiasParams);
+  state.initialized = true;
+
+  // The normalized expected distributions
+  SBModel exp5 = state.expectSeqFW;
+  SBModel exp3 = state.expectSeqRC;
+
+  auto& pos5Exp = readExp.posBiasExpected(salmon::utils::Direction::FORWARD);
+  auto& pos3Exp = readExp.posBiasExpected(salmon::utils::Direction::REVERSE_COMPLEMENT);
 
   // finalize expected positional biases
   if (posBiasCorrect) {
+    auto setPosBias = [](SimplePosBias& pb, const std::vector<double>& masses) -> void {
+      pb.reset();
+      for (size_t b = 0; b < masses.size(); ++b) {
+        if (masses[b] > EPSILON) { pb.addLinearMass(b, masses[b]); }
+      }
+      pb.finalize();
+    };
     for (size_t i = 0; i < pos5Exp.size(); ++i) {
-      pos5Exp[i].finalize();
-      pos3Exp[i].finalize();
+      setPosBias(pos5Exp[i], state.expectPos5[i]);
+      setPosBias(pos3Exp[i], state.expectPos3[i]);
+    }
+  }
+
+  // The positional bias factors (observed / expected) of each length class,
+  // tabulated once here rather than evaluated from the splines per transcript
+  std::vector<PosBiasRatio> posRatio5;
+  std::vector<PosBiasRatio> posRatio3;
+  if (posBiasCorrect) {
+    for (size_t i = 0; i < pos5Exp.size(); ++i) {
+      posRatio5.emplace_back(pos5Obs[i], pos5Exp[i]);
+      posRatio3.emplace_back(pos3Obs[i], pos3Exp[i]);
     }
   }
   if (gcBiasCorrect) {
+    transcriptGCDist.combineCounts(state.expectGC);
     transcriptGCDist.normalize();
   }
 
-  sopt.jointLog->info("Computed expected counts (for bias correction)");
+  if (incremental) {
+    sopt.jointLog->info("Updated expected counts (for bias correction) "
+                        "for {} transcripts whose weight changed",
+                        numUpdatedTranscripts.load());
+  } else {
+    sopt.jointLog->info("Computed expected counts (for bias correction)");
+  }
 
   auto gcBias = gcCounts.ratio(transcriptGCDist, 1000.0);
 
   exp5.normalize();
   exp3.normalize();
 
+  // The sequence-specific bias factor (observed / expected probability) of
+  // every possible context, indexed by the packed context, so that scoring
+  // a transcript is one table lookup per position.
+  std::vector<double> seqFactorTableFW;
+  std::vector<double> seqFactorTableRC;
+  if (seqBiasCorrect) {
+    size_t numContexts = exp5.numContexts();
+    seqFactorTableFW.resize(numContexts);
+    seqFactorTableRC.resize(numContexts);
+    tbb::parallel_for(
+        BlockedIndexRange(size_t(0), numContexts),
+        [&](const BlockedIndexRange& range) -> void {
+          for (auto ctx : boost::irange(range.begin(), range.end())) {
+            seqFactorTableFW[ctx] =
+                std::exp(obs5.evaluateLogPacked(ctx) - exp5.evaluateLogPacked(ctx));
+            seqFactorTableRC[ctx] =
+                std::exp(obs3.evaluateLogPacked(ctx) - exp3.evaluateLogPacked(ctx));
+          }
+        });
+  }
+
   bool noThreshold = sopt.noBiasLengthThreshold;
   std::atomic<size_t> numCorrected{0};
   std::atomic<size_t> numUncorrected{0};
@@ -2225,7 +2336,7 @@ int contextSize = outsideContext + insideContext;
       BlockedIndexRange(size_t(0), size_t(transcripts.size())),
       [&](const BlockedIndexRange& range) -> void {
 
-        std::string rcSeq;
+        auto& ws = workspaces.local();
         // For each transcript
         for (auto it : boost::irange(range.begin(), range.end())) {
 
@@ -2259,27 +2370,26 @@ int contextSize = outsideContext + insideContext;
               and unprocessedLen > 0
               and cdfMaxVal > minCDFMass) {
 
-            Eigen::VectorXd seqFactorsFW(refLen);
-            Eigen::VectorXd seqFactorsRC(refLen);
-            seqFactorsFW.setOnes();
-            seqFactorsRC.setOnes();
+            auto& seqFactorsFW = ws.seqFactorsFW;
+            auto& seqFactorsRC = ws.seqFactorsRC;
+            seqFactorsFW.head(refLen).setOnes();
+            seqFactorsRC.head(refLen).setOnes();
 
-            Eigen::VectorXd contextCountsFP(refLen);
-            Eigen::VectorXd contextCountsTP(refLen);
-            Eigen::VectorXd windowLensFP(refLen);
-            Eigen::VectorXd windowLensTP(refLen);
-            contextCountsFP.setZero();
-            contextCountsTP.setZero();
-            windowLensFP.setZero();
-            windowLensTP.setZero();
+            auto& contextCountsFP = ws.contextCountsFP;
+            auto& contextCountsTP = ws.contextCountsTP;
+            auto& windowLensFP = ws.windowLensFP;
+            auto& windowLensTP = ws.windowLensTP;
+            ws.clearContext(refLen);
 
-            std::vector<double> posFactorsFW(refLen, 1.0);
-            std::vector<double> posFactorsRC(refLen, 1.0);
+            auto& posFactorsFW = ws.posFactorsFW;
+            auto& posFactorsRC = ws.posFactorsRC;
+            posFactorsFW.assign(refLen, 1.0);
+            posFactorsRC.assign(refLen, 1.0);
 
-            // This transcript's sequence
+            // This transcript's sequence (and its reverse complement)
             const char* tseq = txp.Sequence();
-            revComplement(tseq, refLen, rcSeq);
-            const char* rseq = rcSeq.c_str();
+            const char* rseq =
+                seqBiasCorrect ? txpSeqs.reverseComplement(it) : nullptr;
 
             int32_t fl = locFLDLow;
             auto maxLen = std::min(refLen, locFLDHigh + 1);
@@ -2292,25 +2402,13 @@ int contextSize = outsideContext + insideContext;
             }
 
             if (posBiasCorrect) {
-              std::vector<double> posFactorsObs5(refLen, 1.0);
-              std::vector<double> posFactorsObs3(refLen, 1.0);
-              std::vector<double> posFactorsExp5(refLen, 1.0);
-              std::vector<double> posFactorsExp3(refLen, 1.0);
               auto li = txp.lengthClassIndex();
-              auto& p5O = pos5Obs[li];
-              auto& p3O = pos3Obs[li];
-              auto& p5E = pos5Exp[li];
-              auto& p3E = pos3Exp[li];
-              p5O.projectWeights(posFactorsObs5);
-              p3O.projectWeights(posFactorsObs3);
-              p5E.projectWeights(posFactorsExp5);
-              p3E.projectWeights(posFactorsExp3);
-              for (int32_t fragStart = 0; fragStart < refLen - K; ++fragStart) {
-                posFactorsFW[fragStart] =
-                    posFactorsObs5[fragStart] / posFactorsExp5[fragStart];
-                posFactorsRC[fragStart] =
-                    posFactorsObs3[fragStart] / posFactorsExp3[fragStart];
-              }
+              posRatio5[li].project(refLen, posFactorsFW.data());
+              posRatio3[li].project(refLen, posFactorsRC.data());
+              // The last K positions are left uncorrected
+              auto tail = std::max(0, refLen - K);
+              std::fill(posFactorsFW.begin() + tail, posFactorsFW.end(), 1.0);
+              std::fill(posFactorsRC.begin() + tail, posFactorsRC.end(), 1.0);
             }
 
             // Evaluate the sequence specific bias (5' and 3') over the length
@@ -2334,16 +2432,16 @@ int contextSize = outsideContext + insideContext;
                 if (kmerEndPos >= 0 and kmerEndPos < refLen and
                     readStart < refLen) {
                   seqFactorsFW[readStart] =
-                      std::exp(obs5.evaluateLog(mer) - exp5.evaluateLog(mer));
-                  seqFactorsRC[readStart] = std::exp(obs3.evaluateLog(rcmer) -
-                                                     exp3.evaluateLog(rcmer));
+                      seqFactorTableFW[exp5.packedContext(mer)];
+                  seqFactorsRC[readStart] =
+                      seqFactorTableRC[exp3.packedContext(rcmer)];
                 }
                 // shift the context one nucleotide to the right
                 mer.shift_left(tseq[fragStart + contextLength]);
                 rcmer.shift_left(rseq[fragStart + contextLength]);
               }
               // We need these in 5' -> 3' order, so reverse them
-              seqFactorsRC.reverseInPlace();
+              seqFactorsRC.head(refLen).reverseInPlace();
             } // end sequence-specific factor calculation
 
             if (numProcessed > nextUpdate) {
@@ -2569,17 +2667,143 @@ void aggregateEstimatesToGeneLevel(TranscriptGeneMap& tgm,
   //====================== From GeneSum =====================
 }
 
-void generateGeneLevelEstimates(boost::filesystem::path& geneMapPath,
-                                boost::filesystem::path& estDir) {
+template <typename ExpT>
+void aggregateEstimatesToGeneLevel(TranscriptGeneMap& tgm, ExpT& experiment,
+                                   boost::filesystem::path& outputPath) {
+  auto logger = spdlog::get("jointLog");
+  constexpr double minTPM = std::numeric_limits<double>::denorm_min();
+
+  auto& transcripts = experiment.transcripts();
+  size_t numTranscripts = transcripts.size();
+
+  // Map each transcript to its gene, once.  Transcripts that aren't in the
+  // map become their own gene.
+  std::vector<std::string> geneNames;
+  geneNames.reserve(tgm.numGenes());
+  for (size_t g = 0; g < tgm.numGenes(); ++g) {
+    geneNames.push_back(tgm.nameFromGeneID(g));
+  }
+  std::vector<uint32_t> geneOf(numTranscripts);
+  size_t numMissing{0};
+  for (size_t t = 0; t < numTranscripts; ++t) {
+    auto tid = tgm.findTranscriptID(transcripts[t].RefName);
+    if (tid != tgm.INVALID) {
+      geneOf[t] = tgm.gene(tid);
+    } else {
+      if (numMissing == 0) {
+        logger->warn("couldn't find transcript named [{}] in transcript <-> gene map; "
+                     "returning transcript as it's own gene", transcripts[t].RefName);
+      }
+      ++numMissing;
+      geneOf[t] = geneNames.size();
+      geneNames.push_back(transcripts[t].RefName);
+    }
+  }
+  if (numMissing > 1) {
+    logger->warn("{} transcripts in total were not in the transcript <-> gene map, "
+                 "and were returned as their own genes", numMissing);
+  }
+
+  // The same TPM computation as in GZipWriter::writeAbundances (which sets
+  // projectedCounts).
+  double numMappedFrags = experiment.upperBoundHits();
+  double tfracDenom{0.0};
+  for (auto& transcript : transcripts) {
+    tfracDenom += (transcript.projectedCounts / numMappedFrags) / transcript.EffectiveLength;
+  }
+
+  // Scatter-add every transcript's estimates into its gene
+  size_t numGenes = geneNames.size();
+  std::vector<double> geneTPM(numGenes, 0.0);
+  std::vector<double> geneCount(numGenes, 0.0);
+  // (TPM-weighted, and unweighted) sums of the transcript lengths
+  std::vector<double> geneLenW(numGenes, 0.0);
+  std::vector<double> geneEffLenW(numGenes, 0.0);
+  std::vector<double> geneLen(numGenes, 0.0);
+  std::vector<double> geneEffLen(numGenes, 0.0);
+  std::vector<uint32_t> geneNumTxps(numGenes, 0);
+  double million = 1000000.0;
+  for (size_t t = 0; t < numTranscripts; ++t) {
+    auto& transcript = transcripts[t];
+    auto g = geneOf[t];
+    double npm = (transcript.projectedCounts / numMappedFrags);
+    double effLength = transcript.EffectiveLength;
+    double tpm = ((npm / effLength) / tfracDenom) * million;
+    double length = transcript.CompleteLength;
+    geneTPM[g] += tpm;
+    geneCount[g] += transcript.projectedCounts;
+    geneLenW[g] += tpm * length;
+    geneEffLenW[g] += tpm * effLength;
+    geneLen[g] += length;
+    geneEffLen[g] += effLength;
+    ++geneNumTxps[g];
+  }
+
+  logger->info("Aggregating expressions to gene level");
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> output(
+      std::fopen(outputPath.c_str(), "w"), std::fclose);
+  fmt::print(output.get(), "Name\tLength\tEffectiveLength\tTPM\tNumReads\n");
+  for (size_t g = 0; g < numGenes; ++g) {
+    if (geneNumTxps[g] == 0) { continue; }
+    // If this gene was expressed, its lengths are the TPM-weighted
+    // average of its transcripts' lengths; otherwise, they are the mean.
+    double geneLength{0.0};
+    double geneEffLength{0.0};
+    if (geneTPM[g] > minTPM) {
+      geneLength = geneLenW[g] / geneTPM[g];
+      geneEffLength = geneEffLenW[g] / geneTPM[g];
+    } else {
+      geneLength = geneLen[g] / geneNumTxps[g];
+      geneEffLength = geneEffLen[g] / geneNumTxps[g];
+    }
+    fmt::print(output.get(), "{}\t{:.3f}\t{:.3f}\t{:f}\t{:f}\n", geneNames[g],
+               geneLength, geneEffLength, geneTPM[g], geneCount[g]);
+  }
+  logger->info("done");
+}
+
+TranscriptGeneMap loadTranscriptGeneMap(const SalmonOpts& sopt) {
   namespace bfs = boost::filesystem;
   auto logger = spdlog::get("jointLog");
-  logger->info("Computing gene-level abundance estimates");
+  const bfs::path& geneMapPath = sopt.geneMapPath;
   std::set<std::string> validGTFExtensions = {".gtf", ".gff", ".gff3", ".GTF", ".GFF", ".GFF3"};
   auto extension = geneMapPath.extension();
+  bool isGTF = validGTFExtensions.find(extension.string()) != validGTFExtensions.end();
+
+  // The cache is keyed by the annotation's (absolute) path, size and
+  // modification time.
+  bfs::path cachePath;
+  boost::system::error_code ec;
+  if (!sopt.indexDirectory.empty() and bfs::is_directory(sopt.indexDirectory, ec)) {
+    std::string absPath = bfs::absolute(geneMapPath).string();
+    std::vector<int64_t> params{static_cast<int64_t>(bfs::file_size(geneMapPath, ec)),
+                                static_cast<int64_t>(bfs::last_write_time(geneMapPath, ec)),
+                                isGTF ? 1 : 0};
+    uint64_t key = XXH64(absPath.data(), absPath.size(), 0);
+    key = XXH64(params.data(), params.size() * sizeof(int64_t), key);
+    char name[64];
+    std::snprintf(name, sizeof(name), "t2g_%016llx.bin",
+                  static_cast<unsigned long long>(key));
+    cachePath = sopt.indexDirectory / name;
+  }
 
   TranscriptGeneMap tranGeneMap;
+  if (!cachePath.empty() and bfs::exists(cachePath, ec)) {
+    try {
+      std::ifstream ifs(cachePath.string(), std::ios::binary);
+      cereal::BinaryInputArchive iarchive(ifs);
+      iarchive(tranGeneMap);
+      logger->info("Loaded the transcript <-> gene map from {}", cachePath.string());
+      return tranGeneMap;
+    } catch (std::exception& e) {
+      logger->warn("Could not read the cached transcript <-> gene map {} ({}); "
+                   "re-parsing {}", cachePath.string(), e.what(), geneMapPath.string());
+      tranGeneMap = TranscriptGeneMap();
+    }
+  }
+
   // parse the map as a GTF file
-  if (validGTFExtensions.find(extension.string()) != validGTFExtensions.end()) {
+  if (isGTF) {
     // Using libgff
     tranGeneMap = salmon::utils::transcriptGeneMapFromGTF(geneMapPath.string(),
                                                           "gene_id");
@@ -2589,18 +2813,50 @@ void generateGeneLevelEstimates(boost::filesystem::path& geneMapPath,
     tgfile.close();
   }
 
+  // Write the cache under a temporary name, then rename it, so that
+  // concurrent runs never see a partial file.  Failing to write it (e.g. a
+  // read-only index) is not an error.
+  if (!cachePath.empty()) {
+    bfs::path tmpPath = cachePath;
+    tmpPath += bfs::unique_path(".%%%%-%%%%.tmp", ec);
+    bool wrote{false};
+    try {
+      {
+        std::ofstream ofs(tmpPath.string(), std::ios::binary);
+        if (ofs.good()) {
+          cereal::BinaryOutputArchive oarchive(ofs);
+          oarchive(tranGeneMap);
+        }
+        wrote = ofs.good();
+      }
+      if (wrote) {
+        bfs::rename(tmpPath, cachePath, ec);
+        wrote = !ec;
+      }
+    } catch (std::exception& e) {
+      wrote = false;
+    }
+    if (!wrote) {
+      bfs::remove(tmpPath, ec);
+      logger->info("Could not cache the transcript <-> gene map in {}",
+                   sopt.indexDirectory.string());
+    }
+  }
+  return tranGeneMap;
+}
+
+template <typename ExpT>
+void generateGeneLevelEstimates(const SalmonOpts& sopt, ExpT& experiment,
+                                boost::filesystem::path& estDir) {
+  auto logger = spdlog::get("jointLog");
+  logger->info("Computing gene-level abundance estimates");
+
+  TranscriptGeneMap tranGeneMap = loadTranscriptGeneMap(sopt);
   logger->info("There were {} transcripts mapping to {} genes",
                tranGeneMap.numTranscripts(), tranGeneMap.numGenes());
 
-  bfs::path estFilePath = estDir / "quant.sf";
-  if (!bfs::exists(estFilePath)) {
-    std::stringstream errstr;
-    errstr << "Attempting to compute gene-level esimtates, but could not \n"
-           << "find isoform-level file " << estFilePath;
-    throw std::invalid_argument(errstr.str());
-  } else {
-    salmon::utils::aggregateEstimatesToGeneLevel(tranGeneMap, estFilePath);
-  }
+  boost::filesystem::path geneFilePath = estDir / "quant.genes.sf";
+  aggregateEstimatesToGeneLevel(tranGeneMap, experiment, geneFilePath);
 
   /** Create a gene-level summary of the bias-corrected estimates as well if
    * these exist **/
@@ -2626,6 +2882,16 @@ void generateGeneLevelEstimates(boost::filesystem::path& geneMapPath,
 
 // === Explicit instantiations
 
+template void salmon::utils::generateGeneLevelEstimates<ReadExperiment>(
+    const SalmonOpts& sopt, ReadExperiment& experiment,
+    boost::filesystem::path& estDir);
+template void salmon::utils::generateGeneLevelEstimates<AlignmentLibrary<UnpairedRead>>(
+    const SalmonOpts& sopt, AlignmentLibrary<UnpairedRead>& experiment,
+    boost::filesystem::path& estDir);
+template void salmon::utils::generateGeneLevelEstimates<AlignmentLibrary<ReadPair>>(
+    const SalmonOpts& sopt, AlignmentLibrary<ReadPair>& experiment,
+    boost::filesystem::path& estDir);
+
 // explicit instantiations for writing abundances ---
 template void salmon::utils::writeAbundances<AlignmentLibrary<ReadPair>>(
     const SalmonOpts& opts, AlignmentLibrary<ReadPair>& alnLib,
@@ -2705,38 +2971,44 @@ template Eigen::VectorXd
 salmon::utils::updateEffectiveLengths<std::vector<tbb::atomic<double>>,
                                       ReadExperiment>(
     SalmonOpts& sopt, ReadExperiment& readExp, Eigen::VectorXd& effLensIn,
-    std::vector<tbb::atomic<double>>& alphas, std::vector<bool>& available, bool finalRound);
+    std::vector<tbb::atomic<double>>& alphas, std::vector<bool>& available, bool finalRound,
+    ExpectedBiasState* biasState);
 
 template Eigen::VectorXd
 salmon::utils::updateEffectiveLengths<std::vector<double>, ReadExperiment>(
     SalmonOpts& sopt, ReadExperiment& readExp, Eigen::VectorXd& effLensIn,
-    std::vector<double>& alphas, std::vector<bool>& available, bool finalRound);
+    std::vector<double>& alphas, std::vector<bool>& available, bool finalRound,
+    ExpectedBiasState* biasState);
 
 template Eigen::VectorXd
 salmon::utils::updateEffectiveLengths<std::vector<tbb::atomic<double>>,
                                       AlignmentLibrary<ReadPair>>(
     SalmonOpts& sopt, AlignmentLibrary<ReadPair>& readExp,
     Eigen::VectorXd& effLensIn, std::vector<tbb::atomic<double>>& alphas,
-    std::vector<bool>& available, bool finalRound);
+    std::vector<bool>& available, bool finalRound,
+    ExpectedBiasState* biasState);
 
 template Eigen::VectorXd
 salmon::utils::updateEffectiveLengths<std::vector<double>,
                                       AlignmentLibrary<ReadPair>>(
     SalmonOpts& sopt, AlignmentLibrary<ReadPair>& readExp,
-    Eigen::VectorXd& effLensIn, std::vector<double>& alphas, std::vector<bool>& available, bool finalRound);
+    Eigen::VectorXd& effLensIn, std::vector<double>& alphas, std::vector<bool>& available, bool finalRound,
+    ExpectedBiasState* biasState);
 
 template Eigen::VectorXd
 salmon::utils::updateEffectiveLengths<std::vector<tbb::atomic<double>>,
                                       AlignmentLibrary<UnpairedRead>>(
     SalmonOpts& sopt, AlignmentLibrary<UnpairedRead>& readExp,
     Eigen::VectorXd& effLensIn, std::vector<tbb::atomic<double>>& alphas,
-    std::vector<bool>& available, bool finalRound);
+    std::vector<bool>& available, bool finalRound,
+    ExpectedBiasState* biasState);
 
 template Eigen::VectorXd
 salmon::utils::updateEffectiveLengths<std::vector<double>,
                                       AlignmentLibrary<UnpairedRead>>(
     SalmonOpts& sopt, AlignmentLibrary<UnpairedRead>& readExp,
-    Eigen::VectorXd& effLensIn, std::vector<double>& alphas, std::vector<bool>& available, bool finalRound);
+    Eigen::VectorXd& effLensIn, std::vector<double>& alphas, std::vector<bool>& available, bool finalRound,
+    ExpectedBiasState* biasState);
 
 //// 0th order model --- code for computing bias factors.
 
@@ -2,12 +2,13 @@
 #include "SalmonMath.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 
 SimplePosBias::SimplePosBias(int32_t numBins, bool logSpace)
     : numBins_(numBins),
       masses_(numBins, (logSpace ? salmon::math::LOG_1 : 1.0)),
-      isLogged_(logSpace) {}
+      pending_(numBins, 0.0), isLogged_(logSpace) {}
 
 // Add a mass of @mass to bin @bin
 void SimplePosBias::addMass(int32_t bin, double mass) {
@@ -17,22 +18,27 @@ void SimplePosBias::addMass(int32_t bin, double mass) {
 // Compute the bin for @pos on a transcript of length @length,
 // and add @mass to the appropriate bin
 void SimplePosBias::addMass(int32_t pos, int32_t length, double mass) {
-  double step = static_cast<double>(length) / numBins_;
-  int bin = std::floor(pos / step);
-  if (bin >= masses_.size()) {
-    std::cerr << "bin = " << bin << '\n';
+  int32_t b = bin(pos, length);
+  if (b >= masses_.size()) {
+    std::cerr << "bin = " << b << '\n';
   }
-  addMass(bin, mass);
+  addMass(b, mass);
+}
+
+// The bin for @pos on a transcript of length @length
+int32_t SimplePosBias::bin(int32_t pos, int32_t length) const {
+  double step = static_cast<double>(length) / numBins_;
+  return std::floor(pos / step);
 }
 
 // Project, the weights contained in "bins"
 // into the vector @out (using spline interpolation)
-void SimplePosBias::projectWeights(std::vector<double>& out) {
+void SimplePosBias::projectWeights(std::vector<double>& out) const {
   auto len = out.size();
   for (size_t p = 0; p < len; ++p) {
     // The fractional sampling factor position p would have
     double fracP = static_cast<double>(p) / len;
-    out[p] = std::max(0.001, s_(fracP));
+    out[p] = weight(fracP);
   }
 }
 
@@ -42,12 +48,24 @@ void SimplePosBias::combine(const SimplePosBias& other) {
   assert(other.masses_.size() == masses_.size());
   for (size_t i = 0; i < masses_.size(); ++i) {
     masses_[i] = salmon::math::logAdd(masses_[i], other.masses_[i]);
+    pending_[i] += other.pending_[i];
+  }
+}
+
+// Fold the pending (linear-space) masses into masses_
+void SimplePosBias::flushPending_() {
+  for (size_t i = 0; i < masses_.size(); ++i) {
+    if (pending_[i] > 0.0) {
+      masses_[i] = salmon::math::logAdd(masses_[i], std::log(pending_[i]));
+    }
+    pending_[i] = 0.0;
   }
 }
 
 // We're finished updating this distribution, so
 // compute the cdf etc.
 void SimplePosBias::finalize() {
+  flushPending_();
   // convert from log space
   double sum{0.0};
   for (size_t i = 0; i < masses_.size(); ++i) {
@@ -78,6 +96,15 @@ void SimplePosBias::finalize() {
   isFinalized_ = true;
 }
 
+// Discard all mass (and any finalization), returning this to an
+// empty, log-space distribution.
+void SimplePosBias::reset() {
+  masses_.assign(numBins_, salmon::math::LOG_1);
+  pending_.assign(numBins_, 0.0);
+  isLogged_ = true;
+  isFinalized_ = false;
+}
+
 // Seralize this model.
 bool SimplePosBias::writeBinary(boost::iostreams::filtering_ostream& out) const {
     auto* mutThis = const_cast<SimplePosBias*>(this);
@@ -94,3 +121,25 @@ bool SimplePosBias::writeBinary(boost::iostreams::filtering_ostream& out) const
     out.write(reinterpret_cast<char*>(const_cast<decltype(masses_)::value_type*>(masses_.data())), sizeof(masses_.front()) * modelLen);
     return true;
 }
+
+constexpr uint32_t PosBiasRatio::numPoints;
+
+PosBiasRatio::PosBiasRatio(const SimplePosBias& obs, const SimplePosBias& exp)
+    : table_(numPoints + 1) {
+  for (uint32_t i = 0; i <= numPoints; ++i) {
+    double frac = static_cast<double>(i) / numPoints;
+    table_[i] = obs.weight(frac) / exp.weight(frac);
+  }
+}
+
+// Fill out[p], for p in [0, len), with the ratio at fractional
+// position p / len.
+void PosBiasRatio::project(int32_t len, double* out) const {
+  const double scale = static_cast<double>(numPoints) / len;
+  for (int32_t p = 0; p < len; ++p) {
+    double x = p * scale;
+    uint32_t i = static_cast<uint32_t>(x);
+    double f = x - i;
+    out[p] = table_[i] + f * (table_[i + 1] - table_[i]);
+  }
+}
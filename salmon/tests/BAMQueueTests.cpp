@@ -0,0 +1,207 @@
+#include <fstream>
+#include <map>
+#include <random>
+
+#include "spdlog/sinks/null_sink.h"
+#include "BAMQueue.hpp"
+#include "MiniBatchInfo.hpp"
+
+namespace {
+constexpr size_t numTestTargets{10};
+
+// A read as written to a SAM file, and the alignment group it should yield
+// (if any)
+struct SamRead {
+  std::string name;
+  std::vector<std::string> records;
+  // The number of fragments in its alignment group (0 if it has none)
+  size_t numFragments;
+  bool unaligned;
+};
+
+std::string samRecord(const std::string& name, int flag, int ref, int mateRef) {
+  std::string target = (ref < 0) ? "*" : "txp" + std::to_string(ref);
+  std::string mateTarget = (mateRef < 0) ? "*" : (mateRef == ref) ? "=" : "txp" + std::to_string(mateRef);
+  std::string pos = (ref < 0) ? "0" : "101";
+  std::string matePos = (mateRef < 0) ? "0" : "151";
+  std::string cigar = (ref < 0) ? "*" : "10M";
+  return name + "\t" + std::to_string(flag) + "\t" + target + "\t" + pos + "\t255\t" +
+         cigar + "\t" + mateTarget + "\t" + matePos + "\t0\tACGTACGTAC\t*";
+}
+
+// A single-end read with numAlignments alignments (unaligned if there are none)
+SamRead unpairedRead(const std::string& name, size_t numAlignments, std::mt19937& gen) {
+  SamRead r{name, {}, numAlignments, numAlignments == 0};
+  if (numAlignments == 0) { r.records.push_back(samRecord(name, BAM_FUNMAP, -1, -1)); }
+  for (size_t i = 0; i < numAlignments; ++i) {
+    int flag = (gen() % 2) ? BAM_FREVERSE : 0;
+    r.records.push_back(samRecord(name, flag, gen() % numTestTargets, -1));
+  }
+  return r;
+}
+
+// A paired-end read with numAlignments alignments, some of which are of one
+// end only (unaligned if there are none)
+SamRead pairedRead(const std::string& name, size_t numAlignments, std::mt19937& gen) {
+  SamRead r{name, {}, numAlignments, numAlignments == 0};
+  if (numAlignments == 0) {
+    r.records.push_back(samRecord(name, BAM_FPAIRED | BAM_FUNMAP | BAM_FMUNMAP | BAM_FREAD1, -1, -1));
+    r.records.push_back(samRecord(name, BAM_FPAIRED | BAM_FUNMAP | BAM_FMUNMAP | BAM_FREAD2, -1, -1));
+  }
+  for (size_t i = 0; i < numAlignments; ++i) {
+    int ref = gen() % numTestTargets;
+    if (gen() % 4 == 0) {
+      // An orphan, whose mate didn't map
+      r.records.push_back(samRecord(name, BAM_FPAIRED | BAM_FMUNMAP | BAM_FREAD1, ref, -1));
+    } else {
+      // Either end may come first
+      bool firstIsRead2 = gen() % 2;
+      int first = BAM_FPAIRED | BAM_FPROPER_PAIR | (firstIsRead2 ? BAM_FREAD2 : BAM_FREAD1);
+      int second = BAM_FPAIRED | BAM_FPROPER_PAIR | (firstIsRead2 ? BAM_FREAD1 : BAM_FREAD2);
+      r.records.push_back(samRecord(name, first, ref, ref));
+      r.records.push_back(samRecord(name, second, ref, ref));
+    }
+  }
+  return r;
+}
+
+void writeSam(const boost::filesystem::path& path, const std::vector<SamRead>& reads,
+              const std::string& trailer = "") {
+  std::ofstream out(path.string());
+  out << "@HD\tVN:1.4\tSO:unsorted\n";
+  for (size_t t = 0; t < numTestTargets; ++t) { out << "@SQ\tSN:txp" << t << "\tLN:1000\n"; }
+  for (auto& r : reads) {
+    for (auto& rec : r.records) { out << rec << '\n'; }
+  }
+  if (!trailer.empty()) { out << trailer << '\n'; }
+}
+
+template <typename FragT>
+std::string readName(FragT* frag) {
+  // (without any terminating NUL)
+  return std::string(frag->getName(), frag->getNameLength()).c_str();
+}
+
+struct NullFilter {
+  template <typename FragT> void processFrag(FragT*) {}
+};
+
+/**
+ * Does parsing the files with a BAMQueue yield exactly one alignment group
+ * per aligned read, holding all of its alignments, and count the fragments
+ * correctly?  Each read's name must be distinct.
+ */
+template <typename FragT>
+bool groupsReads(std::vector<boost::filesystem::path> files, const std::vector<SamRead>& reads,
+                 uint32_t numParseThreads) {
+  if (!spdlog::get("jointLog")) {
+    auto sink = std::make_shared<spdlog::sinks::null_sink_mt>();
+    spdlog::create("jointLog", {sink});
+  }
+  std::map<std::string, size_t> expected;
+  size_t numUnaligned{0};
+  for (auto& r : reads) {
+    if (r.numFragments > 0) { expected[r.name] = r.numFragments; }
+    numUnaligned += r.unaligned;
+  }
+
+  constexpr bool isPaired = std::is_same<FragT, ReadPair>::value;
+  LibraryFormat libFmt(isPaired ? ReadType::PAIRED_END : ReadType::SINGLE_END,
+                       ReadOrientation::NONE, ReadStrandedness::U);
+  BAMQueue<FragT> queue(files, libFmt, numParseThreads, 1000);
+  NullFilter filter;
+  queue.start(&filter);
+
+  std::map<std::string, size_t> got;
+  bool ok{true};
+  std::vector<AlignmentGroup<FragT*>*> groups;
+  while (queue.getAlignmentGroups(groups, 1000) > 0) {
+    for (auto group : groups) {
+      auto name = readName(group->alignments().front());
+      for (auto frag : group->alignments()) {
+        ok = ok and readName(frag) == name;
+      }
+      // A read's alignments are never split over two groups
+      ok = ok and got.find(name) == got.end();
+      got[name] = group->size();
+    }
+    // Give the fragments and groups back, as the quantification threads do
+    // (the decoding threads wait for them once the pool is exhausted)
+    MiniBatchInfo<AlignmentGroup<FragT*>> batch(
+        0, new std::vector<AlignmentGroup<FragT*>*>(groups), 0.0);
+    batch.release(queue.getFragmentQueue(), queue.getAlignmentGroupQueue(),
+                  queue.poolRefilled());
+    groups.clear();
+  }
+  return ok and got == expected and queue.numMappedFragments() == expected.size() and
+         queue.numObservedFragments() == expected.size() + numUnaligned;
+}
+}
+
+SCENARIO("Alignment records are grouped by read, however they are split up for parsing") {
+  std::mt19937 gen(11);
+  auto tmp = boost::filesystem::temp_directory_path();
+  std::vector<boost::filesystem::path> paths{tmp / boost::filesystem::unique_path(),
+                                             tmp / boost::filesystem::unique_path()};
+
+  GIVEN("Single-end reads with several alignments each, over many slabs of records") {
+    std::vector<SamRead> reads;
+    for (size_t i = 0; i < 20000; ++i) {
+      reads.push_back(unpairedRead("read" + std::to_string(i), gen() % 4, gen));
+    }
+    writeSam(paths[0], reads);
+    THEN("Each aligned read is a single group, with any number of decoding threads") {
+      for (uint32_t numParseThreads : {1, 2, 8}) {
+        REQUIRE(groupsReads<UnpairedRead>({paths[0]}, reads, numParseThreads));
+      }
+    }
+  }
+
+  GIVEN("A read with more alignments than a slab holds") {
+    std::vector<SamRead> reads;
+    for (size_t i = 0; i < 4000; ++i) {
+      reads.push_back(unpairedRead("before" + std::to_string(i), 1, gen));
+    }
+    reads.push_back(unpairedRead("many", 10000, gen));
+    reads.push_back(unpairedRead("after", 2, gen));
+    writeSam(paths[0], reads);
+    THEN("All of its alignments are in one group") {
+      REQUIRE(groupsReads<UnpairedRead>({paths[0]}, reads, 4));
+    }
+  }
+
+  GIVEN("Paired-end reads, with orphans and unaligned pairs, over many slabs of records") {
+    std::vector<SamRead> reads;
+    for (size_t i = 0; i < 20000; ++i) {
+      reads.push_back(pairedRead("pair" + std::to_string(i), gen() % 4, gen));
+    }
+    writeSam(paths[0], reads);
+    THEN("Each aligned read is a single group, and no pair is split") {
+      for (uint32_t numParseThreads : {1, 2, 8}) {
+        REQUIRE(groupsReads<ReadPair>({paths[0]}, reads, numParseThreads));
+      }
+    }
+  }
+
+  GIVEN("Several files, each ending in the middle of a slab") {
+    std::vector<SamRead> reads;
+    for (size_t f = 0; f < paths.size(); ++f) {
+      std::vector<SamRead> fileReads;
+      for (size_t i = 0; i < 3000; ++i) {
+        fileReads.push_back(pairedRead("file" + std::to_string(f) + "_" + std::to_string(i),
+                                       gen() % 4, gen));
+      }
+      // The last record of a file is the first end of a pair, whose mate is
+      // missing; it is dropped.
+      std::string dangling = samRecord("dangling" + std::to_string(f),
+                                       BAM_FPAIRED | BAM_FPROPER_PAIR | BAM_FREAD1, 3, 3);
+      writeSam(paths[f], fileReads, dangling);
+      reads.insert(reads.end(), fileReads.begin(), fileReads.end());
+    }
+    THEN("Every file is read to its end, and the unpaired record is dropped") {
+      REQUIRE(groupsReads<ReadPair>(paths, reads, 4));
+    }
+  }
+
+  for (auto& p : paths) { boost::filesystem::remove(p); }
+}
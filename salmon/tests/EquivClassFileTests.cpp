@@ -0,0 +1,128 @@
+#include <random>
+
+#include "EquivClassFile.hpp"
+
+namespace {
+struct TestClass {
+  std::vector<uint32_t> txps;
+  std::vector<double> weights;
+  uint64_t count;
+};
+
+// Random classes over numTxps transcripts (the transcripts of a class are
+// usually sorted, but the format doesn't require it)
+std::vector<TestClass> randomClasses(size_t n, uint32_t numTxps, std::mt19937& gen) {
+  std::vector<TestClass> classes(n);
+  for (auto& c : classes) {
+    size_t k = 1 + gen() % 8;
+    for (size_t i = 0; i < k; ++i) {
+      c.txps.push_back(gen() % numTxps);
+      c.weights.push_back(std::generate_canonical<double, 53>(gen));
+    }
+    if (gen() % 2) { std::sort(c.txps.begin(), c.txps.end()); }
+    c.count = (gen() % 10 == 0) ? (uint64_t(1) << 40) + gen() : 1 + gen() % 1000;
+  }
+  return classes;
+}
+
+// Write classes the way GZipWriter::writeEquivCountsBinary does
+bool writeClasses(const boost::filesystem::path& path,
+                  const std::vector<std::string>& names,
+                  const std::vector<TestClass>& classes, bool withWeights) {
+  namespace eqc = salmon::eqclass;
+  std::ofstream out(path.string(), std::ios::binary);
+  if (!eqc::writeHeader(out, names, classes.size(), withWeights)) { return false; }
+  for (size_t start = 0; start < classes.size(); start += eqc::classesPerBlock) {
+    size_t end = std::min(classes.size(), start + eqc::classesPerBlock);
+    std::string raw, block;
+    for (size_t i = start; i < end; ++i) {
+      auto& c = classes[i];
+      eqc::encodeClass(raw, c.txps.data(), c.txps.size(),
+                       withWeights ? c.weights.data() : nullptr, c.count);
+    }
+    if (!eqc::compressBlock(raw, end - start, block)) { return false; }
+    out.write(block.data(), block.size());
+  }
+  return out.good();
+}
+
+// Does the file at path hold exactly these names and classes?
+bool readsBack(const boost::filesystem::path& path,
+               const std::vector<std::string>& names,
+               const std::vector<TestClass>& classes, bool withWeights) {
+  salmon::eqclass::EquivClassReader reader(path.string());
+  bool ok = reader.good() and reader.numTranscripts() == names.size() and
+            reader.numClasses() == classes.size() and
+            reader.hasWeights() == withWeights and
+            reader.transcriptNames() == names;
+  salmon::eqclass::EquivClass ec;
+  for (auto& c : classes) {
+    ok = ok and reader.next(ec) and ec.txps == c.txps and ec.count == c.count;
+    if (withWeights) {
+      ok = ok and ec.weights.size() == c.weights.size();
+      for (size_t i = 0; ok and i < c.weights.size(); ++i) {
+        ok = (ec.weights[i] == static_cast<float>(c.weights[i]));
+      }
+    } else {
+      ok = ok and ec.weights.empty();
+    }
+  }
+  return ok and !reader.next(ec) and reader.good();
+}
+}
+
+SCENARIO("Binary equivalence class files read back what was written") {
+  std::mt19937 gen(5);
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 1000; ++i) { names.push_back("txp" + std::to_string(i)); }
+  auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+
+  for (bool withWeights : {false, true}) {
+    std::string weights = withWeights ? "with" : "without";
+    GIVEN("Classes " + weights + " weights, spanning several blocks") {
+      auto classes = randomClasses(2 * salmon::eqclass::classesPerBlock + 17,
+                                   names.size(), gen);
+      THEN("Every class is read back, in order") {
+        REQUIRE(writeClasses(path, names, classes, withWeights));
+        REQUIRE(readsBack(path, names, classes, withWeights));
+      }
+    }
+    GIVEN("A single class " + weights + " weights, over extreme transcript ids") {
+      std::vector<TestClass> classes{
+          {{4294967295u, 0, 4294967295u, 7}, {0.0, 1.0, 1e-30, 0.5}, 0}};
+      THEN("It is read back") {
+        REQUIRE(writeClasses(path, names, classes, withWeights));
+        REQUIRE(readsBack(path, names, classes, withWeights));
+      }
+    }
+    GIVEN("No classes at all " + weights + " weights") {
+      std::vector<TestClass> classes;
+      THEN("The names are read back, and there are no classes") {
+        REQUIRE(writeClasses(path, names, classes, withWeights));
+        REQUIRE(readsBack(path, names, classes, withWeights));
+      }
+    }
+  }
+
+  GIVEN("A truncated file") {
+    auto classes = randomClasses(1000, names.size(), gen);
+    REQUIRE(writeClasses(path, names, classes, true));
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 10);
+    THEN("Reading it fails, rather than returning garbage") {
+      salmon::eqclass::EquivClassReader reader(path.string());
+      salmon::eqclass::EquivClass ec;
+      size_t numRead{0};
+      while (reader.next(ec)) { ++numRead; }
+      REQUIRE(!reader.good());
+      REQUIRE(numRead < classes.size());
+    }
+  }
+  GIVEN("A file that isn't a binary equivalence class file") {
+    { std::ofstream ofs(path.string()); ofs << "3\n2\nA\nB\nC\n"; }
+    THEN("It is rejected") {
+      salmon::eqclass::EquivClassReader reader(path.string());
+      REQUIRE(!reader.good());
+    }
+  }
+  boost::filesystem::remove(path);
+}
@@ -0,0 +1,160 @@
+#include <chrono>
+#include <functional>
+#include "ExpectedGCAccumulator.hpp"
+
+// The direct (per start position, per fragment length) computation of the
+// expected GC distribution that ExpectedGCAccumulator replaces.
+template <typename CondCDFT>
+void directExpectedGC(const Transcript& txp, int32_t numStarts, int32_t flLow,
+                      int32_t flHigh, int32_t flStep, CondCDFT& conditionalCDF,
+                      const Eigen::VectorXd& contextCountsFP,
+                      const Eigen::VectorXd& contextCountsTP,
+                      const Eigen::VectorXd& windowLensFP,
+                      const Eigen::VectorXd& windowLensTP, double weight,
+                      GCFragModel& expectGC) {
+  int32_t refLen = static_cast<int32_t>(txp.RefLength);
+  for (int32_t fragStart = 0; fragStart < numStarts; ++fragStart) {
+    size_t sp = static_cast<size_t>((flLow > 0) ? flLow - 1 : 0);
+    double prevFLMass = conditionalCDF(sp);
+    for (int32_t fl = flLow; fl <= flHigh; fl += flStep) {
+      int32_t fragEnd = fragStart + fl - 1;
+      if (fragEnd >= refLen) { break; }
+      auto gcFrac = txp.gcFrac(fragStart, fragEnd);
+      double contextLength = (windowLensFP[fragStart] + windowLensTP[fragEnd]);
+      int32_t contextFrac = (contextLength > 0) ?
+        (std::lrint(100.0 *
+                    (contextCountsFP[fragStart] + contextCountsTP[fragEnd]) / contextLength)) :
+        0;
+      GCDesc desc{gcFrac, contextFrac};
+      expectGC.inc(desc, weight * (conditionalCDF(fl) - prevFLMass));
+      prevFLMass = conditionalCDF(fl);
+    }
+  }
+}
+
+struct ExpectedGCTestCase {
+  std::vector<std::string> seqs;
+  std::vector<Transcript> txps;
+  std::vector<Eigen::VectorXd> cFP, cTP, lFP, lTP;
+  std::vector<double> cdf;
+
+  ExpectedGCTestCase(size_t numTxps, size_t minLen, size_t maxLen,
+                     bool reduceGCMemory, std::mt19937& gen) {
+    std::uniform_int_distribution<> nucDis(0, 3);
+    std::uniform_int_distribution<> lenDis(minLen, maxLen);
+    std::uniform_int_distribution<> ctxDis(0, 5);
+    seqs.reserve(numTxps);
+    txps.reserve(numTxps);
+    for (size_t tn = 0; tn < numTxps; ++tn) {
+      seqs.push_back(generateRandomSequence(lenDis(gen), nucDis, gen));
+      auto len = seqs.back().length();
+      txps.emplace_back(tn, "txp", len);
+      txps.back().setSequenceBorrowed(seqs.back().c_str(), true, reduceGCMemory);
+      Eigen::VectorXd a(len), b(len), c(len), d(len);
+      for (size_t i = 0; i < len; ++i) {
+        c[i] = ctxDis(gen);
+        d[i] = ctxDis(gen);
+        a[i] = std::uniform_int_distribution<>(0, c[i])(gen);
+        b[i] = std::uniform_int_distribution<>(0, d[i])(gen);
+      }
+      cFP.push_back(a); cTP.push_back(b); lFP.push_back(c); lTP.push_back(d);
+    }
+    // A (roughly) normal fragment length distribution with mean 250
+    cdf.resize(1001);
+    double cum{0.0};
+    for (size_t i = 0; i < cdf.size(); ++i) {
+      double z = (static_cast<double>(i) - 250.0) / 25.0;
+      cum += std::exp(-0.5 * z * z);
+      cdf[i] = cum;
+    }
+    for (auto& v : cdf) { v /= cum; }
+  }
+
+  template <typename FuncT>
+  void run(FuncT f, GCFragModel& model, int32_t flStep) {
+    for (size_t tn = 0; tn < txps.size(); ++tn) {
+      auto& txp = txps[tn];
+      int32_t refLen = static_cast<int32_t>(txp.RefLength);
+      int32_t cdfMaxArg = std::min(static_cast<int32_t>(cdf.size() - 1), refLen);
+      double cdfMaxVal = cdf[cdfMaxArg];
+      auto conditionalCDF = [cdfMaxArg, cdfMaxVal, this](double x) -> double {
+        return (x > cdfMaxArg) ? 1.0 : (cdf[x] / cdfMaxVal);
+      };
+      int32_t flLow = (refLen < cdfMaxArg) ? 1 : 180;
+      int32_t flHigh = (refLen < cdfMaxArg) ? cdfMaxArg : 320;
+      f(txp, refLen - 6, flLow, flHigh, flStep, conditionalCDF, cFP[tn], cTP[tn],
+        lFP[tn], lTP[tn], 1.0 / (tn + 1), model);
+    }
+  }
+};
+
+SCENARIO("The expected GC accumulator matches the direct computation") {
+  std::mt19937 gen(42);
+  for (bool reduceGCMemory : {false, true}) {
+    for (size_t condBins : {1, 3}) {
+      for (size_t gcBins : {25, 101}) {
+        for (int32_t flStep : {1, 5}) {
+          GIVEN("Random transcripts with " + std::to_string(condBins) + " context bins, " +
+                std::to_string(gcBins) + " GC bins, step " + std::to_string(flStep) +
+                ", reduceGCMemory = " + std::to_string(reduceGCMemory)) {
+            ExpectedGCTestCase tc(50, 100, 1200, reduceGCMemory, gen);
+            GCFragModel direct(condBins, gcBins, distribution_utils::DistributionSpace::LINEAR);
+            GCFragModel accumulated(condBins, gcBins, distribution_utils::DistributionSpace::LINEAR);
+            ExpectedGCAccumulator acc(condBins, gcBins);
+            tc.run([](const Transcript& txp, int32_t n, int32_t lo, int32_t hi, int32_t st,
+                      std::function<double(double)> ccdf, const Eigen::VectorXd& a,
+                      const Eigen::VectorXd& b, const Eigen::VectorXd& c,
+                      const Eigen::VectorXd& d, double w, GCFragModel& m) {
+                     directExpectedGC(txp, n, lo, hi, st, ccdf, a, b, c, d, w, m);
+                   }, direct, flStep);
+            tc.run([&acc](const Transcript& txp, int32_t n, int32_t lo, int32_t hi, int32_t st,
+                          std::function<double(double)> ccdf, const Eigen::VectorXd& a,
+                          const Eigen::VectorXd& b, const Eigen::VectorXd& c,
+                          const Eigen::VectorXd& d, double w, GCFragModel& m) {
+                     acc.addTranscript(txp, n, lo, hi, st, ccdf, a, b, c, d, w, m);
+                   }, accumulated, flStep);
+            THEN("Every bin has the same mass") {
+              for (int32_t ctx = 0; ctx <= 100; ++ctx) {
+                for (int32_t frac = 0; frac <= 100; ++frac) {
+                  GCDesc desc{frac, ctx};
+                  REQUIRE(accumulated.get(desc) == Approx(direct.get(desc)));
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Not run by default; use `unitTests "[.benchmark]"`.
+TEST_CASE("Expected GC accumulator benchmark", "[.benchmark]") {
+  std::mt19937 gen(42);
+  // Roughly the length distribution of a GENCODE transcriptome (but fewer
+  // transcripts, so that the direct computation finishes in reasonable time).
+  ExpectedGCTestCase tc(2000, 300, 4000, false, gen);
+  GCFragModel direct(3, 101, distribution_utils::DistributionSpace::LINEAR);
+  GCFragModel accumulated(3, 101, distribution_utils::DistributionSpace::LINEAR);
+  ExpectedGCAccumulator acc(3, 101);
+
+  auto start = std::chrono::steady_clock::now();
+  tc.run([](const Transcript& txp, int32_t n, int32_t lo, int32_t hi, int32_t st,
+            std::function<double(double)> ccdf, const Eigen::VectorXd& a,
+            const Eigen::VectorXd& b, const Eigen::VectorXd& c,
+            const Eigen::VectorXd& d, double w, GCFragModel& m) {
+           directExpectedGC(txp, n, lo, hi, st, ccdf, a, b, c, d, w, m);
+         }, direct, 1);
+  auto mid = std::chrono::steady_clock::now();
+  tc.run([&acc](const Transcript& txp, int32_t n, int32_t lo, int32_t hi, int32_t st,
+                std::function<double(double)> ccdf, const Eigen::VectorXd& a,
+                const Eigen::VectorXd& b, const Eigen::VectorXd& c,
+                const Eigen::VectorXd& d, double w, GCFragModel& m) {
+           acc.addTranscript(txp, n, lo, hi, st, ccdf, a, b, c, d, w, m);
+         }, accumulated, 1);
+  auto stop = std::chrono::steady_clock::now();
+
+  std::cerr << "direct: " << std::chrono::duration<double>(mid - start).count()
+            << "s, accumulated: " << std::chrono::duration<double>(stop - mid).count()
+            << "s\n";
+}
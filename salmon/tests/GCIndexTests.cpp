@@ -0,0 +1,51 @@
+#include "GCIndex.hpp"
+
+SCENARIO("The GC index matches direct G/C counting") {
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<> dis(0, 3);
+  for (bool sparse : {false, true}) {
+    // Lengths around word / count boundaries, and one spanning several
+    // anchors (every 2^16 bases)
+    for (size_t len : {1, 63, 64, 65, 511, 512, 513, 1000, 200000}) {
+      GIVEN("A random sequence of length " + std::to_string(len) +
+            ", sparse = " + std::to_string(sparse)) {
+        auto seq = generateRandomSequence(len, dis, gen);
+        // Lower-case bases count too
+        for (size_t i = 0; i < len; i += 7) { seq[i] = std::tolower(seq[i]); }
+        std::vector<uint32_t> direct(len + 1, 0);
+        for (size_t i = 0; i < len; ++i) {
+          auto c = std::toupper(seq[i]);
+          direct[i + 1] = direct[i] + ((c == 'G' or c == 'C') ? 1 : 0);
+        }
+        GCIndex idx(seq.c_str(), len, sparse);
+
+        THEN("Every rank is correct") {
+          bool allEqual{true};
+          for (uint32_t i = 0; i <= len; ++i) {
+            allEqual = allEqual and (idx.rank(i) == direct[i]);
+          }
+          REQUIRE(allEqual);
+        }
+        THEN("The decoded prefix counts are correct") {
+          std::vector<uint32_t> prefix(len + 1);
+          idx.prefixCounts(prefix.data());
+          REQUIRE(prefix == direct);
+        }
+        THEN("Batched range counts are correct") {
+          std::uniform_int_distribution<int32_t> posDis(0, len - 1);
+          std::vector<int32_t> s(1000), e(1000);
+          for (size_t j = 0; j < s.size(); ++j) {
+            s[j] = posDis(gen);
+            e[j] = posDis(gen);
+            if (s[j] > e[j]) { std::swap(s[j], e[j]); }
+          }
+          std::vector<uint32_t> out(s.size());
+          idx.rangeCounts(s.data(), e.data(), s.size(), out.data());
+          for (size_t j = 0; j < s.size(); ++j) {
+            REQUIRE(out[j] == direct[e[j] + 1] - direct[s[j]]);
+          }
+        }
+      }
+    }
+  }
+}
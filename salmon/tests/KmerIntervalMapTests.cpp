@@ -0,0 +1,158 @@
+#include <chrono>
+#include <random>
+
+#include "KmerIntervalMap.hpp"
+
+namespace {
+// Random (distinct) k-mer codes, with intervals of the size they'd have in a
+// BWT of ~2^30 rows
+std::vector<std::pair<uint64_t, bwtintv_t>>
+randomKmerIntervals(size_t n, uint32_t k, std::mt19937_64& gen) {
+  uint64_t mask = (k == 32) ? ~uint64_t(0) : ((uint64_t(1) << (2 * k)) - 1);
+  std::vector<uint64_t> codes(n);
+  for (auto& c : codes) { c = gen() & mask; }
+  std::sort(codes.begin(), codes.end());
+  codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+  std::vector<std::pair<uint64_t, bwtintv_t>> entries;
+  for (auto c : codes) {
+    bwtintv_t iv;
+    iv.x[0] = gen() & ((uint64_t(1) << 30) - 1);
+    iv.x[1] = gen() & ((uint64_t(1) << 30) - 1);
+    iv.x[2] = 1 + (gen() % 64);
+    iv.info = k;
+    entries.emplace_back(c, iv);
+  }
+  return entries;
+}
+
+bool sameInterval(const bwtintv_t& a, const bwtintv_t& b) {
+  return a.x[0] == b.x[0] and a.x[1] == b.x[1] and a.x[2] == b.x[2] and
+         a.info == b.info;
+}
+
+// Does m hold exactly the given intervals (and reject other k-mers)?
+bool holdsExactly(const KmerIntervalMap& m,
+                  const std::vector<std::pair<uint64_t, bwtintv_t>>& entries,
+                  std::mt19937_64& gen) {
+  bool ok = (m.size() == entries.size());
+  std::vector<uint64_t> codes;
+  bwtintv_t iv;
+  for (auto& kv : entries) {
+    ok = ok and m.find(kv.first, iv) and sameInterval(iv, kv.second);
+    codes.push_back(kv.first);
+  }
+  std::sort(codes.begin(), codes.end());
+  uint64_t mask = (m.k() == 32) ? ~uint64_t(0) : ((uint64_t(1) << (2 * m.k())) - 1);
+  for (size_t i = 0; i < 10000; ++i) {
+    uint64_t c = gen() & mask;
+    if (!std::binary_search(codes.begin(), codes.end(), c)) {
+      ok = ok and !m.find(c, iv);
+    }
+  }
+  return ok;
+}
+}
+
+SCENARIO("The k-mer interval map holds exactly the intervals it was built from") {
+  std::mt19937_64 gen(7);
+  for (uint32_t k : {7, 15, 31, 32}) {
+    for (size_t n : {0, 1, 5000}) {
+      GIVEN("The intervals of " + std::to_string(n) + " random " +
+            std::to_string(k) + "-mers") {
+        auto entries = randomKmerIntervals(n, k, gen);
+        KmerIntervalMap m;
+        m.build(k, entries);
+
+        THEN("Each k-mer maps to its interval, and no other k-mer is found") {
+          REQUIRE(m.k() == k);
+          REQUIRE(holdsExactly(m, entries, gen));
+        }
+        THEN("The same holds once it is saved and loaded again") {
+          auto path = boost::filesystem::temp_directory_path() /
+                      boost::filesystem::unique_path();
+          REQUIRE(m.save(path));
+          KmerIntervalMap loaded;
+          REQUIRE(loaded.load(path));
+          REQUIRE(loaded.k() == k);
+          REQUIRE(holdsExactly(loaded, entries, gen));
+          boost::filesystem::remove(path);
+        }
+      }
+    }
+  }
+
+  GIVEN("A k-mer given as bases") {
+    std::vector<uint8_t> seq{0, 1, 2, 3, 3, 2, 1};
+    bwtintv_t iv;
+    iv.x[0] = 3; iv.x[1] = 9; iv.x[2] = 2; iv.info = 7;
+    KmerIntervalMap m;
+    m.build(7, {{0x6f9, iv}});
+
+    THEN("It is found by its bases, unless one of them is ambiguous") {
+      bwtintv_t found;
+      REQUIRE(m.encode(seq.data()) == 0x6f9);
+      REQUIRE(m.find(seq.data(), found));
+      REQUIRE(sameInterval(found, iv));
+      seq[3] = 4;
+      REQUIRE(!m.find(seq.data(), found));
+    }
+  }
+
+  GIVEN("A file that isn't a k-mer interval map") {
+    auto path = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path();
+    { std::ofstream ofs(path.string()); ofs << "not an index"; }
+    THEN("It isn't loaded") {
+      KmerIntervalMap m;
+      REQUIRE(!m.load(path));
+      REQUIRE(m.size() == 0);
+    }
+    boost::filesystem::remove(path);
+  }
+}
+
+// Not run by default; use `unitTests "[.benchmark]"`.
+TEST_CASE("K-mer interval map benchmark", "[.benchmark]") {
+  std::mt19937_64 gen(42);
+  uint32_t k{31};
+  // Enough k-mers that neither map fits in cache
+  auto entries = randomKmerIntervals(size_t(1) << 24, k, gen);
+
+  // (Roughly) the layout this replaced
+  std::unordered_map<uint64_t, bwtintv_t> hashMap;
+  hashMap.reserve(entries.size());
+  for (auto& kv : entries) { hashMap[kv.first] = kv.second; }
+  KmerIntervalMap m;
+  m.build(k, entries);
+
+  // Half of the queries are present, half aren't (as with read k-mers that
+  // contain errors)
+  std::vector<uint64_t> queries(size_t(1) << 24);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    queries[i] = (i & 1) ? entries[gen() % entries.size()].first
+                         : (gen() & ((uint64_t(1) << (2 * k)) - 1));
+  }
+
+  using Clock = std::chrono::steady_clock;
+  uint64_t hashSum{0}, mapSum{0};
+  auto start = Clock::now();
+  for (auto q : queries) {
+    auto it = hashMap.find(q);
+    if (it != hashMap.end()) { hashSum += it->second.x[0]; }
+  }
+  auto mid = Clock::now();
+  bwtintv_t iv;
+  for (auto q : queries) {
+    if (m.find(q, iv)) { mapSum += iv.x[0]; }
+  }
+  auto stop = Clock::now();
+  REQUIRE(hashSum == mapSum);
+
+  // Each node of the hash map holds the key, the interval and a next
+  // pointer, and there's a bucket pointer per node (at most)
+  size_t hashBytes = hashMap.size() * (sizeof(uint64_t) + sizeof(bwtintv_t) + 2 * sizeof(void*));
+  std::cerr << "unordered_map: " << std::chrono::duration<double>(mid - start).count()
+            << "s, ~" << hashBytes / double(entries.size()) << " bytes / k-mer; "
+            << "KmerIntervalMap: " << std::chrono::duration<double>(stop - mid).count()
+            << "s, " << m.sizeInBytes() / double(entries.size()) << " bytes / k-mer\n";
+}
@@ -0,0 +1,31 @@
+#include "MinimalPerfectHash.hpp"
+
+SCENARIO("The minimal perfect hash is a bijection onto [0, n)") {
+  std::mt19937_64 gen(11);
+  for (size_t n : {0, 1, 2, 100, 10000, 300000}) {
+    GIVEN("A set of " + std::to_string(n) + " random keys") {
+      std::vector<uint64_t> keys(n);
+      for (auto& k : keys) { k = gen(); }
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+      MinimalPerfectHash mph(keys);
+
+      THEN("Every key gets a distinct index below n") {
+        REQUIRE(mph.size() == keys.size());
+        std::vector<bool> seen(keys.size(), false);
+        bool allDistinct{true};
+        for (auto k : keys) {
+          auto i = mph.lookup(k);
+          allDistinct = allDistinct and (i < keys.size()) and !seen[i];
+          if (i < keys.size()) { seen[i] = true; }
+        }
+        REQUIRE(allDistinct);
+      }
+      THEN("It takes a few bits per key") {
+        if (keys.size() >= 10000) {
+          REQUIRE(mph.sizeInBytes() * 8 < 5 * keys.size());
+        }
+      }
+    }
+  }
+}
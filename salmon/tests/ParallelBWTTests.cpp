@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+#include "ParallelBWT.hpp"
+
+extern "C" {
+bwt_t* bwt_pac2bwt(const char* fn_pac, int use_is);
+}
+
+namespace {
+// Pack text (bases 0-3) as BWA's .pac file does: 4 bases to a byte (most
+// significant bits first), and then a byte holding seqLen % 4 (preceded by
+// a zero byte if that is 0).
+std::vector<uint8_t> packText(const std::vector<uint8_t>& text) {
+  std::vector<uint8_t> pac((text.size() + 3) / 4, 0);
+  for (size_t i = 0; i < text.size(); ++i) {
+    pac[i >> 2] |= text[i] << ((~i & 3) << 1);
+  }
+  if (text.size() % 4 == 0) { pac.push_back(0); }
+  pac.push_back(text.size() % 4);
+  return pac;
+}
+
+// The BWT and SA samples of text as `bwa index` builds them
+bwt_t* bwaBWT(const boost::filesystem::path& path, const std::vector<uint8_t>& pac,
+              int saInterval) {
+  {
+    std::ofstream out(path.string(), std::ios::binary);
+    out.write(reinterpret_cast<const char*>(pac.data()), pac.size());
+  }
+  bwt_t* bwt = bwt_pac2bwt(path.c_str(), 1);
+  bwt_bwtupdate_core(bwt);
+  bwt_gen_cnt_table(bwt);
+  bwt_cal_sa(bwt, saInterval);
+  return bwt;
+}
+
+/**
+ * Does buildBWT (sorting at most maxRoundSuffixes suffixes per round) give
+ * exactly the BWT and SA samples that libbwa does?
+ */
+bool sameAsBWA(const std::vector<uint8_t>& text, int saInterval, uint64_t maxRoundSuffixes) {
+  auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  auto pac = packText(text);
+  bwt_t* expected = bwaBWT(path, pac, saInterval);
+  boost::filesystem::remove(path);
+  bwt_t* got = salmon::fmd::buildBWT(pac.data(), text.size(), saInterval, nullptr,
+                                     maxRoundSuffixes);
+  if (got == nullptr) {
+    bwt_destroy(expected);
+    return false;
+  }
+  // (with the occurrence counts interleaved, as they're saved)
+  bwt_bwtupdate_core(got);
+
+  bool same = got->primary == expected->primary and got->seq_len == expected->seq_len and
+              std::equal(got->L2, got->L2 + 5, expected->L2) and
+              got->bwt_size == expected->bwt_size and
+              std::equal(got->bwt, got->bwt + got->bwt_size, expected->bwt) and
+              got->sa_intv == expected->sa_intv and got->n_sa == expected->n_sa and
+              std::equal(got->sa, got->sa + got->n_sa, expected->sa);
+  bwt_destroy(got);
+  bwt_destroy(expected);
+  return same;
+}
+}
+
+SCENARIO("The parallel BWT construction gives what BWA's does") {
+  std::mt19937 gen(13);
+  // Small enough that the suffixes are sorted over several rounds
+  uint64_t maxRoundSuffixes{4096};
+
+  GIVEN("Random texts") {
+    THEN("The BWT and SA samples are BWA's, whatever the length") {
+      for (size_t n : {1, 2, 3, 4, 31, 32, 33, 1000, 50000, 50003}) {
+        std::vector<uint8_t> text(n);
+        for (auto& b : text) { b = gen() % 4; }
+        for (int saInterval : {1, 4, 32}) {
+          REQUIRE(sameAsBWA(text, saInterval, maxRoundSuffixes));
+        }
+      }
+    }
+  }
+
+  GIVEN("Repetitive texts") {
+    // A short motif repeated, with a few substitutions, and then a copy of
+    // the whole (as with transcripts sharing exons)
+    std::string motif{"ACGTTGCAAGGC"};
+    std::vector<uint8_t> text;
+    for (size_t i = 0; i < 30000; ++i) {
+      uint8_t b = std::string("ACGT").find(motif[i % motif.size()]);
+      text.push_back((gen() % 500 == 0) ? (b + 1) % 4 : b);
+    }
+    text.insert(text.end(), text.begin(), text.end());
+    text[45000] = (text[45000] + 2) % 4;
+
+    THEN("The BWT and SA samples are BWA's") {
+      for (int saInterval : {1, 32}) {
+        REQUIRE(sameAsBWA(text, saInterval, maxRoundSuffixes));
+      }
+    }
+  }
+
+  GIVEN("Homopolymers, and texts that are mostly one") {
+    std::vector<uint8_t> poly(20000, 0);
+    std::vector<uint8_t> mostly(20001, 3);
+    mostly[7] = 1;
+    mostly[10000] = 0;
+
+    THEN("The BWT and SA samples are BWA's, though a bucket holds more than a round does") {
+      REQUIRE(sameAsBWA(poly, 32, maxRoundSuffixes));
+      REQUIRE(sameAsBWA(mostly, 4, maxRoundSuffixes));
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#include "QuantFileParser.hpp"
+
+SCENARIO("quant.sf numbers are parsed exactly") {
+  GIVEN("Numbers in the formats salmon writes, and a few others") {
+    std::vector<std::string> nums{"0",        "1",          "0.000000",
+                                  "12.345",   "1234.567890", "-3.25",
+                                  "+7",       "0.000123",   "1.5e-05",
+                                  "2E10",     "6.02214076e23",
+                                  "123456789012345678901234.5",
+                                  "0.1234567890123456789012", "nan", "inf"};
+    THEN("They match strtod") {
+      for (auto& s : nums) {
+        const char* p = s.data();
+        double v{0.0};
+        REQUIRE(salmon::quantfile::parseDouble(p, s.data() + s.size(), v));
+        REQUIRE(p == s.data() + s.size());
+        double expected = std::strtod(s.c_str(), nullptr);
+        if (std::isnan(expected)) {
+          REQUIRE(std::isnan(v));
+        } else {
+          REQUIRE(v == expected);
+        }
+      }
+    }
+  }
+  GIVEN("Random values printed with fixed precision") {
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> dis(0.0, 1e6);
+    THEN("They match strtod") {
+      bool allEqual{true};
+      char buf[64];
+      for (size_t i = 0; i < 100000; ++i) {
+        int n = std::snprintf(buf, sizeof(buf), (i % 2) ? "%f" : "%.3f", dis(gen));
+        const char* p = buf;
+        double v{0.0};
+        salmon::quantfile::parseDouble(p, buf + n, v);
+        allEqual = allEqual and (v == std::strtod(buf, nullptr));
+      }
+      REQUIRE(allEqual);
+    }
+  }
+}
+
+SCENARIO("quant.sf records are parsed") {
+  GIVEN("A quant.sf file with a header, and no final newline") {
+    std::string contents = "Name\tLength\tEffectiveLength\tTPM\tNumReads\n"
+                           "txp1\t1000\t812.5\t10.000000\t20.000000\n"
+                           "txp2\t50\t12.000\t0.000000\t0.000000";
+    salmon::quantfile::QuantFileParser parser(contents.data(),
+                                              contents.data() + contents.size());
+    salmon::quantfile::QuantRecord rec;
+    THEN("Every record is read") {
+      REQUIRE(parser.next(rec));
+      REQUIRE(std::string(rec.name, rec.nameLen) == "txp1");
+      REQUIRE(rec.len == 1000.0);
+      REQUIRE(rec.effectiveLen == 812.5);
+      REQUIRE(rec.tpm == 10.0);
+      REQUIRE(rec.numReads == 20.0);
+      REQUIRE(parser.next(rec));
+      REQUIRE(std::string(rec.name, rec.nameLen) == "txp2");
+      REQUIRE(rec.effectiveLen == 12.0);
+      REQUIRE(!parser.next(rec));
+      REQUIRE(!parser.error());
+    }
+  }
+  GIVEN("A truncated record") {
+    std::string contents = "txp1\t1000\t812.5\n";
+    salmon::quantfile::QuantFileParser parser(contents.data(),
+                                              contents.data() + contents.size());
+    salmon::quantfile::QuantRecord rec;
+    THEN("It is an error") {
+      REQUIRE(!parser.next(rec));
+      REQUIRE(parser.error());
+    }
+  }
+}
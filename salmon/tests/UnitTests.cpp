@@ -9,5 +9,13 @@
 bool verbose=false; // Apparently, we *need* this (OSX)
 
 #include "GCSampleTests.cpp"
+#include "GCIndexTests.cpp"
+#include "QuantFileTests.cpp"
+#include "EquivClassFileTests.cpp"
+#include "BAMQueueTests.cpp"
+#include "ExpectedGCTests.cpp"
 #include "LibraryTypeTests.cpp"
+#include "MinimalPerfectHashTests.cpp"
+#include "KmerIntervalMapTests.cpp"
+#include "ParallelBWTTests.cpp"
 //#include "KmerHistTests.cpp"